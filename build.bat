@@ -1,6 +1,19 @@
 @echo off
 if not exist "bin" mkdir bin
 pushd bin
-cl -nologo -Oi -Od -Zi -MD ../game.cpp -I"C:/Programming/sdl/include" /link -out:iarc.exe -subsystem:console -debug SDL2.lib SDL2main.lib opengl32.lib
+if "%1"=="reload" goto reload
+cl -nologo -Oi -Od -Zi -MD -DDETERMINISTIC_PHYSICS ../game.cpp -I"C:/Programming/sdl/include" /link -out:iarc.exe -subsystem:console -debug SDL2.lib SDL2main.lib opengl32.lib
 popd
 bin\iarc.exe
+goto :eof
+
+:reload
+rem build reload builds the game as game.dll, and the platform layer that
+rem loads it, unless it is running already. Run it again while the game
+rem runs to load the changes. Each build gets its own pdb, since the
+rem debugger holds on to the one of the module that is loaded.
+tasklist /fi "imagename eq iarc_reload.exe" | find /i "iarc_reload.exe" > nul
+if errorlevel 1 cl -nologo -Oi -Od -Zi -MD -DDETERMINISTIC_PHYSICS -DGAME_HOT_RELOAD ../platform_sdl.cpp -I"C:/Programming/sdl/include" /link -out:iarc_reload.exe -subsystem:console -debug SDL2.lib SDL2main.lib opengl32.lib
+del game_*.pdb > nul 2> nul
+cl -nologo -Oi -Od -Zi -MD -LD -DDETERMINISTIC_PHYSICS -DGAME_HOT_RELOAD ../game.cpp -I"C:/Programming/sdl/include" /link -out:game.dll -PDB:game_%random%.pdb -debug iarc_reload.lib SDL2.lib opengl32.lib
+popd
@@ -0,0 +1,232 @@
+// Controllers
+//
+// A controller flies the player by choosing the motor voltages every
+// tick, instead of the keys, see Controller in sim.cpp. This is what we
+// test hover and pendulum stabilizing controllers with. The autopilot
+// below is the built-in one: it holds the player at a target point with
+// the pendulum hanging still below it.
+//
+// control_evaluate_batch flies one controller in many headless worlds
+// and measures how well each of them held a target. Every world starts
+// from a different spot and meets different gusts, and the worlds are
+// spread over all cores.
+#include <atomic>
+#include <thread>
+
+#define CONTROL_SEED        0x636f6e74726f6c
+#define CONTROL_MAX_THREADS 64
+
+// Linear state feedback around hover, set up as a PD cascade: the
+// position error asks for an acceleration, the horizontal part of that
+// asks for a tilt, and the attitude loop tracks the tilt. The pendulum
+// is damped by chasing a target that leads its horizontal offset, like
+// a crane that moves toward a swinging load. Gains from an LQR design
+// on the linearized model fit in the same slots.
+struct Autopilot
+{
+    vec2 target;  // Where to hold the player, m
+    r32 kp_x;     // 1/s^2
+    r32 kd_x;     // 1/s
+    r32 kp_y;     // 1/s^2
+    r32 kd_y;     // 1/s
+    r32 kp_theta; // 1/s^2
+    r32 kd_theta; // 1/s
+    r32 k_swing;  // Lead on the pendulum's offset from the player
+    r32 max_tilt; // rad
+};
+
+void autopilot_defaults(Autopilot *a)
+{
+    a->target = m_vec2(0.0f, 2.0f);
+    a->kp_x = 4.0f;
+    a->kd_x = 3.5f;
+    a->kp_y = 6.0f;
+    a->kd_y = 5.0f;
+    a->kp_theta = 60.0f;
+    a->kd_theta = 12.0f;
+    a->k_swing = 0.5f;
+    a->max_tilt = 0.5f;
+}
+
+void autopilot_control(const Sim *s, const void *params, r32 *l_motor, r32 *r_motor)
+{
+    const Autopilot *a = (const Autopilot*)params;
+    const Player *player = &s->player;
+    const Pendulum *pendulum = &s->pendulum;
+    r32 g = s->world.g;
+
+    r32 swing = pendulum->position.x-player->position.x;
+    r32 Dswing = pendulum->Dposition.x-player->Dposition.x;
+    r32 ex = player->position.x-a->target.x-a->k_swing*swing;
+    r32 Dex = player->Dposition.x-a->k_swing*Dswing;
+    r32 ey = player->position.y-a->target.y;
+    r32 ax = -a->kp_x*ex-a->kd_x*Dex;
+    r32 ay = m_clamp(-a->kp_y*ey-a->kd_y*player->Dposition.y, -0.5f*g, 0.5f*g);
+
+    // The thrust points along the normal (-sin theta, cos theta), so
+    // accelerating to the right takes a negative tilt.
+    r32 theta = player->theta-(r32)TWO_PI*floorf((player->theta+(r32)PI)/(r32)TWO_PI);
+    r32 theta_ref = m_clamp(-ax/(g+ay), -a->max_tilt, a->max_tilt);
+    r32 DDtheta = a->kp_theta*(theta_ref-theta)-a->kd_theta*player->Dtheta;
+
+    // In forces per motor, which are quadratic in the voltage
+    r32 sin_theta, cos_theta;
+    m_sincos(theta, &sin_theta, &cos_theta);
+    r32 hover = voltage_to_force_magnitude(player, compute_hover_voltage(s));
+    r32 thrust = hover*(1.0f+ay/g)/m_max(cos_theta, 0.5f);
+    r32 torque = 0.5f*player->inertia*DDtheta/player->arm;
+    r32 l_force = m_max(thrust-torque, 0.0f);
+    r32 r_force = m_max(thrust+torque, 0.0f);
+    *l_motor = sqrt(l_force/player->motor_constant);
+    *r_motor = sqrt(r_force/player->motor_constant);
+}
+
+Controller autopilot_controller(const Autopilot *a)
+{
+    Controller c;
+    c.control = autopilot_control;
+    c.params = a;
+    return c;
+}
+
+struct ControlSetup
+{
+    SimParams params;
+    WindParams wind;
+    int roombas;
+    int ticks;         // To fly in each world, fewer if the session ends
+    vec2 target;       // To measure the error from, m
+    r32 start_spread;  // Worlds start up to this far from the usual spot, m
+    r32 wind_spacing;  // s, between the gusts that neighbouring worlds meet
+};
+
+void control_setup_defaults(ControlSetup *setup)
+{
+    sim_defaults(&setup->params);
+    wind_defaults(&setup->wind);
+    setup->roombas = 1;
+    setup->ticks = 10*60;
+    setup->target = m_vec2(0.0f, 2.0f);
+    setup->start_spread = 0.5f;
+    setup->wind_spacing = 7.3f;
+}
+
+// How well a controller did in one world
+struct ControlTrial
+{
+    r32 position_error; // RMS distance of the player from the target, m
+    r32 swing;          // RMS horizontal offset of the pendulum from the player, m
+    r32 energy;         // Mean of the squared motor voltages, summed over both motors
+    int resets;         // Times the player left the field
+    int wins;           // Roombas captured at the green line
+    int losses;         // Roombas captured at the red line
+    int magnets;        // Roombas turned with the magnet
+    int points;
+    int ticks;
+};
+
+// Sets up world number index of a batch.
+void control_init_world(Sim *s, const ControlSetup *setup, int index)
+{
+    sim_init(s, &setup->wind, setup->roombas, &setup->params);
+    RngKey key = rng_key(CONTROL_SEED);
+    vec2 offset = m_vec2(2.0f*rng_uniform(key, (u64)index, 0)-1.0f,
+                         2.0f*rng_uniform(key, (u64)index, 1)-1.0f);
+    offset *= setup->start_spread;
+    s->player.position += offset;
+    s->pendulum.position += offset;
+    s->wind.time = setup->wind_spacing*index;
+}
+
+void control_run_world(Sim *s, const Controller *controller, const ControlSetup *setup, ControlTrial *trial)
+{
+    r32 position_error = 0.0f;
+    r32 swing = 0.0f;
+    r32 energy = 0.0f;
+    trial->resets = 0;
+    trial->wins = 0;
+    trial->losses = 0;
+    trial->magnets = 0;
+    trial->ticks = 0;
+    while (trial->ticks < setup->ticks && s->playing)
+    {
+        sim_step(s, 0, SIM_DT, controller);
+        trial->ticks++;
+        vec2 error = s->player.position-setup->target;
+        position_error += m_dot(error, error);
+        swing += m_square(s->pendulum.position.x-s->player.position.x);
+        energy += m_square(s->player.l_motor)+m_square(s->player.r_motor);
+        for (int i = 0; i < s->num_events; i++)
+        {
+            switch (s->events[i].type)
+            {
+                case SIM_EVENT_PLAYER_RESET: trial->resets++; break;
+                case SIM_EVENT_ROOMBA_WIN: trial->wins++; break;
+                case SIM_EVENT_ROOMBA_LOSE: trial->losses++; break;
+                case SIM_EVENT_MAGNET: trial->magnets++; break;
+                default: break;
+            }
+        }
+    }
+    int n = trial->ticks > 0 ? trial->ticks : 1;
+    trial->position_error = sqrt(position_error/n);
+    trial->swing = sqrt(swing/n);
+    trial->energy = energy/n;
+    trial->points = s->points;
+}
+
+struct ControlBatch
+{
+    const Controller *controller;
+    const ControlSetup *setup;
+    ControlTrial *trials;
+    int count;
+    std::atomic<int> next;
+};
+
+void control_batch_worker(ControlBatch *batch)
+{
+    // Too large for the stack of every thread we might run on
+    Sim *s = (Sim*)malloc(sizeof(Sim));
+    for (;;)
+    {
+        int i = batch->next++;
+        if (i >= batch->count || !s)
+            break;
+        control_init_world(s, batch->setup, i);
+        control_run_world(s, batch->controller, batch->setup, &batch->trials[i]);
+    }
+    free(s);
+}
+
+// Flies the controller in count worlds on up to threads threads, 0 for
+// one per core. The results only depend on the controller and setup,
+// not on the number of threads.
+// trials: Holds count results
+void control_evaluate_batch(const Controller *controller, const ControlSetup *setup,
+                            int count, ControlTrial *trials, int threads = 0)
+{
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads > CONTROL_MAX_THREADS)
+        threads = CONTROL_MAX_THREADS;
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    ControlBatch batch;
+    batch.controller = controller;
+    batch.setup = setup;
+    batch.trials = trials;
+    batch.count = count;
+    batch.next = 0;
+
+    // The calling thread is one of the workers
+    std::thread workers[CONTROL_MAX_THREADS];
+    for (int i = 1; i < threads; i++)
+        workers[i] = std::thread(control_batch_worker, &batch);
+    control_batch_worker(&batch);
+    for (int i = 1; i < threads; i++)
+        workers[i].join();
+}
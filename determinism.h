@@ -0,0 +1,24 @@
+#pragma once
+
+// DETERMINISTIC_PHYSICS makes the simulation bit-identical across
+// machines and optimization levels (see sim.cpp). Include this before
+// anything else: the float settings have to come before any code, so
+// that the inline functions in the headers are compiled the same way
+// as the simulation that calls them. Programs that check replays
+// (sync_server, verify) always define it.
+#ifdef DETERMINISTIC_PHYSICS
+#if defined(__FAST_MATH__) || defined(_M_FP_FAST)
+#error "DETERMINISTIC_PHYSICS: build without -ffast-math or /fp:fast"
+#endif
+#if (defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ != 0) || (defined(_M_IX86_FP) && _M_IX86_FP < 2)
+#error "DETERMINISTIC_PHYSICS: float math has to be SSE2, not x87 (-msse2 -mfpmath=sse)"
+#endif
+#if defined(_MSC_VER)
+#pragma float_control(precise, on)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+#endif
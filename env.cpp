@@ -0,0 +1,334 @@
+// Environment
+//
+// A Gym-style interface to train agents on the game without a window.
+// A VecEnv runs count independent sessions, each in its own Sim, and
+// env_step advances all of them by one tick on a pool of threads. The
+// observations, rewards and done flags are written to arrays that the
+// VecEnv owns and the agent reads in place, with ENV_OBS_SIZE floats of
+// observation per environment.
+//
+// A session is done when its time runs out, or after max_ticks. It is
+// reset within the same step, so obs already holds the first
+// observation of the next session when done is set, like vectorized
+// environments in Gym. The reward of a step is reward_point for each
+// point won (and minus that for each point lost), plus reward_magnet for
+// each roomba turned with the magnet.
+//
+//    VecEnv env;
+//    env_create(&env, 4096);
+//    env_reset(&env);
+//    for (;;)
+//    {
+//        choose keys[i] from env.obs+i*ENV_OBS_SIZE
+//        env_step(&env, keys);
+//        learn from env.reward[i] and env.done[i]
+//    }
+//    env_destroy(&env);
+//
+// Most of a Sim is sized by MAX_ROOMBAS, so programs that create many
+// environments should define it to what they need before including
+// sim.cpp. The wind is off by default. Set wind before env_reset to
+// turn it on, which adds little to the cost of a step.
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define ENV_SEED        0x656e76
+#define ENV_MAX_THREADS 64
+#define ENV_CHUNK       64 // Environments handed to a thread at a time
+
+enum EnvObservation
+{
+    ENV_OBS_X = 0,         // Player position, m
+    ENV_OBS_Y,
+    ENV_OBS_DX,            // Player velocity, m/s
+    ENV_OBS_DY,
+    ENV_OBS_SIN_THETA,     // Player tilt
+    ENV_OBS_COS_THETA,
+    ENV_OBS_DTHETA,        // rad/s
+    ENV_OBS_PENDULUM_X,    // Pendulum position relative to the player, m
+    ENV_OBS_PENDULUM_Y,
+    ENV_OBS_PENDULUM_DX,   // Pendulum velocity, m/s
+    ENV_OBS_PENDULUM_DY,
+    ENV_OBS_ROOMBA_X,      // The roomba nearest the pendulum, relative to it, m
+    ENV_OBS_ROOMBA_DIRECTION,
+    ENV_OBS_RED_LINE,      // Relative to the pendulum, m
+    ENV_OBS_GREEN_LINE,
+    ENV_OBS_TIME_LEFT,     // s
+    ENV_OBS_SIZE
+};
+
+struct EnvPool
+{
+    std::thread threads[ENV_MAX_THREADS];
+    int num_threads; // Including the caller of env_step
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    u32 generation; // Counts the steps handed out
+    int busy;       // Threads still working on the current step
+    bool quit;
+    std::atomic<int> next;
+};
+
+struct VecEnv
+{
+    int count;
+    int roombas;
+    WindParams wind;
+    int max_ticks;
+    r32 reward_point;
+    r32 reward_magnet;
+
+    Sim *sims;
+    u32 *episodes; // Sessions started in each environment
+    int *ticks;    // Into the current session
+
+    r32 *obs;      // count*ENV_OBS_SIZE
+    r32 *reward;   // count
+    bool *done;    // count
+
+    // Actions of the step in progress, one of them is set
+    const u32 *keys;
+    const r32 *motors;
+
+    EnvPool *pool;
+};
+
+void env_observe(VecEnv *env, int i)
+{
+    const Sim *s = &env->sims[i];
+    const Player &player = s->player;
+    const Pendulum &pendulum = s->pendulum;
+    const Roombas &roombas = s->roombas;
+    r32 *obs = env->obs+i*ENV_OBS_SIZE;
+
+    int nearest = 0;
+    for (int j = 1; j < roombas.count; j++)
+    {
+        if (m_abs(roombas.x[j]-pendulum.position.x) < m_abs(roombas.x[nearest]-pendulum.position.x))
+            nearest = j;
+    }
+
+    obs[ENV_OBS_X] = player.position.x;
+    obs[ENV_OBS_Y] = player.position.y;
+    obs[ENV_OBS_DX] = player.Dposition.x;
+    obs[ENV_OBS_DY] = player.Dposition.y;
+    m_sincos(player.theta, &obs[ENV_OBS_SIN_THETA], &obs[ENV_OBS_COS_THETA]);
+    obs[ENV_OBS_DTHETA] = player.Dtheta;
+    obs[ENV_OBS_PENDULUM_X] = pendulum.position.x-player.position.x;
+    obs[ENV_OBS_PENDULUM_Y] = pendulum.position.y-player.position.y;
+    obs[ENV_OBS_PENDULUM_DX] = pendulum.Dposition.x;
+    obs[ENV_OBS_PENDULUM_DY] = pendulum.Dposition.y;
+    obs[ENV_OBS_ROOMBA_X] = roombas.x[nearest]-pendulum.position.x;
+    obs[ENV_OBS_ROOMBA_DIRECTION] = roombas.direction[nearest];
+    obs[ENV_OBS_RED_LINE] = s->world.red_line-pendulum.position.x;
+    obs[ENV_OBS_GREEN_LINE] = s->world.green_line-pendulum.position.x;
+    obs[ENV_OBS_TIME_LEFT] = s->TIMER_PLAYER_TIME.t;
+}
+
+// Starts the next session in environment i, with the player a little
+// off the usual spot so that sessions differ.
+void env_reset_one(VecEnv *env, int i)
+{
+    Sim *s = &env->sims[i];
+    sim_init(s, &env->wind, env->roombas);
+    RngKey key = rng_key(ENV_SEED);
+    u64 draw = 2*(u64)env->episodes[i];
+    vec2 offset = m_vec2(rng_uniform(key, (u64)i, draw)-0.5f,
+                         rng_uniform(key, (u64)i, draw+1)-0.5f);
+    s->player.position += offset;
+    s->pendulum.position += offset;
+    env->episodes[i]++;
+    env->ticks[i] = 0;
+}
+
+void env_motor_control(const Sim *, const void *params, r32 *l_motor, r32 *r_motor)
+{
+    const r32 *motors = (const r32*)params;
+    *l_motor = motors[0];
+    *r_motor = motors[1];
+}
+
+void env_step_one(VecEnv *env, int i)
+{
+    Sim *s = &env->sims[i];
+    int points = s->points;
+    if (env->motors)
+    {
+        Controller controller;
+        controller.control = env_motor_control;
+        controller.params = env->motors+2*i;
+        sim_step(s, 0, SIM_DT, &controller);
+    }
+    else
+    {
+        sim_step(s, env->keys[i], SIM_DT);
+    }
+    env->ticks[i]++;
+
+    r32 reward = env->reward_point*(r32)(s->points-points);
+    for (int j = 0; j < s->num_events; j++)
+    {
+        if (s->events[j].type == SIM_EVENT_MAGNET)
+            reward += env->reward_magnet;
+    }
+    env->reward[i] = reward;
+    env->done[i] = !s->playing || (env->max_ticks > 0 && env->ticks[i] >= env->max_ticks);
+    if (env->done[i])
+        env_reset_one(env, i);
+    env_observe(env, i);
+}
+
+void env_work(VecEnv *env)
+{
+    for (;;)
+    {
+        int first = env->pool->next.fetch_add(ENV_CHUNK);
+        if (first >= env->count)
+            break;
+        int end = first+ENV_CHUNK < env->count ? first+ENV_CHUNK : env->count;
+        for (int i = first; i < end; i++)
+            env_step_one(env, i);
+    }
+}
+
+void env_worker(VecEnv *env)
+{
+    EnvPool *pool = env->pool;
+    u32 generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [&]{ return pool->quit || pool->generation != generation; });
+            if (pool->quit)
+                return;
+            generation = pool->generation;
+        }
+        env_work(env);
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->busy--;
+            if (pool->busy == 0)
+                pool->finished.notify_one();
+        }
+    }
+}
+
+// threads: 0 for one per core
+// return: false if out of memory
+bool env_create(VecEnv *env, int count, int threads = 0, int roombas = 1)
+{
+    env->count = count;
+    env->roombas = m_clamp(roombas, 1, MAX_ROOMBAS);
+    wind_defaults(&env->wind);
+    env->max_ticks = 0;
+    env->reward_point = 1.0f;
+    env->reward_magnet = 0.1f;
+    env->sims = (Sim*)malloc(count*sizeof(Sim));
+    env->episodes = (u32*)calloc(count, sizeof(u32));
+    env->ticks = (int*)calloc(count, sizeof(int));
+    env->obs = (r32*)calloc(count*ENV_OBS_SIZE, sizeof(r32));
+    env->reward = (r32*)calloc(count, sizeof(r32));
+    env->done = (bool*)calloc(count, sizeof(bool));
+    env->keys = 0;
+    env->motors = 0;
+    env->pool = 0;
+    if (!env->sims || !env->episodes || !env->ticks || !env->obs || !env->reward || !env->done)
+        return false;
+
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads > ENV_MAX_THREADS)
+        threads = ENV_MAX_THREADS;
+    if (threads > (count+ENV_CHUNK-1)/ENV_CHUNK)
+        threads = (count+ENV_CHUNK-1)/ENV_CHUNK;
+    if (threads < 1)
+        threads = 1;
+    EnvPool *pool = new EnvPool();
+    env->pool = pool;
+    pool->num_threads = threads;
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->quit = false;
+    pool->next = 0;
+    for (int i = 1; i < threads; i++)
+        pool->threads[i] = std::thread(env_worker, env);
+    return true;
+}
+
+void env_destroy(VecEnv *env)
+{
+    EnvPool *pool = env->pool;
+    if (pool)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->quit = true;
+        }
+        pool->wake.notify_all();
+        for (int i = 1; i < pool->num_threads; i++)
+            pool->threads[i].join();
+        delete pool;
+    }
+    free(env->sims);
+    free(env->episodes);
+    free(env->ticks);
+    free(env->obs);
+    free(env->reward);
+    free(env->done);
+}
+
+// Starts a new session in every environment, and fills in obs.
+void env_reset(VecEnv *env)
+{
+    for (int i = 0; i < env->count; i++)
+    {
+        env_reset_one(env, i);
+        env_observe(env, i);
+        env->reward[i] = 0.0f;
+        env->done[i] = false;
+    }
+}
+
+void env_run(VecEnv *env)
+{
+    EnvPool *pool = env->pool;
+    pool->next = 0;
+    if (pool->num_threads > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->busy = pool->num_threads-1;
+            pool->generation++;
+        }
+        pool->wake.notify_all();
+    }
+
+    // The calling thread is one of the workers
+    env_work(env);
+    if (pool->num_threads > 1)
+    {
+        std::unique_lock<std::mutex> lock(pool->mutex);
+        pool->finished.wait(lock, [&]{ return pool->busy == 0; });
+    }
+}
+
+// keys: SIM_KEY_* bits for each environment
+void env_step(VecEnv *env, const u32 *keys)
+{
+    env->keys = keys;
+    env->motors = 0;
+    env_run(env);
+}
+
+// Sets the motor voltages directly instead of through the keys.
+// motors: Left and right voltage for each environment, in [0, 1]
+void env_step_motors(VecEnv *env, const r32 *motors)
+{
+    env->keys = 0;
+    env->motors = motors;
+    env_run(env);
+}
@@ -0,0 +1,128 @@
+// env_bench: steps many environments with a random agent.
+//
+// Measures how many environment steps per second env.cpp manages on
+// this machine, and doubles as an example of driving a VecEnv. The
+// agent holds a random key combination for a random number of ticks,
+// like verify --generate. --motors sets random motor voltages around
+// hover instead. --wind turns on the wind, and the drag with it.
+//
+//    $ g++ -O2 ../env_bench.cpp -o env_bench -pthread
+//    $ ./env_bench --envs 4096 --steps 1000
+//    $ ./env_bench --envs 4096 --steps 1000 --threads 1 --motors
+//    $ ./env_bench --envs 4096 --steps 1000 --wind 1
+#define DETERMINISTIC_PHYSICS
+#define MAX_ROOMBAS 16
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#include "wind.cpp"
+#include "sim.cpp"
+#include "control.cpp"
+#include "env.cpp"
+
+#define BENCH_SEED 0x62656e6368
+
+int main(int argc, char **argv)
+{
+    int envs = 4096;
+    int steps = 1000;
+    int threads = 0;
+    int roombas = 1;
+    r32 wind = 0.0f;
+    bool motors = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--envs") == 0 && i+1 < argc)
+            envs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--steps") == 0 && i+1 < argc)
+            steps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roombas") == 0 && i+1 < argc)
+            roombas = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--wind") == 0 && i+1 < argc)
+            wind = (r32)atof(argv[++i]);
+        else if (strcmp(argv[i], "--motors") == 0)
+            motors = true;
+        else
+        {
+            printf("usage: env_bench [--envs n] [--steps n] [--threads n] [--roombas n] [--wind intensity] [--motors]\n");
+            return 1;
+        }
+    }
+    if (envs < 1)
+        envs = 1;
+
+    VecEnv env;
+    if (!env_create(&env, envs, threads, roombas))
+    {
+        printf("Out of memory for %d environments\n", envs);
+        return 1;
+    }
+    if (wind > 0.0f)
+    {
+        env.wind.intensity = m_min(wind, WIND_MAX_INTENSITY);
+        wind_air(&env.wind);
+    }
+    env_reset(&env);
+
+    u32 *keys = (u32*)calloc(envs, sizeof(u32));
+    int *hold = (int*)calloc(envs, sizeof(int));
+    r32 *voltages = (r32*)calloc(2*envs, sizeof(r32));
+    RngKey key = rng_key(BENCH_SEED);
+    r32 hover = compute_hover_voltage(&env.sims[0]);
+    double total_reward = 0.0;
+    u64 episodes = 0;
+    r32 seconds = 0.0f;
+    for (int step = 0; step < steps; step++)
+    {
+        // The agent is not timed, only env_step
+        for (int i = 0; i < envs; i++)
+        {
+            if (hold[i] == 0)
+            {
+                u32 r = rng_u32(key, (u64)i, (u64)step);
+                keys[i] = r & 15;
+                hold[i] = 1+((r >> 4) & 31);
+                voltages[2*i+0] = hover+0.1f*(((r >> 9) & 255)/255.0f-0.5f);
+                voltages[2*i+1] = hover+0.1f*(((r >> 17) & 255)/255.0f-0.5f);
+            }
+            hold[i]--;
+        }
+        u64 begin = perf_counter();
+        if (motors)
+            env_step_motors(&env, voltages);
+        else
+            env_step(&env, keys);
+        seconds += time_since(begin);
+        for (int i = 0; i < envs; i++)
+        {
+            total_reward += env.reward[i];
+            episodes += env.done[i] ? 1 : 0;
+        }
+    }
+    double env_steps = (double)envs*steps;
+    printf("%d environments, %d steps on %d threads: %.0f env-steps per second\n",
+           envs, steps, env.pool->num_threads, seconds > 0.0f ? env_steps/seconds : 0.0);
+    printf("%llu sessions finished, %.3f reward per 1000 env-steps\n",
+           (unsigned long long)episodes, 1000.0*total_reward/env_steps);
+    env_destroy(&env);
+    free(keys);
+    free(hold);
+    free(voltages);
+    return 0;
+}
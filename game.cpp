@@ -1,7 +1,9 @@
+#define GAME_MODULE
 #include "platform.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
 #include <cstdio>
 // #define DEBUG
-#define array_count(list) (sizeof((list))/sizeof((list)[0]))
 #define IFKEYDOWN(KEY) if (input.key.down[SDL_SCANCODE_##KEY])
 #define IFKEYUP(KEY) if (input.key.released[SDL_SCANCODE_##KEY])
 #ifndef TWO_PI
@@ -12,66 +14,14 @@
                   (r32)(((HEX) >>  8) & 0xff) / 255.0f, \
                   (r32)(((HEX) >>  0) & 0xff) / 255.0f
 
-struct Player
-{
-    vec2 position;
-    vec2 Dposition;
-    r32 theta;
-    r32 Dtheta;
-
-    r32 motor_constant;
-    r32 l_motor;
-    r32 r_motor;
-
-    r32 mass;
-    r32 arm;
-    r32 inertia;
-} player;
-
-struct PlayerPendulumLink
-{
-    r32 k;
-    r32 l0;
-    r32 d;
-} spring;
-
-struct Pendulum
-{
-    vec2 position;
-    vec2 Dposition;
-    r32 mass;
-    r32 radius;
-} pendulum;
-
-struct Roomba
-{
-    r32 x;
-    r32 y;
-    r32 dy0;
-    r32 dy1;
-    r32 dy2;
-    r32 radius;
-    r32 direction;
-    r32 Rdirection;
-    r32 turn_timer;
-    r32 turn_timer0;
-    r32 activate_timer;
-    r32 activate_timer0;
-    r32 speed;
-} roomba;
-
-struct Highscore
-{
-    int points;
-    char nickname[256];
-    char email[256];
-} highscore;
-
-struct HighscoreList
-{
-    int count;
-    Highscore highscores[4096];
-} highscore_list;
+#include "highscore.cpp"
+#include "leaderboard.cpp"
+#include "wind.cpp"
+#include "sim.cpp"
+#include "control.cpp"
+#include "replay.cpp"
+#include "sync.cpp"
+#include "tunables.cpp"
 
 enum GameState
 {
@@ -79,6 +29,11 @@ enum GameState
     GAME_HIGHSCORE
 };
 
+// Random numbers are read from counter-based streams (see so_noise),
+// one stream per purpose, so they do not depend on call order.
+#define RNG_SEED 0x4c616772616e6765
+#define RNG_STREAM_PARTICLES 1
+
 #define NUM_PARTICLES 512
 struct Particles
 {
@@ -88,74 +43,47 @@ struct Particles
     vec2 position[NUM_PARTICLES];
     vec2 velocity[NUM_PARTICLES];
     r32 alpha[NUM_PARTICLES];
+    u64 draws; // Values read from RNG_STREAM_PARTICLES so far
 } particles;
 
 struct Game
 {
     GameState state;
+    bool loaded; // Highscores, sync and tunables are set up
 } game;
 
-enum TimerState
-{
-    TIMER_INACTIVE = 0,
-    TIMER_BEGIN = 1,
-    TIMER_ACTIVE = 2,
-    TIMER_SUCCESS = 3,
-    TIMER_ABORTED = 4
-};
+// The game plays one simulation. These name its parts for the code
+// below, which draws it and reacts to it.
+Sim sim;
+Player &player = sim.player;
+Pendulum &pendulum = sim.pendulum;
+Roombas &roombas = sim.roombas;
+World &world = sim.world;
+Timer *timers = sim.timers;
 
-struct Timer
-{
-    TimerState state;
-    r32 t;
-    r32 duration;
-    bool repeat;
-};
+// Tunables, copied into the simulation every tick
+WindParams wind_params;
 
-#define TIMER_RED_LINE_CAPTURE timers[0]
-#define TIMER_GREEN_LINE_CAPTURE timers[1]
-#define TIMER_MAGNET timers[2]
-#define TIMER_MAGNET_CELEBRATION timers[3]
-#define TIMER_AUTOTURN timers[4]
-#define TIMER_ROOMBA_LOSE timers[5]
-#define TIMER_ROOMBA_WIN timers[6]
-#define TIMER_PLAYER_TIME timers[7]
-#define NUM_TIMERS 8
-Timer timers[NUM_TIMERS];
-
-#define ON_TIMER_SUCCESS(TIMER) if (TIMER.state == TIMER_SUCCESS)
-#define ON_TIMER_ABORTED(TIMER) if (TIMER.state == TIMER_ABORTED)
-#define ON_TIMER_BEGIN(TIMER) if (TIMER.state == TIMER_BEGIN)
-#define DURING_TIMER(TIMER) if (TIMER.state == TIMER_ACTIVE || TIMER.state == TIMER_BEGIN)
-#define TIMER_PROGRESS(TIMER) (1.0f-TIMER.t/TIMER.duration)
-#define START_TIMER(TIMER) if (TIMER.state == TIMER_INACTIVE) { TIMER.state = TIMER_BEGIN; TIMER.t = TIMER.duration; }
-#define ABORT_TIMER(TIMER) if (TIMER.state == TIMER_ACTIVE) TIMER.state = TIMER_ABORTED;
-
-void init_timer(Timer *timer, r32 duration, bool repeat = false)
-{
-    timer->state = TIMER_INACTIVE;
-    timer->t = 0.0f;
-    timer->duration = duration;
-    timer->repeat = repeat;
-}
+// Takes effect from the next session
+int roomba_count = 1;
 
-struct World
-{
-    r32 floor_level;
-    r32 green_line;
-    r32 red_line;
-    r32 g;
-
-    r32 right;
-    r32 left;
-    r32 top;
-    r32 bottom;
-} world;
-
-r32 compute_hover_voltage()
+// The keys of the session so far, uploaded with its score
+Replay replay;
+
+// Flies the player while engaged, and the arrow keys move its target
+Autopilot autopilot;
+bool autopilot_engaged = false;
+
+// Springs after the player, stopping short of the edges of the arena
+struct Camera
 {
-    return sqrt(0.5f*(player.mass+pendulum.mass)*world.g/player.motor_constant);
-}
+    vec2 position;
+    vec2 Dposition;
+} camera;
+
+// Given by the platform layer when the game is a module that can be
+// reloaded, see game_load
+GameMemory *game_memory;
 
 void spawn_particle(vec2 p0, vec2 v0)
 {
@@ -174,6 +102,7 @@ void game_init()
 {
     {
         particles.num_inactive = NUM_PARTICLES;
+        particles.draws = 0;
         for (int i = 0; i < NUM_PARTICLES; i++)
         {
             particles.inactive[i] = i;
@@ -181,92 +110,63 @@ void game_init()
         }
     }
     // load highscore list
+    // The in-memory list is authoritative once loaded, since every
+    // change to it goes through the journal.
     {
-        FILE *file = fopen("gamedata.dat", "rb+");
-        if (file)
+        if (!game.loaded)
         {
-            size_t read_bytes = fread(&highscore_list, 1, sizeof(highscore_list), file);
-            if (read_bytes != sizeof(highscore_list))
-            {
-                highscore_list.count = 0;
-            }
-            fclose(file);
+            highscore_load();
+            leaderboard_rebuild();
+            sync_init();
+            tunables_init();
+            wind_defaults(&wind_params);
+            autopilot_defaults(&autopilot);
+            game.loaded = true;
         }
     }
     {
         highscore.points = 0;
         game.state = GAME_PLAY;
     }
-    {
-        init_timer(&TIMER_GREEN_LINE_CAPTURE, 2.0f);
-        init_timer(&TIMER_RED_LINE_CAPTURE, 2.0f);
-        init_timer(&TIMER_MAGNET, 0.45f);
-        init_timer(&TIMER_MAGNET_CELEBRATION, 0.5f);
-        init_timer(&TIMER_AUTOTURN, 8.5f, true);
-        init_timer(&TIMER_ROOMBA_LOSE, 0.5f);
-        init_timer(&TIMER_ROOMBA_WIN, 0.5f);
-        init_timer(&TIMER_PLAYER_TIME, 60.0f);
-        START_TIMER(TIMER_AUTOTURN);
-        START_TIMER(TIMER_PLAYER_TIME);
-    }
-    {
-        world.floor_level = 0.0f;
-        world.green_line = 2.5f;
-        world.red_line = -1.5f;
-        world.g = 9.81f;
-        world.right = +2.0f;
-        world.left = -2.0f;
-        world.top = +3.0f;
-        world.bottom = -1.0f;
-    }
-    {
-        spring.l0 = 0.8f;
-        spring.k = 40.0f;
-        spring.d = 1.0f;
-
-        pendulum.mass = 0.05f;
-        pendulum.radius = 0.1f;
-
-        player.mass = 1.0f;
-        player.arm = 0.5f;
-        player.inertia = player.mass*player.arm*player.arm;
-
-        player.motor_constant = 0.8f*(player.mass+pendulum.mass)*world.g;
-        player.l_motor = compute_hover_voltage();
-        player.r_motor = player.l_motor;
-
-        roomba.radius = 0.5f;
-        roomba.speed = 0.33f;
-        roomba.Rdirection = -1.0f;
-        roomba.y = world.floor_level+0.2f;
-        roomba.dy0 = -0.1f;
-        roomba.dy1 = +0.1f;
-        roomba.dy2 = 0.4f;
-    }
-    {
-        player.theta = 0.0f;
-        player.Dtheta = 0.0f;
-        player.position = m_vec2(0.0f, 2.0f);
-        player.Dposition = m_vec2(0.0f, 0.0f);
+    const SimParams *params = tunables_update();
+    sim_init(&sim, &wind_params, roomba_count, params);
+    replay_begin(&replay, &wind_params, roomba_count);
 
-        pendulum.position = m_vec2(player.position.x, player.position.y-spring.l0);
-        pendulum.Dposition = m_vec2(0.0f, 0.0f);
-
-        roomba.x = 0.0f;
-        roomba.direction = -1.0f;
-    }
+    // Replays are always played with the default constants
+    if (memcmp(params, &tunables.defaults, sizeof(SimParams)) != 0)
+        replay.valid = false;
 }
 
-r32 voltage_to_force_magnitude(r32 voltage)
+// Unit circle points at CIRCLE_SEGMENTS even steps, point[i] being at
+// angle TWO_PI*i/CIRCLE_SEGMENTS. Computed at compile time.
+#define CIRCLE_SEGMENTS 64
+struct CircleTable
 {
-    return player.motor_constant*voltage*voltage;
+    vec2 point[CIRCLE_SEGMENTS+1];
+};
+
+SO_MATH_CONSTEXPR CircleTable make_circle_table()
+{
+    CircleTable result = {};
+    for (int i = 0; i <= CIRCLE_SEGMENTS; i++)
+    {
+        double t = 6.283185307179586 * i / CIRCLE_SEGMENTS;
+        result.point[i] = m_vec2((r32)m_ct_cos(t), (r32)m_ct_sin(t));
+    }
+    return result;
 }
 
+global SO_MATH_CONSTEXPR CircleTable circle_table = make_circle_table();
+
 void glCircle(vec2 center, r32 radius, r32 t_max = TWO_PI, int n = 64)
 {
+    // Each segment starts where the previous one ended, so only the
+    // end point is new. It comes from the table when n divides
+    // CIRCLE_SEGMENTS, except for a last segment cut short by t_max.
+    int stride = CIRCLE_SEGMENTS % n == 0 ? CIRCLE_SEGMENTS / n : 0;
+    vec2 p0 = m_vec2(radius, 0.0f);
     for (int i = 0; i < n; i++)
     {
-        r32 t0 = TWO_PI * i / (r32)n;
         r32 t1 = TWO_PI * (i + 1) / (r32)n;
         bool should_break = false;
         if (t1 > t_max)
@@ -274,13 +174,20 @@ void glCircle(vec2 center, r32 radius, r32 t_max = TWO_PI, int n = 64)
             t1 = t_max;
             should_break = true;
         }
-        r32 c0 = radius*cos(t0);
-        r32 s0 = radius*sin(t0);
-        r32 c1 = radius*cos(t1);
-        r32 s1 = radius*sin(t1);
+        vec2 p1;
+        if (stride > 0 && !should_break)
+        {
+            p1 = radius*circle_table.point[(i + 1)*stride];
+        }
+        else
+        {
+            m_sincos(t1, &p1.y, &p1.x);
+            p1 = radius*p1;
+        }
         glVertex2f(center.x, center.y);
-        glVertex2f(center.x+c0, center.y+s0);
-        glVertex2f(center.x+c1, center.y+s1);
+        glVertex2f(center.x+p0.x, center.y+p0.y);
+        glVertex2f(center.x+p1.x, center.y+p1.y);
+        p0 = p1;
         if (should_break)
             break;
     }
@@ -301,325 +208,114 @@ void glQuad(r32 x0, r32 y0, r32 x1, r32 y1)
     glVertex2f(x0, y0);
 }
 
-void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
+GAME_EXPORT void game_shutdown()
 {
-    // update timers
-    {
-        for (int i = 0; i < NUM_TIMERS; i++)
-        {
-            if (timers[i].state == TIMER_SUCCESS)
-            {
-                if (timers[i].repeat)
-                {
-                    timers[i].state = TIMER_BEGIN;
-                }
-                else
-                {
-                    timers[i].state = TIMER_INACTIVE;
-                }
-            }
-            if (timers[i].state == TIMER_ABORTED)
-            {
-                timers[i].state = TIMER_INACTIVE;
-            }
-            if (timers[i].state == TIMER_BEGIN)
-            {
-                timers[i].t = timers[i].duration;
-                timers[i].state = TIMER_ACTIVE;
-            }
-            if (timers[i].state == TIMER_ACTIVE)
-            {
-                timers[i].t -= delta_time;
-                if (timers[i].t < 0.0f)
-                {
-                    timers[i].state = TIMER_SUCCESS;
-                }
-            }
-        }
-    }
+    sync_shutdown();
+    tunables_shutdown();
+}
 
-    ON_TIMER_SUCCESS(TIMER_PLAYER_TIME)
-    {
-        game.state = GAME_HIGHSCORE;
-        strcpy(highscore.nickname, "Nickname");
-        strcpy(highscore.email, "YourEmail@ProbablyGmail.com");
-    }
+GAME_EXPORT void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
+{
+    sync_update();
 
     // update game
     {
-        // key input
-        if (game.state == GAME_PLAY)
+        u32 keys = 0;
+        IFKEYDOWN(LEFT) keys |= SIM_KEY_LEFT;
+        IFKEYDOWN(RIGHT) keys |= SIM_KEY_RIGHT;
+        IFKEYDOWN(UP) keys |= SIM_KEY_UP;
+        IFKEYDOWN(DOWN) keys |= SIM_KEY_DOWN;
+
+        // A replay starts from the tunables at sim_init, so changing
+        // them halfway makes the session impossible to play again.
+        if (memcmp(&sim.wind.params, &wind_params, sizeof(WindParams)) != 0)
         {
-            r32 hover_voltage = compute_hover_voltage();
-            r32 dl = 0.0f;
-            r32 dr = 0.0f;
-            IFKEYDOWN(LEFT)
-            {
-                dl -= 0.05f;
-                dr += 0.05f;
-            }
-            IFKEYDOWN(RIGHT)
-            {
-                dl += 0.05f;
-                dr -= 0.05f;
-            }
-            IFKEYDOWN(UP)
-            {
-                dl += 0.05f;
-                dr += 0.05f;
-            }
-            IFKEYDOWN(DOWN)
-            {
-                dl -= 0.05f;
-                dr -= 0.05f;
-            }
-            player.l_motor = hover_voltage+dl;
-            player.r_motor = hover_voltage+dr;
-            if (player.l_motor > 1.0f) player.l_motor = 1.0f;
-            if (player.l_motor < 0.0f) player.l_motor = 0.0f;
-            if (player.r_motor > 1.0f) player.r_motor = 1.0f;
-            if (player.r_motor < 0.0f) player.r_motor = 0.0f;
+            sim.wind.params = wind_params;
+            replay.valid = false;
         }
-
-        // spring force
-        r32 spring_f = 0.0f;
+        const SimParams *params = tunables_update();
+        if (memcmp(&sim.params, params, sizeof(SimParams)) != 0)
         {
-            r32 xa = player.position.x;
-            r32 xb = pendulum.position.x;
-            r32 Dxa = player.Dposition.x;
-            r32 Dxb = pendulum.Dposition.x;
-            r32 ya = player.position.y;
-            r32 yb = pendulum.position.y;
-            r32 Dya = player.Dposition.y;
-            r32 Dyb = pendulum.Dposition.y;
-            r32 l = sqrt((xa-xb)*(xa-xb) + (ya-yb)*(ya-yb));
-            r32 Dl = ((xa-xb)*(Dxa-Dxb) + (ya-yb)*(Dya-Dyb)) / l;
-            spring_f = spring.k*(l-spring.l0) + spring.d*Dl;
+            sim_set_params(&sim, params);
+            replay.valid = false;
         }
-
-        vec2 v_player_to_pendulum = pendulum.position-player.position;
-        r32 distance = m_length(v_player_to_pendulum);
-        if (distance > 0.01f)
-            v_player_to_pendulum /= distance;
-        vec2 v_pendulum_to_player = -v_player_to_pendulum;
-
-        // update player
+        if (game.state == GAME_PLAY)
+            replay_record(&replay, keys);
+        if (autopilot_engaged)
         {
-            r32 dt = delta_time;
-            vec2 tangent = m_vec2(cos(player.theta), sin(player.theta));
-            vec2 normal = m_vec2(-tangent.y, tangent.x);
-            r32 l_magnitude = voltage_to_force_magnitude(player.l_motor);
-            r32 r_magnitude = voltage_to_force_magnitude(player.r_motor);
-            vec2 l_force = l_magnitude*normal;
-            vec2 r_force = r_magnitude*normal;
-
-            if (player.position.y+player.arm*tangent.y < world.floor_level)
-            {
-                r_force.y += 1000.0f*(world.floor_level-player.position.y-player.arm*tangent.y);
-            }
-            if (player.position.y-player.arm*tangent.y < world.floor_level)
-            {
-                l_force.y += 1000.0f*(world.floor_level-player.position.y+player.arm*tangent.y);
-            }
-
-            vec2 s_force = spring_f*v_player_to_pendulum;
-            vec2 g_force = m_vec2(0.0f, -player.mass*world.g);
-            vec2 sum_forces = l_force+r_force+g_force+s_force;
-
-            vec2 DDposition = sum_forces / player.mass;
-            player.Dposition += DDposition * dt;
-            player.position += player.Dposition * dt;
-
-            r32 DDtheta = player.arm * (r_magnitude-l_magnitude) / player.inertia;
-            player.Dtheta += DDtheta * dt;
-            player.theta += player.Dtheta * dt;
-
-            if (player.position.x > world.green_line+3.0f ||
-                player.position.x < world.red_line-3.0f ||
-                player.position.y < world.floor_level-2.0f ||
-                player.position.y > 3.0f)
-            {
-                player.theta = 0.0f;
-                player.Dtheta = 0.0f;
-                player.position = m_vec2(0.0f, 2.0f);
-                player.Dposition = m_vec2(0.0f, 0.0f);
-
-                pendulum.position = m_vec2(player.position.x, player.position.y-spring.l0);
-                pendulum.Dposition = m_vec2(0.0f, 0.0f);
-            }
+            // Replays only hold keys, so they can not play this back
+            Controller controller = autopilot_controller(&autopilot);
+            if (keys & SIM_KEY_LEFT) autopilot.target.x -= delta_time;
+            if (keys & SIM_KEY_RIGHT) autopilot.target.x += delta_time;
+            if (keys & SIM_KEY_UP) autopilot.target.y += delta_time;
+            if (keys & SIM_KEY_DOWN) autopilot.target.y -= delta_time;
+            replay.valid = false;
+            sim_step(&sim, keys, delta_time, &controller);
         }
-
-        // update pendulum
+        else
         {
-            r32 dt = delta_time;
-            vec2 s_force = spring_f*v_pendulum_to_player;
-            vec2 g_force = m_vec2(0.0f, -pendulum.mass*world.g);
-            vec2 n_force = m_vec2(0.0f, 0.0f);
+            sim_step(&sim, keys, delta_time);
+        }
+        highscore.points = sim.points;
+    }
 
-            // contact forces
+    // react to what happened in the step
+    for (int i = 0; i < sim.num_events; i++)
+    {
+        switch (sim.events[i].type)
+        {
+            case SIM_EVENT_TIME_UP:
             {
-                r32 ay = pendulum.position.y-pendulum.radius;
-                r32 by = world.floor_level;
-                r32 cy = roomba.y+roomba.dy1;
-                if (ay < by)
-                {
-                    n_force.y = 50.0f*(by-ay);
-                }
-                if (ay < cy && m_abs(pendulum.position.x-roomba.x) < roomba.radius)
+                if (game.state == GAME_PLAY)
                 {
-                    n_force.y = 50.0f*(cy-ay);
+                    game.state = GAME_HIGHSCORE;
+                    strcpy(highscore.nickname, "Nickname");
+                    strcpy(highscore.email, "YourEmail@ProbablyGmail.com");
                 }
+                break;
             }
-            vec2 delta_v = pendulum.Dposition - player.Dposition;
-            vec2 f_force = -0.1f*delta_v*m_length(delta_v);
-            vec2 sum_forces = g_force+s_force+f_force+n_force;
 
-            vec2 DDposition = sum_forces / pendulum.mass;
-            pendulum.Dposition += DDposition * dt;
-            pendulum.position += pendulum.Dposition * dt;
+            default:
+                break;
         }
+    }
 
-        // update camera
+    // update camera
+    {
+        r32 k = 1.0f;
+        r32 d = 1.0f;
+        vec2 reference = player.position;
+        vec2 Dreference = player.Dposition;
+        if (player.position.x > 0.3f*world.green_line)
         {
-            static vec2 position = m_vec2(0.0f, 0.0f);
-            static vec2 Dposition = m_vec2(0.0f, 0.0f);
-            r32 k = 1.0f;
-            r32 d = 1.0f;
-            vec2 reference = player.position;
-            vec2 Dreference = player.Dposition;
-            if (player.position.x > 0.3f*world.green_line)
-            {
-                reference.x = 0.3f*world.green_line;
-                Dreference.x = 0.0f;
-            }
-            if (player.position.x < 0.3f*world.red_line)
-            {
-                reference.x = 0.3f*world.red_line;
-                Dreference.x = 0.0f;
-            }
-            vec2 e = reference-position;
-            vec2 De = Dreference-Dposition;
-            vec2 DDposition = k*e + d*De;
-
-            Dposition += DDposition*delta_time;
-            position += Dposition*delta_time;
-            r32 radius = 3.0f;
-
-            world.right = (mode.width / (r32)mode.height)*(position.x+radius);
-            world.left = (mode.width / (r32)mode.height)*(position.x-radius);
-            world.top = position.y+radius;
-            world.bottom = position.y-radius;
+            reference.x = 0.3f*world.green_line;
+            Dreference.x = 0.0f;
         }
-
-        // update roomba
+        if (player.position.x < 0.3f*world.red_line)
         {
-            roomba.x += roomba.direction*roomba.speed*delta_time;
-            ON_TIMER_SUCCESS(TIMER_AUTOTURN)
-            {
-                roomba.Rdirection *= -1.0f;
-            }
-            roomba.direction += 5.0f*(roomba.Rdirection-roomba.direction)*delta_time;
-
-            if (m_abs(pendulum.position.x-roomba.x) < roomba.radius &&
-                pendulum.position.y > roomba.y+roomba.dy1 &&
-                pendulum.position.y-pendulum.radius < roomba.y+roomba.dy2)
-            {
-                if (TIMER_MAGNET_CELEBRATION.state != TIMER_ACTIVE)
-                {
-                    START_TIMER(TIMER_MAGNET);
-                }
-            }
-            else
-            {
-                ABORT_TIMER(TIMER_MAGNET);
-            }
-
-            ON_TIMER_SUCCESS(TIMER_MAGNET)
-            {
-                START_TIMER(TIMER_MAGNET_CELEBRATION);
-                roomba.Rdirection *= -1.0f;
-            }
-
-            // Red field
-            {
-                if (roomba.x - roomba.radius < world.red_line &&
-                    TIMER_ROOMBA_LOSE.state != TIMER_ACTIVE)
-                {
-                    START_TIMER(TIMER_RED_LINE_CAPTURE);
-                }
-                else
-                {
-                    ABORT_TIMER(TIMER_RED_LINE_CAPTURE);
-                }
-
-                ON_TIMER_SUCCESS(TIMER_RED_LINE_CAPTURE)
-                {
-                    START_TIMER(TIMER_ROOMBA_LOSE);
-                    if (game.state == GAME_PLAY)
-                        highscore.points--;
-                }
-
-                DURING_TIMER(TIMER_ROOMBA_LOSE)
-                {
-                    static r32 x0 = 0.0f;
-                    ON_TIMER_BEGIN(TIMER_ROOMBA_LOSE)
-                    {
-                        x0 = roomba.x;
-                    }
-                    r32 t = TIMER_PROGRESS(TIMER_ROOMBA_LOSE);
-                    roomba.x = x0 - 32.0f*m_smoothstep(0.0f, 1.0f, t);
-                }
-
-                ON_TIMER_SUCCESS(TIMER_ROOMBA_LOSE)
-                {
-                    roomba.x = 0.0f;
-                }
-            }
-
-            // Green field
-            {
-                // IFKEYDOWN(Y)
-                if (roomba.x + roomba.radius > world.green_line &&
-                    TIMER_ROOMBA_WIN.state != TIMER_ACTIVE)
-                {
-                    START_TIMER(TIMER_GREEN_LINE_CAPTURE);
-                }
-                else
-                {
-                    ABORT_TIMER(TIMER_GREEN_LINE_CAPTURE);
-                }
-
-                ON_TIMER_SUCCESS(TIMER_GREEN_LINE_CAPTURE)
-                {
-                    START_TIMER(TIMER_ROOMBA_WIN);
-                    if (game.state == GAME_PLAY)
-                        highscore.points++;
-                }
-
-                DURING_TIMER(TIMER_ROOMBA_WIN)
-                {
-                    static r32 x0 = 0.0f;
-                    ON_TIMER_BEGIN(TIMER_ROOMBA_WIN)
-                    {
-                        x0 = roomba.x;
-                    }
-                    r32 t = TIMER_PROGRESS(TIMER_ROOMBA_WIN);
-                    roomba.x = x0 + 32.0f*m_smoothstep(0.0f, 1.0f, t);
-                }
-
-                ON_TIMER_SUCCESS(TIMER_ROOMBA_WIN)
-                {
-                    roomba.x = 0.0f;
-                }
-            }
+            reference.x = 0.3f*world.red_line;
+            Dreference.x = 0.0f;
         }
+        vec2 e = reference-camera.position;
+        vec2 De = Dreference-camera.Dposition;
+        vec2 DDposition = k*e + d*De;
+
+        camera.Dposition += DDposition*delta_time;
+        camera.position += camera.Dposition*delta_time;
+        r32 radius = 3.0f;
+
+        world.right = (mode.width / (r32)mode.height)*(camera.position.x+radius);
+        world.left = (mode.width / (r32)mode.height)*(camera.position.x-radius);
+        world.top = camera.position.y+radius;
+        world.bottom = camera.position.y-radius;
     }
     // end update
 
     // spawn particles
     #ifdef PARTICLES
     {
-        vec2 tangent = m_vec2(cos(player.theta), sin(player.theta));
+        vec2 tangent;
+        m_sincos(player.theta, &tangent.y, &tangent.x);
         vec2 normal = m_vec2(-tangent.y, tangent.x);
         vec2 right_wing = player.position + 0.8f*player.arm*tangent;
         vec2 left_wing = player.position - 0.8f*player.arm*tangent;
@@ -629,16 +325,19 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
         IFKEYDOWN(RIGHT) right = true;
         IFKEYDOWN(LEFT) left = true;
         IFKEYDOWN(UP) { right = true; left = true; }
+        r32 u[4];
+        rng_fill_uniform(rng_key(RNG_SEED), RNG_STREAM_PARTICLES, particles.draws, u, 4);
+        particles.draws += 4;
         if (left)
         {
-            r32 v1 = 0.3f+0.3f*frand();
-            r32 v2 = -0.3f+0.6f*frand();
+            r32 v1 = 0.3f+0.3f*u[0];
+            r32 v2 = -0.3f+0.6f*u[1];
             spawn_particle(left_wing, -v1*normal+v2*tangent);
         }
         if (right)
         {
-            r32 v1 = 0.3f+0.3f*frand();
-            r32 v2 = -0.3f+0.6f*frand();
+            r32 v1 = 0.3f+0.3f*u[2];
+            r32 v2 = -0.3f+0.6f*u[3];
             spawn_particle(right_wing, -v1*normal+v2*tangent);
         }
     }
@@ -737,7 +436,8 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
 
         // draw player
         {
-            vec2 tangent = m_vec2(cos(player.theta), sin(player.theta));
+            vec2 tangent;
+            m_sincos(player.theta, &tangent.y, &tangent.x);
             vec2 center = player.position;
             vec2 right_wing = center + tangent*player.arm;
             vec2 left_wing = center - tangent*player.arm;
@@ -768,33 +468,36 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             glEnd();
         }
 
-        // draw roomba
+        // draw roombas
         {
             glBegin(GL_TRIANGLES);
+            for (int i = 0; i < roombas.count; i++)
             {
-                r32 x0 = roomba.x-roomba.radius;
-                r32 x1 = roomba.x+roomba.radius;
-                r32 y0 = roomba.y+roomba.dy0;
-                r32 y1 = roomba.y+roomba.dy1;
-                glColor4f(XRGB(0x1A1A1AFF));
-                glVertex2f(x0, y0);
-                glVertex2f(x1, y0);
-                glVertex2f(x1, y1);
-                glVertex2f(x1, y1);
-                glVertex2f(x0, y1);
-                glVertex2f(x0, y0);
-            }
-            {
-                r32 x0 = roomba.x-0.8f*roomba.radius;
-                r32 x1 = roomba.x+0.8f*roomba.radius;
-                r32 y0 = roomba.y+roomba.dy1;
-                r32 y1 = roomba.y+roomba.dy2;
-                glColor4f(XRGB(0xE03C2877)); glVertex2f(x0, y0);
-                glColor4f(XRGB(0xE03C2877)); glVertex2f(x1, y0);
-                glColor4f(XRGB(0xE03C2822)); glVertex2f(x1, y1);
-                glColor4f(XRGB(0xE03C2822)); glVertex2f(x1, y1);
-                glColor4f(XRGB(0xE03C2822)); glVertex2f(x0, y1);
-                glColor4f(XRGB(0xE03C2877)); glVertex2f(x0, y0);
+                {
+                    r32 x0 = roombas.x[i]-roombas.radius;
+                    r32 x1 = roombas.x[i]+roombas.radius;
+                    r32 y0 = roombas.y+roombas.dy0;
+                    r32 y1 = roombas.y+roombas.dy1;
+                    glColor4f(XRGB(0x1A1A1AFF));
+                    glVertex2f(x0, y0);
+                    glVertex2f(x1, y0);
+                    glVertex2f(x1, y1);
+                    glVertex2f(x1, y1);
+                    glVertex2f(x0, y1);
+                    glVertex2f(x0, y0);
+                }
+                {
+                    r32 x0 = roombas.x[i]-0.8f*roombas.radius;
+                    r32 x1 = roombas.x[i]+0.8f*roombas.radius;
+                    r32 y0 = roombas.y+roombas.dy1;
+                    r32 y1 = roombas.y+roombas.dy2;
+                    glColor4f(XRGB(0xE03C2877)); glVertex2f(x0, y0);
+                    glColor4f(XRGB(0xE03C2877)); glVertex2f(x1, y0);
+                    glColor4f(XRGB(0xE03C2822)); glVertex2f(x1, y1);
+                    glColor4f(XRGB(0xE03C2822)); glVertex2f(x1, y1);
+                    glColor4f(XRGB(0xE03C2822)); glVertex2f(x0, y1);
+                    glColor4f(XRGB(0xE03C2877)); glVertex2f(x0, y0);
+                }
             }
             glEnd();
 
@@ -803,30 +506,32 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             r32 eye_radius = 0.2f;
 
             glBegin(GL_LINES);
-            glColor4f(XRGB(0xE2D7B5FF));
-            {
-                // left eye
-                r32 dx = -outer_eye+(-inner_eye+outer_eye)*(0.5f+0.5f*roomba.direction);
-                r32 cx = roomba.x+roomba.radius*dx;
-                r32 x0 = cx-eye_radius*roomba.radius;
-                r32 x1 = cx+eye_radius*roomba.radius;
-                r32 y = roomba.y;
-                glVertex2f(x0, y);
-                glVertex2f(x1, y);
-            }
+            for (int i = 0; i < roombas.count; i++)
             {
-                // right eye
-                r32 dx = inner_eye+(outer_eye-inner_eye)*(0.5f+0.5f*roomba.direction);
-                r32 cx = roomba.x+roomba.radius*dx;
-                r32 x0 = cx-eye_radius*roomba.radius;
-                r32 x1 = cx+eye_radius*roomba.radius;
-                glVertex2f(x0, roomba.y);
-                glVertex2f(x1, roomba.y);
-            }
-            glColor4f(XRGB(0x00000055));
-            {
-                glVertex2f(roomba.x-roomba.radius, world.floor_level);
-                glVertex2f(roomba.x+roomba.radius, world.floor_level);
+                r32 x = roombas.x[i];
+                r32 y = roombas.y;
+                r32 radius = roombas.radius;
+                r32 direction = roombas.direction[i];
+                glColor4f(XRGB(0xE2D7B5FF));
+                {
+                    // left eye
+                    r32 dx = -outer_eye+(-inner_eye+outer_eye)*(0.5f+0.5f*direction);
+                    r32 cx = x+radius*dx;
+                    glVertex2f(cx-eye_radius*radius, y);
+                    glVertex2f(cx+eye_radius*radius, y);
+                }
+                {
+                    // right eye
+                    r32 dx = inner_eye+(outer_eye-inner_eye)*(0.5f+0.5f*direction);
+                    r32 cx = x+radius*dx;
+                    glVertex2f(cx-eye_radius*radius, y);
+                    glVertex2f(cx+eye_radius*radius, y);
+                }
+                glColor4f(XRGB(0x00000055));
+                {
+                    glVertex2f(x-radius, world.floor_level);
+                    glVertex2f(x+radius, world.floor_level);
+                }
             }
             glEnd();
         }
@@ -849,118 +554,101 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
         }
         #endif
 
-        // draw magnet timer
-        DURING_TIMER(TIMER_MAGNET)
+        // draw magnet timers
+        glBegin(GL_TRIANGLES);
+        glColor4f(XRGB(0xE03C28FF));
+        for (int i = 0; i < roombas.count; i++)
         {
-            glBegin(GL_TRIANGLES);
-            glColor4f(XRGB(0xE03C28FF));
-            glCircle(m_vec2(roomba.x, roomba.y+roomba.dy1+0.5f),
-                        0.3f,
-                        TWO_PI*TIMER_PROGRESS(TIMER_MAGNET));
-            glEnd();
-        }
-
-        DURING_TIMER(TIMER_RED_LINE_CAPTURE)
-        {
-            glBegin(GL_TRIANGLES);
-            glColor4f(XRGB(0xE03C28FF));
-            r32 arc = TWO_PI*TIMER_PROGRESS(TIMER_RED_LINE_CAPTURE);
-            vec2 center = m_vec2(world.red_line-1.0f, world.floor_level-0.5f);
-            glCircle(center, 0.3f, arc);
-            glEnd();
-        }
-
-        DURING_TIMER(TIMER_GREEN_LINE_CAPTURE)
-        {
-            glBegin(GL_TRIANGLES);
-            glColor4f(XRGB(0x6AB417FF));
-            r32 arc = TWO_PI*TIMER_PROGRESS(TIMER_GREEN_LINE_CAPTURE);
-            vec2 center = m_vec2(world.green_line+1.0f, world.floor_level-0.5f);
-            glCircle(center, 0.3f, arc);
-            glEnd();
-        }
-
-        DURING_TIMER(TIMER_MAGNET_CELEBRATION)
-        {
-            r32 t = TIMER_PROGRESS(TIMER_MAGNET_CELEBRATION);
-            r32 t0 = 2.0f*(t+0.1f)*(t+0.1f)*(t+0.1f);
-            r32 t1 = 0.2f+1.9f*t*t;
-            if (t0 > t1)
-                t0 = t1;
-            vec2 c = m_vec2(roomba.x, roomba.y+roomba.dy1+0.5f);
-            // TODO: Random thetas
-            static r32 thetas[] = {
-                0.1f, 0.7f, 1.4f, 1.6f,
-                2.6f, 3.5f, 4.5f, 5.5f
-            };
-            glBegin(GL_LINES);
-            for (int i = 0; i < 8; i++)
+            Timer *magnet = roomba_timer(&sim, ROOMBA_MAGNET, i);
+            DURING_TIMER((*magnet))
             {
-                r32 theta = thetas[i];
-                r32 cost = cos(theta);
-                r32 sint = sin(theta);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(c.x+t0*cost, c.y+t0*sint);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(c.x+t1*cost, c.y+t1*sint);
+                glCircle(m_vec2(roombas.x[i], roombas.y+roombas.dy1+0.5f),
+                            0.3f,
+                            TWO_PI*timer_progress(&sim.wheel, magnet));
             }
-            glEnd();
         }
+        glEnd();
 
-        // TODO: better win anim
-        DURING_TIMER(TIMER_ROOMBA_WIN)
+        // The lines can only show one capture each, so they show the
+        // one that is furthest along.
         {
-            TIMER_PLAYER_TIME.t += 16.0f*delta_time;
-
-            static vec2 center = m_vec2(0.0f, 0.0f);
-            ON_TIMER_BEGIN(TIMER_ROOMBA_WIN)
+            r32 red_arc = 0.0f;
+            r32 green_arc = 0.0f;
+            for (int i = 0; i < roombas.count; i++)
             {
-                center = m_vec2(roomba.x, (roomba.y+roomba.dy0+roomba.y+roomba.dy1)/2.0f);
+                Timer *red_capture = roomba_timer(&sim, ROOMBA_RED_CAPTURE, i);
+                Timer *green_capture = roomba_timer(&sim, ROOMBA_GREEN_CAPTURE, i);
+                DURING_TIMER((*red_capture))
+                {
+                    red_arc = m_max(red_arc, TWO_PI*timer_progress(&sim.wheel, red_capture));
+                }
+                DURING_TIMER((*green_capture))
+                {
+                    green_arc = m_max(green_arc, TWO_PI*timer_progress(&sim.wheel, green_capture));
+                }
             }
-            r32 t = TIMER_PROGRESS(TIMER_ROOMBA_WIN);
-            r32 t0 = 2.0f*(t+0.1f)*(t+0.1f)*(t+0.1f);
-            r32 t1 = 0.2f+1.9f*t*t;
-            if (t0 > t1)
-                t0 = t1;
-            static r32 thetas[] = {
-                0.1f, 0.7f, 1.4f, 1.6f,
-                2.6f, 3.5f, 4.5f, 5.5f
-            };
-            glBegin(GL_LINES);
-            for (int i = 0; i < 8; i++)
+            glBegin(GL_TRIANGLES);
+            if (red_arc > 0.0f)
+            {
+                glColor4f(XRGB(0xE03C28FF));
+                vec2 center = m_vec2(world.red_line-1.0f, world.floor_level-0.5f);
+                glCircle(center, 0.3f, red_arc);
+            }
+            if (green_arc > 0.0f)
             {
-                r32 theta = thetas[i];
-                r32 cost = cos(theta);
-                r32 sint = sin(theta);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(center.x+t0*cost, center.y+t0*sint);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(center.x+t1*cost, center.y+t1*sint);
+                glColor4f(XRGB(0x6AB417FF));
+                vec2 center = m_vec2(world.green_line+1.0f, world.floor_level-0.5f);
+                glCircle(center, 0.3f, green_arc);
             }
             glEnd();
         }
 
-        // TODO: better lose anim
-        DURING_TIMER(TIMER_ROOMBA_LOSE)
+        // Celebration, win and lose all burst lines out from the roomba.
+        // TODO: Random thetas
+        // TODO: better win and lose anims
         {
-            static vec2 center = m_vec2(0.0f, 0.0f);
-            ON_TIMER_BEGIN(TIMER_ROOMBA_LOSE)
-            {
-                center = m_vec2(roomba.x, (roomba.y+roomba.dy0+roomba.y+roomba.dy1)/2.0f);
-            }
-            r32 t = TIMER_PROGRESS(TIMER_ROOMBA_LOSE);
-            r32 t0 = 2.0f*(t+0.1f)*(t+0.1f)*(t+0.1f);
-            r32 t1 = 0.2f+1.9f*t*t;
-            if (t0 > t1)
-                t0 = t1;
             static r32 thetas[] = {
                 0.1f, 0.7f, 1.4f, 1.6f,
                 2.6f, 3.5f, 4.5f, 5.5f
             };
             glBegin(GL_LINES);
-            for (int i = 0; i < 8; i++)
-            {
-                r32 theta = thetas[i];
-                r32 cost = cos(theta);
-                r32 sint = sin(theta);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(center.x+t0*cost, center.y+t0*sint);
-                glColor4f(XRGB(0x000000FF)); glVertex2f(center.x+t1*cost, center.y+t1*sint);
+            glColor4f(XRGB(0x000000FF));
+            for (int i = 0; i < roombas.count; i++)
+            {
+                Timer *celebration = roomba_timer(&sim, ROOMBA_CELEBRATION, i);
+                Timer *win = roomba_timer(&sim, ROOMBA_WIN, i);
+                Timer *lose = roomba_timer(&sim, ROOMBA_LOSE, i);
+                Timer *burst = 0;
+                vec2 center = m_vec2(0.0f, 0.0f);
+                DURING_TIMER((*celebration))
+                {
+                    burst = celebration;
+                    center = m_vec2(roombas.x[i], roombas.y+roombas.dy1+0.5f);
+                }
+                DURING_TIMER((*win))
+                {
+                    burst = win;
+                    center = m_vec2(roombas.x0[i], roombas.y+(roombas.dy0+roombas.dy1)/2.0f);
+                }
+                DURING_TIMER((*lose))
+                {
+                    burst = lose;
+                    center = m_vec2(roombas.x0[i], roombas.y+(roombas.dy0+roombas.dy1)/2.0f);
+                }
+                if (!burst)
+                    continue;
+                r32 t = timer_progress(&sim.wheel, burst);
+                r32 t0 = 2.0f*(t+0.1f)*(t+0.1f)*(t+0.1f);
+                r32 t1 = 0.2f+1.9f*t*t;
+                if (t0 > t1)
+                    t0 = t1;
+                for (int j = 0; j < 8; j++)
+                {
+                    r32 cost = cos(thetas[j]);
+                    r32 sint = sin(thetas[j]);
+                    glVertex2f(center.x+t0*cost, center.y+t0*sint);
+                    glVertex2f(center.x+t1*cost, center.y+t1*sint);
+                }
             }
             glEnd();
         }
@@ -991,11 +679,11 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             using namespace ImGui;
             if (Button("Increase"))
             {
-                highscore.points++;
+                sim.points++;
             }
             if (Button("Decrease"))
             {
-                highscore.points--;
+                sim.points--;
             }
             if (Button("Reset"))
             {
@@ -1003,6 +691,61 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             }
             Text("Highscore: %d", highscore.points);
             Text("Particles: %d\n", particles.num_inactive);
+            // The wind needs air to push on, so turning it up turns on the drag
+            if (SliderFloat("Wind", &wind_params.intensity, 0.0f, WIND_MAX_INTENSITY) &&
+                wind_params.intensity > 0.0f)
+            {
+                wind_air(&wind_params);
+            }
+            bool air = wind_params.player_drag > 0.0f;
+            if (Checkbox("Air drag", &air))
+            {
+                wind_params.player_drag = air ? WIND_PLAYER_DRAG : 0.0f;
+                wind_params.pendulum_drag = air ? WIND_PENDULUM_DRAG : 0.0f;
+            }
+            SliderInt("Roombas (on reset)", &roomba_count, 1, MAX_ROOMBAS);
+            if (Checkbox("Autopilot", &autopilot_engaged) && autopilot_engaged)
+            {
+                autopilot.target = player.position;
+            }
+            if (TreeNode("Events"))
+            {
+                r32 minutes = sim.wheel.tick*delta_time/60.0f;
+                for (int i = 0; i < NUM_SIM_EVENTS; i++)
+                {
+                    u32 count = sim.event_counts[i];
+                    Text("%s: %u (%.1f per minute)", sim_event_name((SimEventType)i),
+                         count, minutes > 0.0f ? count/minutes : 0.0f);
+                }
+                if (sim.events_dropped > 0)
+                    Text("Dropped: %u", sim.events_dropped);
+                TreePop();
+            }
+            Text("Highscores: %d (%d journaled, %d replayed in %.2f ms)",
+                 highscore_list.count, highscore_journal.records,
+                 highscore_journal.replayed, highscore_journal.load_ms);
+            ImGuiMemoryStats imgui_stats = imgui_memory_stats();
+            Text("ImGui: %d allocations last frame (%d from the system), %d blocks in use, %d KB pooled",
+                 imgui_stats.allocs, imgui_stats.system_allocs, imgui_stats.live, (int)(imgui_stats.pooled/1024));
+            #ifdef GAME_HOT_RELOAD
+            Text("Module: reloaded %d times, last in %.2f ms", game_memory->reloads, game_memory->reload_ms);
+            #endif
+            if (tunables.enabled)
+            {
+                Text("Tunables: %s loaded %d times, %.2f ms to parse, %.2f ms from change to use",
+                     tunables.path, tunables.reloads, tunables.parse_ms, tunables.reload_ms);
+                if (tunables.error[0])
+                    TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", tunables.error);
+            }
+            if (sync_state.enabled)
+            {
+                Text("Sync: %s, %d uploaded, %d queued, %d merged, %d failures",
+                     sync_state.status.online ? "online" : "offline",
+                     sync_state.status.uploaded, sync_state.status.queued,
+                     sync_state.merged, sync_state.status.failures);
+                if (sync_state.status.backoff > 0)
+                    Text("Sync: retrying in %d ms", sync_state.status.backoff);
+            }
         }
         #endif
 
@@ -1019,7 +762,7 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(16.0f, 16.0f));
             PushStyleVar(ImGuiStyleVar_FrameRounding, 8.0f);
             SetNextWindowPosCenter();
-            SetNextWindowSize(ImVec2(500.0f, 265.0f));
+            SetNextWindowSize(ImVec2(500.0f, 500.0f));
             Begin("Enter your details!", NULL,
                   ImGuiWindowFlags_NoTitleBar|
                   ImGuiWindowFlags_NoResize);
@@ -1029,31 +772,10 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             PopItemWidth();
             if (Button("Save and try again"))
             {
-                if (highscore_list.count < array_count(highscore_list.highscores))
-                {
-                    highscore_list.highscores[highscore_list.count] = highscore;
-                    highscore_list.count++;
-                }
-                {
-                    FILE *file = fopen("gamedata.dat", "wb+");
-                    if (file)
-                    {
-                        fwrite(&highscore_list, 1, sizeof(highscore_list), file);
-                        fclose(file);
-                    }
-                }
-                {
-                    FILE *file = fopen("highscores.txt", "w+");
-                    if (file)
-                    {
-                        for (int i = 0; i < highscore_list.count; i++)
-                        {
-                            Highscore h = highscore_list.highscores[i];
-                            fprintf(file, "%d points. %s (%s)\n", h.points, h.nickname, h.email);
-                        }
-                        fclose(file);
-                    }
-                }
+                if (highscore_save(highscore))
+                    leaderboard_insert(highscore_list.count-1);
+                sync_submit(highscore, &replay);
+                highscore_export_text();
                 game_init();
             }
             SameLine();
@@ -1061,6 +783,7 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             {
                 game_init();
             }
+            leaderboard_panel(200.0f, highscore.points);
             End();
             PopStyleVar();
             PopStyleVar();
@@ -1077,7 +800,7 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
             }
             for (int i = 0; i < highscore_list.count; i++)
             {
-                int points = highscore_list.highscores[i].points;
+                int points = highscore_list.entries[i].points;
                 int bin = points+array_count(bins)/2;
                 if (bin < 0) bin = 0;
                 if (bin > array_count(bins)-1) bin = array_count(bins)-1;
@@ -1121,4 +844,103 @@ void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time)
     // end render
 }
 
+#ifdef GAME_HOT_RELOAD
+// Everything the game needs to carry on after a reload. It is copied
+// into GameMemory by the module that is unloaded, and out of it by the
+// one that replaces it.
+struct GameStatePart
+{
+    void *data;
+    size_t size;
+};
+
+GameStatePart game_state_parts[] = {
+    { &game,              sizeof(game) },
+    { &particles,         sizeof(particles) },
+    { &sim,               sizeof(sim) },
+    { &wind_params,       sizeof(wind_params) },
+    { &roomba_count,      sizeof(roomba_count) },
+    { &replay,            sizeof(replay) },
+    { &autopilot,         sizeof(autopilot) },
+    { &autopilot_engaged, sizeof(autopilot_engaged) },
+    { &camera,            sizeof(camera) },
+    { &highscore,         sizeof(highscore) },
+    { &highscore_list,    sizeof(highscore_list) },
+    { &highscore_journal, sizeof(highscore_journal) },
+    { &leaderboard,       sizeof(leaderboard) },
+    { &sync_state,        sizeof(sync_state) },
+    { &tunables,          sizeof(tunables) },
+};
+
+// Changes whenever a part is added, removed or changes size, in which
+// case the state of an older module can not be used. Changes that move
+// fields around but keep every size are not noticed, so restart after
+// those.
+u64 game_state_layout()
+{
+    u64 layout = 0xcbf29ce484222325ull;
+    for (int i = 0; i < array_count(game_state_parts); i++)
+    {
+        layout ^= (u64)game_state_parts[i].size;
+        layout *= 0x100000001b3ull;
+    }
+    return layout;
+}
+
+size_t game_state_size()
+{
+    size_t size = sizeof(u64);
+    for (int i = 0; i < array_count(game_state_parts); i++)
+        size += game_state_parts[i].size;
+    return size;
+}
+
+// Called after the module is loaded, and after every reload.
+GAME_EXPORT void game_load(GameMemory *memory)
+{
+    game_memory = memory;
+    u64 layout = game_state_layout();
+    if (!memory->state || memory->state_size != game_state_size() ||
+        memcmp(memory->state, &layout, sizeof(layout)) != 0)
+    {
+        game_init();
+        return;
+    }
+    u08 *at = memory->state+sizeof(layout);
+    for (int i = 0; i < array_count(game_state_parts); i++)
+    {
+        memcpy(game_state_parts[i].data, at, game_state_parts[i].size);
+        at += game_state_parts[i].size;
+    }
+
+    // The threads ran code of the old module, so they were stopped
+    sync_init();
+    tunables_init();
+}
+
+// Called before the module is unloaded for a reload.
+GAME_EXPORT void game_unload(GameMemory *memory)
+{
+    sync_shutdown();
+    tunables_shutdown();
+    size_t size = game_state_size();
+    if (memory->state_size != size)
+    {
+        free(memory->state);
+        memory->state = (u08*)malloc(size);
+        memory->state_size = memory->state ? size : 0;
+        if (!memory->state)
+            return;
+    }
+    u64 layout = game_state_layout();
+    memcpy(memory->state, &layout, sizeof(layout));
+    u08 *at = memory->state+sizeof(layout);
+    for (int i = 0; i < array_count(game_state_parts); i++)
+    {
+        memcpy(at, game_state_parts[i].data, game_state_parts[i].size);
+        at += game_state_parts[i].size;
+    }
+}
+#elif !defined(SEPARATE_BUILD)
 #include "platform_sdl.cpp"
+#endif
@@ -0,0 +1,727 @@
+// Highscore persistence
+//
+// The highscore list is stored as a snapshot (gamedata.dat) plus a
+// write-ahead journal (gamedata.log). Saving a score is a single
+// sequential append of one checksummed record to the journal. On load
+// we read the snapshot and replay the journal records that it does not
+// already contain, stopping at the first torn or corrupt record. Once
+// the journal grows past HIGHSCORE_CHECKPOINT records it is folded into
+// a new snapshot, so recovery only ever has to replay a short tail.
+//
+// The snapshot is written to gamedata.tmp and renamed over gamedata.dat,
+// so a crash during a checkpoint leaves either the old or the new
+// snapshot intact, and the journal still holds every record since the
+// old one.
+//
+// Records are kept in their encoded form both on disk and in memory,
+// see highscore_encode. The list only keeps the points of each record
+// unpacked, since that is what the leaderboard sorts by.
+#include <mutex>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef HIGHSCORE_SNAPSHOT_PATH // Tools can keep their own files
+#define HIGHSCORE_SNAPSHOT_PATH   "gamedata.dat"
+#define HIGHSCORE_SNAPSHOT_TEMP   "gamedata.tmp"
+#define HIGHSCORE_JOURNAL_PATH    "gamedata.log"
+#endif
+#define HIGHSCORE_SNAPSHOT_MAGIC  0x32535348 // "HSS2"
+#define HIGHSCORE_JOURNAL_MAGIC_1 0x314a5348 // "HSJ1", raw Highscore payload
+#define HIGHSCORE_JOURNAL_MAGIC   0x324a5348 // "HSJ2", encoded payload
+#define HIGHSCORE_CHECKPOINT      64
+#define HIGHSCORE_MAX             (1 << 17)
+#define HIGHSCORE_LEGACY_MAX      4096
+
+// Upper bound on highscore_encode output: a 5 byte varint for points,
+// and at most 255 string bytes with a 2 byte length for the nickname
+// and for the email, plus one domain code byte.
+#define HIGHSCORE_MAX_ENCODED     (5+2+255+2+255+1)
+#define HIGHSCORE_MAX_JOURNAL_RECORD (sizeof(HighscoreJournalHeader)+HIGHSCORE_MAX_ENCODED)
+
+struct Highscore
+{
+    int points;
+    char nickname[256];
+    char email[256];
+} highscore;
+
+struct HighscoreEntry
+{
+    int points;
+    u32 offset; // Start of the encoded record in highscore_list.data
+};
+
+struct HighscoreList
+{
+    int count;
+    HighscoreEntry entries[HIGHSCORE_MAX];
+
+    // Encoded records back to back, in list order. This is also
+    // exactly the payload of a snapshot.
+    u08 *data;
+    u32 data_used;
+    u32 data_capacity;
+} highscore_list;
+
+struct HighscoreSnapshotHeader
+{
+    u32 magic;
+    u32 count;
+    u32 length;   // Number of payload bytes following the header
+    u32 checksum; // crc32 of payload
+};
+
+struct HighscoreJournalHeader
+{
+    u32 magic;
+    u32 sequence; // Index in highscore_list that the record is stored at
+    u32 length;   // Number of payload bytes following the header
+    u32 checksum; // crc32 of sequence and payload
+};
+
+struct HighscoreJournal
+{
+    int records;  // Number of valid records currently in the journal file
+    r32 load_ms;  // Time spent in the last highscore_load
+    int replayed; // Number of records replayed by the last highscore_load
+
+    // Records of the list that are in the snapshot or were written to the
+    // journal on this thread. The ones after it were left to another
+    // thread by highscore_add_batch, see highscore_save_batch.
+    int journaled;
+
+    // Set if another thread failed to write to the journal, possibly
+    // leaving a torn record that replay would stop at, so that the next
+    // save checkpoints instead of appending after it.
+    bool damaged;
+} highscore_journal;
+
+// Held while the journal is appended to or emptied, since the sync
+// worker journals merged scores while the frame thread saves its own.
+// One thread's records never interleave with or get cut by another's.
+std::mutex highscore_journal_mutex;
+
+//////////////////// Encoding ////////////////////
+// An encoded record is
+//
+//   varint  zigzag(points)
+//   varint  nickname length, followed by the UTF-8 bytes
+//   varint  length of the email up to '@', followed by the bytes
+//   u08     domain code
+//             0:   the email has no '@'
+//             1:   varint length and bytes of the domain follow
+//             2+i: the domain is highscore_email_domains[i]
+//
+// which is usually 20-30 bytes instead of sizeof(Highscore) = 516.
+// The dictionary is part of the format, so only ever append to it.
+const char *highscore_email_domains[] = {
+    "gmail.com", "hotmail.com", "outlook.com", "yahoo.com", "icloud.com",
+    "live.com", "msn.com", "online.no", "hotmail.no", "live.no",
+    "ntnu.no", "stud.ntnu.no", "uio.no", "ProbablyGmail.com"
+};
+
+int highscore_put_varint(u08 *out, u32 x)
+{
+    int n = 0;
+    while (x >= 0x80)
+    {
+        out[n++] = (u08)(x | 0x80);
+        x >>= 7;
+    }
+    out[n++] = (u08)x;
+    return n;
+}
+
+// return: Number of bytes read, or 0 if the varint runs past end.
+int highscore_get_varint(const u08 *in, const u08 *end, u32 *x)
+{
+    u32 result = 0;
+    for (int n = 0; n < 5 && in+n < end; n++)
+    {
+        result |= (u32)(in[n] & 0x7f) << (7*n);
+        if (!(in[n] & 0x80))
+        {
+            *x = result;
+            return n+1;
+        }
+    }
+    return 0;
+}
+
+u32 highscore_zigzag(int x)   { return ((u32)x << 1) ^ (u32)(x >> 31); }
+int highscore_unzigzag(u32 x) { return (int)(x >> 1) ^ -(int)(x & 1); }
+
+// return: Length of s clamped to max bytes, without cutting a UTF-8
+//         sequence in half.
+int highscore_utf8_length(const char *s, int max)
+{
+    int length = 0;
+    while (length < max && s[length])
+        length++;
+    if (length == max)
+        while (length > 0 && ((u08)s[length] & 0xc0) == 0x80)
+            length--;
+    return length;
+}
+
+int highscore_put_string(u08 *out, const char *s, int length)
+{
+    int n = highscore_put_varint(out, (u32)length);
+    memcpy(out+n, s, length);
+    return n+length;
+}
+
+// out must hold HIGHSCORE_MAX_ENCODED bytes. The domain dictionary is
+// optional, records encoded without it decode the same.
+// return: Number of bytes written
+int highscore_encode(const Highscore *h, u08 *out, bool use_dictionary = true)
+{
+    int n = highscore_put_varint(out, highscore_zigzag(h->points));
+    int nickname_length = highscore_utf8_length(h->nickname, 255);
+    n += highscore_put_string(out+n, h->nickname, nickname_length);
+
+    int email_length = highscore_utf8_length(h->email, 255);
+    int local_length = 0;
+    while (local_length < email_length && h->email[local_length] != '@')
+        local_length++;
+    n += highscore_put_string(out+n, h->email, local_length);
+    if (local_length == email_length)
+    {
+        out[n++] = 0;
+        return n;
+    }
+
+    const char *domain = h->email+local_length+1;
+    int domain_length = email_length-local_length-1;
+    if (use_dictionary)
+    {
+        for (int i = 0; i < array_count(highscore_email_domains); i++)
+        {
+            const char *entry = highscore_email_domains[i];
+            if ((int)strlen(entry) == domain_length && memcmp(entry, domain, domain_length) == 0)
+            {
+                out[n++] = (u08)(2+i);
+                return n;
+            }
+        }
+    }
+    out[n++] = 1;
+    n += highscore_put_string(out+n, domain, domain_length);
+    return n;
+}
+
+int highscore_get_string(const u08 *in, const u08 *end, char *out, int capacity)
+{
+    u32 length;
+    int n = highscore_get_varint(in, end, &length);
+    if (n == 0 || length > (u32)(end-in-n) || length >= (u32)capacity)
+        return 0;
+    memcpy(out, in+n, length);
+    out[length] = 0;
+    return n+(int)length;
+}
+
+// return: Number of bytes read, or 0 if the record is malformed.
+int highscore_decode(const u08 *in, const u08 *end, Highscore *h)
+{
+    const u08 *at = in;
+    u32 points;
+    int n = highscore_get_varint(at, end, &points);
+    if (n == 0) return 0;
+    h->points = highscore_unzigzag(points);
+    at += n;
+
+    n = highscore_get_string(at, end, h->nickname, sizeof(h->nickname));
+    if (n == 0) return 0;
+    at += n;
+
+    n = highscore_get_string(at, end, h->email, sizeof(h->email));
+    if (n == 0 || at+n >= end) return 0;
+    at += n;
+
+    int local_length = (int)strlen(h->email);
+    int code = *at++;
+    if (code == 0)
+        return (int)(at-in);
+
+    char domain[256];
+    if (code == 1)
+    {
+        n = highscore_get_string(at, end, domain, sizeof(domain));
+        if (n == 0) return 0;
+        at += n;
+    }
+    else if (code-2 < array_count(highscore_email_domains))
+    {
+        strcpy(domain, highscore_email_domains[code-2]);
+    }
+    else
+    {
+        return 0;
+    }
+    if (local_length+1+(int)strlen(domain) >= sizeof(h->email))
+        return 0;
+    h->email[local_length] = '@';
+    strcpy(h->email+local_length+1, domain);
+    return (int)(at-in);
+}
+
+// return: The points of an encoded record, without decoding the strings.
+int highscore_decode_points(const u08 *in, const u08 *end)
+{
+    u32 points = 0;
+    highscore_get_varint(in, end, &points);
+    return highscore_unzigzag(points);
+}
+
+//////////////////// List ////////////////////
+
+bool highscore_reserve(u32 bytes)
+{
+    if (highscore_list.data_used+bytes <= highscore_list.data_capacity)
+        return true;
+    u32 capacity = highscore_list.data_capacity ? highscore_list.data_capacity : 64*1024;
+    while (capacity < highscore_list.data_used+bytes)
+        capacity *= 2;
+    u08 *data = (u08*)realloc(highscore_list.data, capacity);
+    if (!data)
+        return false;
+    highscore_list.data = data;
+    highscore_list.data_capacity = capacity;
+    return true;
+}
+
+// Appends an already encoded record to the in-memory list.
+bool highscore_append_encoded(const u08 *record, int length)
+{
+    if (highscore_list.count >= HIGHSCORE_MAX || !highscore_reserve((u32)length))
+        return false;
+    HighscoreEntry *entry = &highscore_list.entries[highscore_list.count];
+    entry->offset = highscore_list.data_used;
+    entry->points = highscore_decode_points(record, record+length);
+    memcpy(highscore_list.data+highscore_list.data_used, record, length);
+    highscore_list.data_used += (u32)length;
+    highscore_list.count++;
+    return true;
+}
+
+bool highscore_append(const Highscore *h)
+{
+    u08 record[HIGHSCORE_MAX_ENCODED];
+    int length = highscore_encode(h, record);
+    return highscore_append_encoded(record, length);
+}
+
+void highscore_get(int index, Highscore *h)
+{
+    u32 begin = highscore_list.entries[index].offset;
+    u32 end = index+1 < highscore_list.count ? highscore_list.entries[index+1].offset
+                                             : highscore_list.data_used;
+    highscore_decode(highscore_list.data+begin, highscore_list.data+end, h);
+}
+
+// return: Size of the encoded record at in, or 0 if it is malformed.
+//         Only walks the lengths, so it is much cheaper than decoding.
+int highscore_skip(const u08 *in, const u08 *end, int *points)
+{
+    const u08 *at = in;
+    u32 x;
+    int n = highscore_get_varint(at, end, &x);
+    if (n == 0) return 0;
+    *points = highscore_unzigzag(x);
+    at += n;
+    for (int i = 0; i < 2; i++)
+    {
+        n = highscore_get_varint(at, end, &x);
+        if (n == 0 || x > 255 || x > (u32)(end-at-n)) return 0;
+        at += n+x;
+    }
+    if (at >= end) return 0;
+    int code = *at++;
+    if (code == 1)
+    {
+        n = highscore_get_varint(at, end, &x);
+        if (n == 0 || x > 255 || x > (u32)(end-at-n)) return 0;
+        at += n+x;
+    }
+    else if (code-2 >= (int)array_count(highscore_email_domains))
+    {
+        return 0;
+    }
+    return (int)(at-in);
+}
+
+// Rebuilds the entries from the encoded data.
+// return: false if the data does not hold exactly count valid records.
+bool highscore_index(u32 count)
+{
+    const u08 *data = highscore_list.data;
+    const u08 *end = data+highscore_list.data_used;
+    const u08 *at = data;
+    highscore_list.count = 0;
+    while (at < end && highscore_list.count < HIGHSCORE_MAX)
+    {
+        HighscoreEntry *entry = &highscore_list.entries[highscore_list.count];
+        int n = highscore_skip(at, end, &entry->points);
+        if (n == 0)
+            break;
+        entry->offset = (u32)(at-data);
+        highscore_list.count++;
+        at += n;
+    }
+    return at == end && highscore_list.count == (int)count;
+}
+
+//////////////////// Disk ////////////////////
+
+u32 crc32(u32 crc, const void *data, size_t length)
+{
+    persist u32 table[256];
+    persist bool table_ready = false;
+    if (!table_ready)
+    {
+        for (u32 i = 0; i < 256; i++)
+        {
+            u32 c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+    const u08 *bytes = (const u08*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Pushes the file contents past the OS cache, so that a record that
+// was reported as written survives a power loss and not just a crash.
+void flush_to_disk(FILE *file)
+{
+    fflush(file);
+    #ifdef _WIN32
+    _commit(_fileno(file));
+    #else
+    fsync(fileno(file));
+    #endif
+}
+
+u32 highscore_record_checksum(u32 sequence, const void *payload, u32 length)
+{
+    u32 crc = crc32(0, &sequence, sizeof(sequence));
+    return crc32(crc, payload, length);
+}
+
+bool highscore_write_snapshot()
+{
+    FILE *file = fopen(HIGHSCORE_SNAPSHOT_TEMP, "wb");
+    if (!file)
+        return false;
+    HighscoreSnapshotHeader header;
+    header.magic = HIGHSCORE_SNAPSHOT_MAGIC;
+    header.count = (u32)highscore_list.count;
+    header.length = highscore_list.data_used;
+    header.checksum = crc32(0, highscore_list.data, highscore_list.data_used);
+    bool written = fwrite(&header, 1, sizeof(header), file) == sizeof(header) &&
+                   fwrite(highscore_list.data, 1, header.length, file) == header.length;
+    flush_to_disk(file);
+    fclose(file);
+    if (!written)
+        return false;
+
+    // rename does not replace existing files on Windows. If we die
+    // between remove and rename, highscore_load picks up the temp file.
+    remove(HIGHSCORE_SNAPSHOT_PATH);
+    return rename(HIGHSCORE_SNAPSHOT_TEMP, HIGHSCORE_SNAPSHOT_PATH) == 0;
+}
+
+// Folds the journal into a new snapshot and empties the journal.
+void highscore_checkpoint()
+{
+    std::lock_guard<std::mutex> lock(highscore_journal_mutex);
+    if (!highscore_write_snapshot())
+        return;
+    FILE *file = fopen(HIGHSCORE_JOURNAL_PATH, "wb");
+    if (file)
+    {
+        flush_to_disk(file);
+        fclose(file);
+        highscore_journal.records = 0;
+    }
+    highscore_journal.journaled = highscore_list.count;
+    highscore_journal.damaged = false;
+}
+
+// Reads the fixed-size HighscoreList that the game used to fwrite as a
+// whole: an int count followed by HIGHSCORE_LEGACY_MAX raw records.
+bool highscore_read_legacy_snapshot(FILE *file, int count)
+{
+    if (count < 0 || count > HIGHSCORE_LEGACY_MAX)
+        return false;
+    for (int i = 0; i < count; i++)
+    {
+        Highscore h;
+        if (fread(&h, 1, sizeof(h), file) != sizeof(h))
+            return false;
+        h.nickname[sizeof(h.nickname)-1] = 0;
+        h.email[sizeof(h.email)-1] = 0;
+        highscore_append(&h);
+    }
+    return true;
+}
+
+bool highscore_read_snapshot(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    bool ok = false;
+    HighscoreSnapshotHeader header;
+    if (fread(&header, 1, sizeof(header), file) == sizeof(header))
+    {
+        if (header.magic == HIGHSCORE_SNAPSHOT_MAGIC)
+        {
+            // The payload is the in-memory representation, so it is read
+            // with one fread and only scanned to rebuild the entries.
+            if (highscore_reserve(header.length) &&
+                fread(highscore_list.data, 1, header.length, file) == header.length &&
+                crc32(0, highscore_list.data, header.length) == header.checksum)
+            {
+                highscore_list.data_used = header.length;
+                ok = highscore_index(header.count);
+            }
+        }
+        else
+        {
+            fseek(file, sizeof(int), SEEK_SET);
+            ok = highscore_read_legacy_snapshot(file, (int)header.magic);
+        }
+    }
+    fclose(file);
+    if (!ok)
+    {
+        highscore_list.count = 0;
+        highscore_list.data_used = 0;
+    }
+    return ok;
+}
+
+// return: true if the journal ended cleanly, false if it had a torn
+//         or corrupt tail that was ignored.
+bool highscore_replay_journal()
+{
+    highscore_journal.records = 0;
+    highscore_journal.replayed = 0;
+    FILE *file = fopen(HIGHSCORE_JOURNAL_PATH, "rb");
+    if (!file)
+        return true;
+
+    bool clean = true;
+    for (;;)
+    {
+        HighscoreJournalHeader header;
+        size_t read_bytes = fread(&header, 1, sizeof(header), file);
+        if (read_bytes == 0)
+            break;
+        bool legacy = header.magic == HIGHSCORE_JOURNAL_MAGIC_1;
+        if (read_bytes != sizeof(header) ||
+            (header.magic != HIGHSCORE_JOURNAL_MAGIC && !legacy) ||
+            (legacy && header.length != sizeof(Highscore)) ||
+            (!legacy && header.length > HIGHSCORE_MAX_ENCODED))
+        {
+            clean = false;
+            break;
+        }
+
+        union { Highscore raw; u08 encoded[HIGHSCORE_MAX_ENCODED]; } payload;
+        if (fread(&payload, 1, header.length, file) != header.length ||
+            highscore_record_checksum(header.sequence, &payload, header.length) != header.checksum)
+        {
+            clean = false;
+            break;
+        }
+
+        // Records below count are already in the snapshot (we crashed
+        // after writing the snapshot but before truncating the journal).
+        // A record beyond count means a record is missing in between.
+        if ((int)header.sequence > highscore_list.count)
+        {
+            clean = false;
+            break;
+        }
+        if ((int)header.sequence == highscore_list.count)
+        {
+            bool appended;
+            if (legacy)
+            {
+                payload.raw.nickname[sizeof(payload.raw.nickname)-1] = 0;
+                payload.raw.email[sizeof(payload.raw.email)-1] = 0;
+                appended = highscore_append(&payload.raw);
+            }
+            else
+            {
+                Highscore scratch;
+                appended = highscore_decode(payload.encoded, payload.encoded+header.length, &scratch) == (int)header.length &&
+                           highscore_append_encoded(payload.encoded, header.length);
+            }
+            if (!appended)
+            {
+                clean = false;
+                break;
+            }
+            highscore_journal.replayed++;
+        }
+        highscore_journal.records++;
+    }
+    fclose(file);
+    return clean;
+}
+
+void highscore_load()
+{
+    u64 begin = perf_counter();
+    highscore_list.count = 0;
+    highscore_list.data_used = 0;
+    if (!highscore_read_snapshot(HIGHSCORE_SNAPSHOT_PATH))
+        highscore_read_snapshot(HIGHSCORE_SNAPSHOT_TEMP);
+
+    // Appending after a torn record would hide every later record from
+    // the next replay, so get rid of the tail before saving anything.
+    if (!highscore_replay_journal())
+        highscore_checkpoint();
+    highscore_journal.journaled = highscore_list.count;
+    highscore_journal.damaged = false;
+    highscore_journal.load_ms = 1000.0f*time_since(begin);
+}
+
+void highscore_export_text()
+{
+    FILE *file = fopen("highscores.txt", "w+");
+    if (file)
+    {
+        for (int i = 0; i < highscore_list.count; i++)
+        {
+            Highscore h;
+            highscore_get(i, &h);
+            fprintf(file, "%d points. %s (%s)\n", h.points, h.nickname, h.email);
+        }
+        fclose(file);
+    }
+}
+
+// Writes the journal record of the list entry at index to out, which
+// must hold HIGHSCORE_MAX_JOURNAL_RECORD bytes. Header and payload go
+// out together, so the journal only ever grows by whole records or by
+// a torn tail that fails its crc.
+// return: Number of bytes written
+int highscore_put_journal_record(int index, u08 *out)
+{
+    u32 begin = highscore_list.entries[index].offset;
+    u32 end = index+1 < highscore_list.count ? highscore_list.entries[index+1].offset : highscore_list.data_used;
+    HighscoreJournalHeader header;
+    header.magic = HIGHSCORE_JOURNAL_MAGIC;
+    header.sequence = (u32)index;
+    header.length = end-begin;
+    header.checksum = highscore_record_checksum(header.sequence, highscore_list.data+begin, header.length);
+    memcpy(out, &header, sizeof(header));
+    memcpy(out+sizeof(header), highscore_list.data+begin, header.length);
+    return (int)(sizeof(header)+header.length);
+}
+
+// Appends journal records, as written by highscore_put_journal_record,
+// to the journal file. Touches nothing but the file, so it can be
+// called from any thread, as long as only one thread at a time writes
+// records that the others have not written before them. Waits for any
+// save or checkpoint in progress.
+// return: false if they may not all have been written
+bool highscore_write_journal(const u08 *journal, int length, bool durable)
+{
+    std::lock_guard<std::mutex> lock(highscore_journal_mutex);
+    FILE *file = fopen(HIGHSCORE_JOURNAL_PATH, "ab");
+    if (!file)
+        return false;
+    bool written = fwrite(journal, 1, length, file) == (size_t)length;
+    if (durable)
+        flush_to_disk(file);
+    return fclose(file) == 0 && written;
+}
+
+// Appends records to the in-memory list only, and puts their journal
+// records in journal, for another thread to write with
+// highscore_write_journal. Unlike highscore_save_batch this does no
+// file I/O, so it can be called from the frame thread. The records are
+// lost if the game stops before they are written, or if writing fails.
+// journal: Must hold count*HIGHSCORE_MAX_JOURNAL_RECORD bytes
+// return: Number of records added before the list filled up
+int highscore_add_batch(const Highscore *records, int count, u08 *journal, int *journal_length)
+{
+    int added = 0;
+    int length = 0;
+    while (added < count && highscore_append(&records[added]))
+    {
+        length += highscore_put_journal_record(highscore_list.count-1, journal+length);
+        added++;
+    }
+    *journal_length = length;
+    return added;
+}
+
+// Appends records to the list and journals them with one sequential
+// write. Durable saves are pushed to disk before returning, and may
+// fold the journal into a new snapshot. Non-durable saves only hand the
+// write to the OS, which survives the process dying but not the
+// machine, and never checkpoint.
+//
+// The records that highscore_add_batch left to another thread since
+// the last save are journaled again first, since that thread may not
+// have written them yet, and replay stops at a gap in the sequence.
+// Replay skips the copy that comes second. Waits while the other
+// thread is writing, see highscore_journal_mutex.
+// return: Number of records saved before the list filled up.
+int highscore_save_batch(const Highscore *records, int count, bool durable)
+{
+    int saved = 0;
+    while (saved < count && highscore_append(&records[saved]))
+        saved++;
+
+    {
+        std::lock_guard<std::mutex> lock(highscore_journal_mutex);
+        FILE *file = highscore_journal.damaged ? 0 : fopen(HIGHSCORE_JOURNAL_PATH, "ab");
+        bool journaled = file != 0;
+        for (int i = highscore_journal.journaled; journaled && i < highscore_list.count; i++)
+        {
+            u08 record[HIGHSCORE_MAX_JOURNAL_RECORD];
+            size_t size = (size_t)highscore_put_journal_record(i, record);
+            if (fwrite(record, 1, size, file) == size)
+                highscore_journal.records++;
+            else
+                journaled = false;
+        }
+        if (file)
+        {
+            if (durable)
+                flush_to_disk(file);
+            fclose(file);
+        }
+        if (journaled)
+            highscore_journal.journaled = highscore_list.count;
+    }
+
+    // A record missing from the journal would stop replay at that point,
+    // so fall back to writing everything into a snapshot.
+    if (highscore_journal.journaled < highscore_list.count ||
+        (durable && highscore_journal.records >= HIGHSCORE_CHECKPOINT))
+        highscore_checkpoint();
+    return saved;
+}
+
+// return: false if the list is full and the score was dropped.
+bool highscore_save(Highscore h)
+{
+    return highscore_save_batch(&h, 1, true) == 1;
+}
@@ -0,0 +1,235 @@
+// highscore_bench: times loading the highscore list.
+//
+// Generates a list of random records, with nicknames and emails like
+// the ones players type, and saves it both as a snapshot in the encoded
+// format and as the fixed-size list that the game used to fwrite whole.
+// Then times reading each back, with a warm page cache: the old single
+// fread, highscore_load on the snapshot, and highscore_load converting
+// the old file. Also checks that every record reads back the same.
+// The old format holds at most 4096 records, so it is only timed up to
+// that. The files are written to the current directory.
+//
+//    $ g++ -O2 ../highscore_bench.cpp -o highscore_bench
+//    $ ./highscore_bench --records 4096 --runs 200
+//    $ ./highscore_bench --records 100000
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#define HIGHSCORE_SNAPSHOT_PATH "highscore_bench.dat"
+#define HIGHSCORE_SNAPSHOT_TEMP "highscore_bench.tmp"
+#define HIGHSCORE_JOURNAL_PATH  "highscore_bench.log"
+#include "highscore.cpp"
+
+#define BENCH_SEED        0x68697363
+#define BENCH_LEGACY_PATH "highscore_bench_legacy.dat"
+
+// What the game used to fwrite and fread as a whole
+struct LegacyList
+{
+    int count;
+    Highscore records[HIGHSCORE_LEGACY_MAX];
+};
+
+const char *bench_names[] = {
+    "Nickname", "ola", "kari", "drone_pilot", "xXpendulumXx", "roombaslayer",
+    "Magnus", "ingrid.h", "Åse", "Bjørn", "tester", "a"
+};
+
+// Other domains than these are stored in full
+const char *bench_domains[] = {
+    "gmail.com", "hotmail.com", "stud.ntnu.no", "ProbablyGmail.com", "online.no",
+    "example.com", "student.uib.no", "protonmail.com"
+};
+
+void bench_generate(Highscore *records, int count)
+{
+    RngKey key = rng_key(BENCH_SEED);
+    for (int i = 0; i < count; i++)
+    {
+        u32 r = rng_u32(key, (u64)i, 0);
+        const char *name = bench_names[r % array_count(bench_names)];
+        const char *domain = bench_domains[(r >> 8) % array_count(bench_domains)];
+        Highscore *h = &records[i];
+        memset(h, 0, sizeof(*h));
+        h->points = (int)((r >> 16) % 200) - 20;
+        sprintf(h->nickname, "%s%d", name, i % 100);
+        sprintf(h->email, "%s%d@%s", name, i, domain);
+    }
+}
+
+bool bench_write_legacy(const LegacyList *list)
+{
+    FILE *file = fopen(BENCH_LEGACY_PATH, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(list, 1, sizeof(*list), file) == sizeof(*list);
+    fclose(file);
+    return written;
+}
+
+bool bench_read_legacy(LegacyList *list)
+{
+    FILE *file = fopen(BENCH_LEGACY_PATH, "rb");
+    if (!file)
+        return false;
+    bool read = fread(list, 1, sizeof(*list), file) == sizeof(*list);
+    fclose(file);
+    return read;
+}
+
+// return: true if the list holds exactly these records, in this order
+bool bench_check(const Highscore *records, int count)
+{
+    if (highscore_list.count != count)
+        return false;
+    for (int i = 0; i < count; i++)
+    {
+        Highscore h;
+        highscore_get(i, &h);
+        if (h.points != records[i].points || strcmp(h.nickname, records[i].nickname) != 0 ||
+            strcmp(h.email, records[i].email) != 0)
+            return false;
+    }
+    return true;
+}
+
+long bench_file_size(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+void bench_print(const char *name, r32 total, r32 best, int runs)
+{
+    printf("  %-28s %8.3f ms mean %8.3f ms best\n", name, 1000.0f*total/runs, 1000.0f*best);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 4096;
+    int runs = 100;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--records") == 0 && i+1 < argc)
+            count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i+1 < argc)
+            runs = atoi(argv[++i]);
+        else
+        {
+            printf("usage: highscore_bench [--records n] [--runs n]\n");
+            return 1;
+        }
+    }
+    if (count < 0 || count > HIGHSCORE_MAX)
+    {
+        printf("--records must be from 0 to %d\n", HIGHSCORE_MAX);
+        return 1;
+    }
+    if (runs < 1)
+        runs = 1;
+    bool legacy = count <= HIGHSCORE_LEGACY_MAX;
+
+    Highscore *records = (Highscore*)malloc((count > 0 ? count : 1)*sizeof(Highscore));
+    LegacyList *legacy_list = (LegacyList*)calloc(1, sizeof(LegacyList));
+    bench_generate(records, count);
+
+    // The snapshot, with an empty journal
+    remove(HIGHSCORE_JOURNAL_PATH);
+    highscore_list.count = 0;
+    highscore_list.data_used = 0;
+    for (int i = 0; i < count; i++)
+        highscore_append(&records[i]);
+    if (!highscore_write_snapshot())
+    {
+        printf("Failed to write %s\n", HIGHSCORE_SNAPSHOT_PATH);
+        return 1;
+    }
+    if (legacy)
+    {
+        legacy_list->count = count;
+        memcpy(legacy_list->records, records, count*sizeof(Highscore));
+        if (!bench_write_legacy(legacy_list))
+        {
+            printf("Failed to write %s\n", BENCH_LEGACY_PATH);
+            return 1;
+        }
+    }
+
+    printf("%d records, %d runs\n", count, runs);
+    printf("  snapshot %ld bytes, %u bytes of records in memory\n",
+           bench_file_size(HIGHSCORE_SNAPSHOT_PATH), highscore_list.data_used);
+    if (legacy)
+        printf("  old format %ld bytes\n", bench_file_size(BENCH_LEGACY_PATH));
+
+    bool passed = true;
+    r32 total = 0.0f;
+    r32 best = 1e9f;
+    for (int run = 0; legacy && run < runs; run++)
+    {
+        u64 begin = perf_counter();
+        bool read = bench_read_legacy(legacy_list);
+        r32 t = time_since(begin);
+        passed = passed && read && legacy_list->count == count;
+        total += t;
+        best = t < best ? t : best;
+    }
+    if (legacy)
+        bench_print("fread of the old format", total, best, runs);
+
+    total = 0.0f;
+    best = 1e9f;
+    for (int run = 0; run < runs; run++)
+    {
+        u64 begin = perf_counter();
+        highscore_load();
+        r32 t = time_since(begin);
+        total += t;
+        best = t < best ? t : best;
+    }
+    passed = passed && bench_check(records, count);
+    bench_print("highscore_load", total, best, runs);
+
+    // The old file in place of the snapshot, which highscore_load
+    // converts as it reads it
+    total = 0.0f;
+    best = 1e9f;
+    for (int run = 0; legacy && run < runs; run++)
+    {
+        remove(HIGHSCORE_SNAPSHOT_PATH);
+        rename(BENCH_LEGACY_PATH, HIGHSCORE_SNAPSHOT_PATH);
+        u64 begin = perf_counter();
+        highscore_load();
+        r32 t = time_since(begin);
+        rename(HIGHSCORE_SNAPSHOT_PATH, BENCH_LEGACY_PATH);
+        total += t;
+        best = t < best ? t : best;
+    }
+    if (legacy)
+    {
+        passed = passed && bench_check(records, count);
+        bench_print("highscore_load, old format", total, best, runs);
+    }
+
+    printf("Records read back %s\n", passed ? "the same" : "DIFFERENTLY");
+    free(records);
+    free(legacy_list);
+    return passed ? 0 : 1;
+}
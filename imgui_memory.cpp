@@ -0,0 +1,161 @@
+// ImGui memory
+//
+// ImGui allocates through io.MemAllocFn and io.MemFreeFn, mostly to grow
+// its ImVectors (draw lists, window storage, text buffers) and to build
+// the font atlas. The vectors keep their capacity from frame to frame,
+// but new windows, tree nodes and text fields, and every activation of
+// an InputText, allocate again. Instead of going to malloc each time,
+// blocks are taken from pools of fixed size classes (powers of two, from
+// 16 bytes to IMGUI_MEMORY_MAX_BLOCK), and freed blocks are kept on a
+// free list per class to be handed out again. Once the UI has been
+// through its screens, frames take nothing from the system.
+//
+// MemFreeFn is not told the size of the block, so each block starts with
+// a header that holds its size class. Pools grow a slab of
+// IMGUI_MEMORY_SLAB bytes at a time and never shrink. Blocks too large
+// for the pools (the font atlas, mostly) are passed on to malloc.
+//
+// ImGui is only used on the frame thread, so none of this is locked.
+#include <stddef.h>
+
+#define IMGUI_MEMORY_MIN_BLOCK   16
+#define IMGUI_MEMORY_MAX_BLOCK   (256*1024)
+#define IMGUI_MEMORY_NUM_CLASSES 15 // 16 << 14 is the largest
+#define IMGUI_MEMORY_SLAB        (64*1024)
+#define IMGUI_MEMORY_LARGE       IMGUI_MEMORY_NUM_CLASSES
+
+// Keeps the blocks aligned like malloc does
+union ImGuiMemoryHeader
+{
+    struct
+    {
+        u32 size_class; // Or IMGUI_MEMORY_LARGE
+        size_t size;    // Of large blocks
+    };
+    max_align_t align;
+};
+
+struct ImGuiMemoryFree
+{
+    ImGuiMemoryFree *next;
+};
+
+struct ImGuiMemory
+{
+    ImGuiMemoryFree *free[IMGUI_MEMORY_NUM_CLASSES];
+
+    // Of the current frame, moved to stats by imgui_memory_frame
+    int allocs;
+    int frees;
+    int system_allocs;
+
+    int live;
+    size_t pooled;
+    size_t large;
+    ImGuiMemoryStats stats;
+} imgui_memory;
+
+int imgui_memory_class(size_t size)
+{
+    int size_class = 0;
+    size_t block = IMGUI_MEMORY_MIN_BLOCK;
+    while (block < size)
+    {
+        block *= 2;
+        size_class++;
+    }
+    return size_class;
+}
+
+// return: false if out of memory
+bool imgui_memory_grow(int size_class)
+{
+    size_t block = sizeof(ImGuiMemoryHeader) + ((size_t)IMGUI_MEMORY_MIN_BLOCK << size_class);
+    size_t count = IMGUI_MEMORY_SLAB/block > 0 ? IMGUI_MEMORY_SLAB/block : 1;
+    u08 *slab = (u08*)malloc(count*block);
+    if (!slab)
+        return false;
+    imgui_memory.system_allocs++;
+    imgui_memory.pooled += count*block;
+    for (size_t i = 0; i < count; i++)
+    {
+        ImGuiMemoryHeader *header = (ImGuiMemoryHeader*)(slab + i*block);
+        header->size_class = (u32)size_class;
+        ImGuiMemoryFree *node = (ImGuiMemoryFree*)(header+1);
+        node->next = imgui_memory.free[size_class];
+        imgui_memory.free[size_class] = node;
+    }
+    return true;
+}
+
+void *imgui_memory_alloc(size_t size)
+{
+    imgui_memory.allocs++;
+    if (size > IMGUI_MEMORY_MAX_BLOCK)
+    {
+        ImGuiMemoryHeader *header = (ImGuiMemoryHeader*)malloc(sizeof(ImGuiMemoryHeader)+size);
+        if (!header)
+            return 0;
+        imgui_memory.system_allocs++;
+        imgui_memory.large += size;
+        imgui_memory.live++;
+        header->size_class = IMGUI_MEMORY_LARGE;
+        header->size = size;
+        return header+1;
+    }
+
+    int size_class = imgui_memory_class(size);
+    if (!imgui_memory.free[size_class] && !imgui_memory_grow(size_class))
+        return 0;
+    ImGuiMemoryFree *node = imgui_memory.free[size_class];
+    imgui_memory.free[size_class] = node->next;
+    imgui_memory.live++;
+    return node;
+}
+
+void imgui_memory_free(void *data)
+{
+    if (!data)
+        return;
+    imgui_memory.frees++;
+    imgui_memory.live--;
+    ImGuiMemoryHeader *header = (ImGuiMemoryHeader*)data - 1;
+    if (header->size_class == IMGUI_MEMORY_LARGE)
+    {
+        imgui_memory.large -= header->size;
+        free(header);
+        return;
+    }
+    ImGuiMemoryFree *node = (ImGuiMemoryFree*)data;
+    node->next = imgui_memory.free[header->size_class];
+    imgui_memory.free[header->size_class] = node;
+}
+
+// Must be called before ImGui allocates anything, since blocks from
+// malloc can not be given to imgui_memory_free.
+void imgui_memory_init()
+{
+    ImGuiIO &io = ImGui::GetIO();
+    io.MemAllocFn = imgui_memory_alloc;
+    io.MemFreeFn = imgui_memory_free;
+}
+
+// Called once per frame, before the next ImGui frame starts
+void imgui_memory_frame()
+{
+    ImGuiMemoryStats &stats = imgui_memory.stats;
+    stats.allocs = imgui_memory.allocs;
+    stats.frees = imgui_memory.frees;
+    stats.system_allocs = imgui_memory.system_allocs;
+    stats.live = imgui_memory.live;
+    stats.pooled = imgui_memory.pooled;
+    stats.large = imgui_memory.large;
+    imgui_memory.allocs = 0;
+    imgui_memory.frees = 0;
+    imgui_memory.system_allocs = 0;
+}
+
+ImGuiMemoryStats imgui_memory_stats()
+{
+    return imgui_memory.stats;
+}
@@ -0,0 +1,139 @@
+// Leaderboard
+//
+// Keeps the best LEADERBOARD_SIZE entries of highscore_list in a binary
+// min-heap of list indices, with the worst kept score at the root. An
+// insert is O(1) when the score does not qualify and O(log K) otherwise.
+// The ranked index (best first) is rebuilt lazily from the heap when it
+// is needed for drawing, which only happens after a change.
+#define LEADERBOARD_SIZE HIGHSCORE_MAX
+
+struct Leaderboard
+{
+    int heap[LEADERBOARD_SIZE];
+    int count;
+
+    int ranked[LEADERBOARD_SIZE]; // Indices into highscore_list, best first
+    int ranked_count;
+    bool dirty;
+} leaderboard;
+
+// return: true if list entry a ranks below list entry b. Equal scores
+//         are ranked by who got there first.
+bool leaderboard_worse(int a, int b)
+{
+    int pa = highscore_list.entries[a].points;
+    int pb = highscore_list.entries[b].points;
+    if (pa != pb)
+        return pa < pb;
+    return a > b;
+}
+
+void leaderboard_sift_up(int *heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i-1)/2;
+        if (!leaderboard_worse(heap[i], heap[parent]))
+            break;
+        int t = heap[i]; heap[i] = heap[parent]; heap[parent] = t;
+        i = parent;
+    }
+}
+
+void leaderboard_sift_down(int *heap, int count, int i)
+{
+    for (;;)
+    {
+        int l = 2*i+1;
+        int r = 2*i+2;
+        int worst = i;
+        if (l < count && leaderboard_worse(heap[l], heap[worst])) worst = l;
+        if (r < count && leaderboard_worse(heap[r], heap[worst])) worst = r;
+        if (worst == i)
+            break;
+        int t = heap[i]; heap[i] = heap[worst]; heap[worst] = t;
+        i = worst;
+    }
+}
+
+void leaderboard_insert(int index)
+{
+    if (leaderboard.count < LEADERBOARD_SIZE)
+    {
+        leaderboard.heap[leaderboard.count] = index;
+        leaderboard_sift_up(leaderboard.heap, leaderboard.count);
+        leaderboard.count++;
+        leaderboard.dirty = true;
+    }
+    else if (leaderboard_worse(leaderboard.heap[0], index))
+    {
+        leaderboard.heap[0] = index;
+        leaderboard_sift_down(leaderboard.heap, leaderboard.count, 0);
+        leaderboard.dirty = true;
+    }
+}
+
+void leaderboard_rebuild()
+{
+    leaderboard.count = 0;
+    leaderboard.ranked_count = 0;
+    leaderboard.dirty = true;
+    for (int i = 0; i < highscore_list.count; i++)
+        leaderboard_insert(i);
+}
+
+// Heapsorts a copy of the heap into the ranked index. Popping the root
+// yields the worst entry, so the ranked index is filled from the back.
+void leaderboard_update_ranking()
+{
+    if (!leaderboard.dirty)
+        return;
+    int n = leaderboard.count;
+    int *ranked = leaderboard.ranked;
+    for (int i = 0; i < n; i++)
+        ranked[i] = leaderboard.heap[i];
+    for (int end = n-1; end > 0; end--)
+    {
+        int t = ranked[0]; ranked[0] = ranked[end]; ranked[end] = t;
+        leaderboard_sift_down(ranked, end, 0);
+    }
+    leaderboard.ranked_count = n;
+    leaderboard.dirty = false;
+}
+
+// return: The 1-based rank that a new score with the given points would
+//         get, i.e. one more than the number of kept scores above it.
+int leaderboard_rank_of(int points)
+{
+    leaderboard_update_ranking();
+    int lo = 0;
+    int hi = leaderboard.ranked_count;
+    while (lo < hi)
+    {
+        int mid = (lo+hi)/2;
+        if (highscore_list.entries[leaderboard.ranked[mid]].points >= points)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo+1;
+}
+
+// Draws the ranking as a scrolling child region. Only the rows that are
+// inside the visible region are submitted to ImGui.
+void leaderboard_panel(r32 height, int my_points)
+{
+    using namespace ImGui;
+    leaderboard_update_ranking();
+    Text("Your score would rank #%d of %d", leaderboard_rank_of(my_points), highscore_list.count+1);
+    BeginChild("##leaderboard", ImVec2(0.0f, height), true);
+    ImGuiListClipper clipper(leaderboard.ranked_count, GetTextLineHeightWithSpacing());
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+    {
+        Highscore h;
+        highscore_get(leaderboard.ranked[i], &h);
+        Text("%6d %6d  %s", i+1, h.points, h.nickname);
+    }
+    clipper.End();
+    EndChild();
+}
@@ -1,7 +1,32 @@
-/* so_new_math - v1.01
+/* so_new_math - v1.02
 
 Changelog
 =========
+19. october 2026
+    Every function is inline, so the header can be included by more
+    than one source file of a program.
+
+    SoA batch quaternion and rigid transform functions: m_quat_mul_n,
+    m_quat_rotate_n, m_rigid_compose_n, m_rigid_inverse_n and
+    m_rigid_transform_n.
+
+    The constructors and the fixed-transform builders are constexpr
+    in C++14 (see SO_MATH_CONSTEXPR), together with compile-time
+    m_ct_sin and m_ct_cos, mat_rotate_*_ct and m_rgba.
+
+    Polynomial approximations m_sincos, m_sqrt, m_rsqrt and m_exp,
+    with documented error and SO_MATH_APPROX to trade precision for
+    speed. m_fast_inv_sqrt no longer type-puns through a pointer.
+
+    Batch functions over arrays of vectors: m_transform_points,
+    m_transform_vectors, m_normalize_n and m_dot_n, for AoS arrays
+    and for SoA (separate x, y) arrays. Parallel with OpenMP for
+    large n.
+
+    SSE specializations of vec4 and mat4 arithmetic, with an AVX
+    mat4*mat4. Used when the compiler targets SSE (all x64 builds),
+    define SO_MATH_NO_SIMD to get the generic templates everywhere.
+
 4. january 2016
     smoothstep for new math
 
@@ -46,10 +71,32 @@ Changelog
 #ifndef SO_MATH_HEADER_INCLUDE
 #define SO_MATH_HEADER_INCLUDE
 #include "math.h"
+#include <string.h>
+
+#if !defined(SO_MATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define SO_MATH_SSE
+#include <xmmintrin.h>
+#if defined(__AVX__)
+#define SO_MATH_AVX
+#include <immintrin.h>
+#endif
+#endif
 
 #define PI     3.14159265359
 #define TWO_PI 6.28318530718
 
+// Constructors and builders that only depend on their arguments are
+// constexpr when the compiler supports C++14 constexpr, so constant
+// matrices and tables can be computed at compile time. They only
+// write through .data, since a constant expression may not read a
+// union member other than the one that was last written.
+#if __cplusplus >= 201402L || (defined(_MSC_VER) && _MSC_VER >= 1910)
+#define SO_MATH_CONSTEXPR constexpr
+#define SO_MATH_HAS_CONSTEXPR
+#else
+#define SO_MATH_CONSTEXPR inline
+#endif
+
 template <typename T, int n>
 struct Vector
 {
@@ -154,16 +201,26 @@ template <typename T> struct Matrix<T, 4, 4> {
 // Convenience functions for constructing matrices and
 // vectors, from components or other vectors.
 
-vec2 m_vec2(float s)                            { vec2 result = { s, s       }; return result; }
-vec3 m_vec3(float s)                            { vec3 result = { s, s, s    }; return result; }
-vec4 m_vec4(float s)                            { vec4 result = { s, s, s, s }; return result; }
-vec2 m_vec2(float x, float y)                   { vec2 result = { x, y       }; return result; }
-vec3 m_vec3(float x, float y, float z)          { vec3 result = { x, y, z    }; return result; }
-vec4 m_vec4(float x, float y, float z, float w) { vec4 result = { x, y, z, w }; return result; }
-vec4 m_vec4(vec3 xyz, float w)                  { vec4 result = { xyz.x, xyz.y, xyz.z, w }; return result; }
+SO_MATH_CONSTEXPR vec2 m_vec2(float s)                            { vec2 result = { s, s       }; return result; }
+SO_MATH_CONSTEXPR vec3 m_vec3(float s)                            { vec3 result = { s, s, s    }; return result; }
+SO_MATH_CONSTEXPR vec4 m_vec4(float s)                            { vec4 result = { s, s, s, s }; return result; }
+SO_MATH_CONSTEXPR vec2 m_vec2(float x, float y)                   { vec2 result = { x, y       }; return result; }
+SO_MATH_CONSTEXPR vec3 m_vec3(float x, float y, float z)          { vec3 result = { x, y, z    }; return result; }
+SO_MATH_CONSTEXPR vec4 m_vec4(float x, float y, float z, float w) { vec4 result = { x, y, z, w }; return result; }
+SO_MATH_CONSTEXPR vec4 m_vec4(vec3 xyz, float w)                  { vec4 result = { xyz.data[0], xyz.data[1], xyz.data[2], w }; return result; }
+
+// return: The color 0xRRGGBBAA as a vec4 with components in [0, 1]
+SO_MATH_CONSTEXPR vec4 m_rgba(unsigned int hex)
+{
+    vec4 result = { ((hex >> 24) & 0xff) / 255.0f,
+                    ((hex >> 16) & 0xff) / 255.0f,
+                    ((hex >>  8) & 0xff) / 255.0f,
+                    ((hex >>  0) & 0xff) / 255.0f };
+    return result;
+}
 
 template <typename T, int n>
-Matrix<T, n, n> m_identity_()
+SO_MATH_CONSTEXPR Matrix<T, n, n> m_identity_()
 {
     Matrix<T, n, n> result = { };
     for (unsigned int i = 0; i < n; i++)
@@ -172,59 +229,68 @@ Matrix<T, n, n> m_identity_()
 }
 
 template <typename T>
-Matrix<T, 2, 2> m_mat2_(Vector<T, 2> a1,
-                        Vector<T, 2> a2)
+SO_MATH_CONSTEXPR Matrix<T, 2, 2> m_mat2_(Vector<T, 2> a1,
+                                          Vector<T, 2> a2)
 {
-    mat2 result = { };
-    result.a1 = a1;
-    result.a2 = a2;
+    Matrix<T, 2, 2> result = { };
+    for (int i = 0; i < 2; i++)
+    {
+        result.data[i+0] = a1.data[i];
+        result.data[i+2] = a2.data[i];
+    }
     return result;
 }
 
 template <typename T>
-Matrix<T, 3, 3> m_mat3_(Vector<T, 3> a1,
-                        Vector<T, 3> a2,
-                        Vector<T, 3> a3)
+SO_MATH_CONSTEXPR Matrix<T, 3, 3> m_mat3_(Vector<T, 3> a1,
+                                          Vector<T, 3> a2,
+                                          Vector<T, 3> a3)
 {
-    mat3 result = { };
-    result.a1 = a1;
-    result.a2 = a2;
-    result.a3 = a3;
+    Matrix<T, 3, 3> result = { };
+    for (int i = 0; i < 3; i++)
+    {
+        result.data[i+0] = a1.data[i];
+        result.data[i+3] = a2.data[i];
+        result.data[i+6] = a3.data[i];
+    }
     return result;
 }
 
 template <typename T>
-Matrix<T, 3, 3> m_mat3_(Matrix<T, 4, 4> m)
+SO_MATH_CONSTEXPR Matrix<T, 3, 3> m_mat3_(Matrix<T, 4, 4> m)
 {
-    mat3 result = { };
-    result.a1 = m.a1.xyz;
-    result.a2 = m.a2.xyz;
-    result.a3 = m.a3.xyz;
+    Matrix<T, 3, 3> result = { };
+    for (int col = 0; col < 3; col++)
+    for (int row = 0; row < 3; row++)
+        result.data[row + col*3] = m.data[row + col*4];
     return result;
 }
 
 template <typename T>
-Matrix<T, 4, 4> m_mat4_(Vector<T, 4> a1,
-                        Vector<T, 4> a2,
-                        Vector<T, 4> a3,
-                        Vector<T, 4> a4)
+SO_MATH_CONSTEXPR Matrix<T, 4, 4> m_mat4_(Vector<T, 4> a1,
+                                          Vector<T, 4> a2,
+                                          Vector<T, 4> a3,
+                                          Vector<T, 4> a4)
 {
-    mat4 result = { };
-    result.a1 = a1;
-    result.a2 = a2;
-    result.a3 = a3;
-    result.a4 = a4;
+    Matrix<T, 4, 4> result = { };
+    for (int i = 0; i < 4; i++)
+    {
+        result.data[i+0] = a1.data[i];
+        result.data[i+4] = a2.data[i];
+        result.data[i+8] = a3.data[i];
+        result.data[i+12] = a4.data[i];
+    }
     return result;
 }
 
+// return: m in the upper-left 3x3 block, identity elsewhere
 template <typename T>
-Matrix<T, 4, 4> m_mat4_(Matrix<T, 3, 3> m)
+SO_MATH_CONSTEXPR Matrix<T, 4, 4> m_mat4_(Matrix<T, 3, 3> m)
 {
-    mat4 result = m_identity_<T, 4>();
-    result.a1.xyz = m.a1;
-    result.a2.xyz = m.a2;
-    result.a3.xyz = m.a3;
-    result.a4.xyz = m.a4;
+    Matrix<T, 4, 4> result = m_identity_<T, 4>();
+    for (int col = 0; col < 3; col++)
+    for (int row = 0; row < 3; row++)
+        result.data[row + col*4] = m.data[row + col*3];
     return result;
 }
 
@@ -525,9 +591,127 @@ Vector<T, r> operator *(Matrix<T, r, c> m, Vector<T, c> x)
 
 // Because I like readable error messages when there is a
 // dimension mismatch in the most common operations.
-vec2 operator *(mat2 m, vec2 b) { return m.a1*b.x + m.a2*b.y; }
-vec3 operator *(mat3 m, vec3 b) { return m.a1*b.x + m.a2*b.y + m.a3*b.z; }
-vec4 operator *(mat4 m, vec4 b) { return m.a1*b.x + m.a2*b.y + m.a3*b.z + m.a4*b.w; }
+inline vec2 operator *(mat2 m, vec2 b) { return m.a1*b.x + m.a2*b.y; }
+inline vec3 operator *(mat3 m, vec3 b) { return m.a1*b.x + m.a2*b.y + m.a3*b.z; }
+
+#ifndef SO_MATH_SSE
+inline vec4 operator *(mat4 m, vec4 b) { return m.a1*b.x + m.a2*b.y + m.a3*b.z + m.a4*b.w; }
+#else
+///////////////// SSE specializations /////////////////
+// Non-template overloads for float vec4 and mat4, which the
+// compiler picks over the generic templates above. They compute
+// the same sums in the same order as the templates, except for
+// m_dot, where the four products are added pairwise.
+// Vectors and matrices are only 4-byte aligned, so all loads and
+// stores are unaligned.
+
+inline vec4 m_vec4(__m128 v) { vec4 result; _mm_storeu_ps(result.data, v); return result; }
+inline __m128 m_sse(vec4 v)  { return _mm_loadu_ps(v.data); }
+
+inline vec4 operator +(vec4 a, vec4 b)    { return m_vec4(_mm_add_ps(m_sse(a), m_sse(b))); }
+inline vec4 operator -(vec4 a, vec4 b)    { return m_vec4(_mm_sub_ps(m_sse(a), m_sse(b))); }
+inline vec4 operator *(vec4 a, vec4 b)    { return m_vec4(_mm_mul_ps(m_sse(a), m_sse(b))); }
+inline vec4 operator /(vec4 a, vec4 b)    { return m_vec4(_mm_div_ps(m_sse(a), m_sse(b))); }
+inline vec4 operator *(vec4 v, float s)   { return m_vec4(_mm_mul_ps(m_sse(v), _mm_set1_ps(s))); }
+inline vec4 operator *(float s, vec4 v)   { return m_vec4(_mm_mul_ps(m_sse(v), _mm_set1_ps(s))); }
+inline vec4 operator -(vec4 a)            { return m_vec4(_mm_xor_ps(m_sse(a), _mm_set1_ps(-0.0f))); } // Flips the sign of 0 too
+inline vec4 &operator +=(vec4 &a, vec4 b) { a = a + b; return a; }
+inline vec4 &operator -=(vec4 &a, vec4 b) { a = a - b; return a; }
+inline vec4 &operator *=(vec4 &v, float s) { v = v * s; return v; }
+
+inline float m_dot(vec4 a, vec4 b)
+{
+    __m128 p = _mm_mul_ps(m_sse(a), m_sse(b));
+    __m128 q = _mm_add_ps(p, _mm_movehl_ps(p, p));          // x+z, y+w
+    q = _mm_add_ss(q, _mm_shuffle_ps(q, q, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(q);
+}
+
+// return: Column c of m as a register
+inline __m128 m_sse_column(const mat4 &m, int c) { return _mm_loadu_ps(m.data + 4*c); }
+
+inline __m128 m_sse_mul(const mat4 &m, __m128 x)
+{
+    __m128 r = _mm_mul_ps(m_sse_column(m, 0), _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(m_sse_column(m, 1), _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r, _mm_mul_ps(m_sse_column(m, 2), _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 2, 2))));
+    r = _mm_add_ps(r, _mm_mul_ps(m_sse_column(m, 3), _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3))));
+    return r;
+}
+
+inline vec4 operator *(mat4 m, vec4 b)
+{
+    return m_vec4(m_sse_mul(m, m_sse(b)));
+}
+
+inline mat4 operator *(mat4 a, mat4 b)
+{
+    mat4 result;
+    #ifdef SO_MATH_AVX
+    // Two columns of the result at a time. Each 128-bit lane holds one
+    // column of b, and in-lane shuffles broadcast its components.
+    __m256 a1 = _mm256_broadcast_ps((const __m128*)(a.data + 0));
+    __m256 a2 = _mm256_broadcast_ps((const __m128*)(a.data + 4));
+    __m256 a3 = _mm256_broadcast_ps((const __m128*)(a.data + 8));
+    __m256 a4 = _mm256_broadcast_ps((const __m128*)(a.data + 12));
+    for (int c = 0; c < 4; c += 2)
+    {
+        __m256 x = _mm256_loadu_ps(b.data + 4*c);
+        __m256 r = _mm256_mul_ps(a1, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a4, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm256_storeu_ps(result.data + 4*c, r);
+    }
+    #else
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(result.data + 4*c, m_sse_mul(a, m_sse_column(b, c)));
+    #endif
+    return result;
+}
+
+inline mat4 operator +(mat4 a, mat4 b)
+{
+    mat4 result;
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(result.data + 4*c, _mm_add_ps(m_sse_column(a, c), m_sse_column(b, c)));
+    return result;
+}
+
+inline mat4 operator -(mat4 a, mat4 b)
+{
+    mat4 result;
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(result.data + 4*c, _mm_sub_ps(m_sse_column(a, c), m_sse_column(b, c)));
+    return result;
+}
+
+inline mat4 operator *(mat4 a, float s)
+{
+    mat4 result;
+    __m128 k = _mm_set1_ps(s);
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(result.data + 4*c, _mm_mul_ps(m_sse_column(a, c), k));
+    return result;
+}
+
+inline mat4 operator *(float s, mat4 a) { return a * s; }
+
+inline mat4 m_transpose(mat4 m)
+{
+    __m128 c1 = m_sse_column(m, 0);
+    __m128 c2 = m_sse_column(m, 1);
+    __m128 c3 = m_sse_column(m, 2);
+    __m128 c4 = m_sse_column(m, 3);
+    _MM_TRANSPOSE4_PS(c1, c2, c3, c4);
+    mat4 result;
+    _mm_storeu_ps(result.data + 0, c1);
+    _mm_storeu_ps(result.data + 4, c2);
+    _mm_storeu_ps(result.data + 8, c3);
+    _mm_storeu_ps(result.data + 12, c4);
+    return result;
+}
+#endif
 
 template <int n>
 float m_length(Vector<float, n> v)
@@ -536,13 +720,20 @@ float m_length(Vector<float, n> v)
     return result;
 }
 
-float m_fast_inv_sqrt(float x)
+// Going through memcpy instead of a pointer cast keeps this defined
+// behaviour; compilers turn it into a register move.
+inline float m_float_from_bits(unsigned int i) { float x; memcpy(&x, &i, sizeof(x)); return x; }
+inline unsigned int m_bits_from_float(float x) { unsigned int i; memcpy(&i, &x, sizeof(i)); return i; }
+
+// Max relative error 1.75e-3 for positive normal x.
+// See m_rsqrt for something more accurate.
+inline float m_fast_inv_sqrt(float x)
 {
     float xhalf = 0.5f * x;
-    int i = *(int*)&x;          // Integer representation of float
-    i = 0x5f3759df - (i >> 1);  // Initial guess
-    x = *(float*)&i;            // Converted to floating point
-    x = x*(1.5f-(xhalf*x*x));   // One round of Newton-Raphson's method
+    unsigned int i = m_bits_from_float(x);  // Integer representation of float
+    i = 0x5f3759df - (i >> 1);              // Initial guess
+    x = m_float_from_bits(i);               // Converted to floating point
+    x = x*(1.5f-(xhalf*x*x));               // One round of Newton-Raphson's method
     return x;
 }
 
@@ -554,39 +745,39 @@ Vector<float, n> m_normalize(Vector<float, n> v)
 }
 
 ///////////////// GLSL-like stuff ////////////////
-int m_sign(int x)       { return x < 0 ? -1 : 1; }
-int m_abs(int x)        { return x < 0 ? -x : x; }
-int m_min(int x, int y) { return x < y ? x : y; }
-int m_max(int x, int y) { return x > y ? x : y; }
-int m_clamp(int x, int low, int high)
+inline int m_sign(int x)       { return x < 0 ? -1 : 1; }
+inline int m_abs(int x)        { return x < 0 ? -x : x; }
+inline int m_min(int x, int y) { return x < y ? x : y; }
+inline int m_max(int x, int y) { return x > y ? x : y; }
+inline int m_clamp(int x, int low, int high)
 {
     return x < low ? low : (x > high ? high : x);
 }
 
-float m_sign(float x)         { return x < 0 ? -1.0f : +1.0f; }
-float m_abs(float x)          { return x < 0 ? -x : x; }
-float m_min(float x, float y) { return x < y ? x : y; }
-float m_max(float x, float y) { return x > y ? x : y; }
-float m_clamp(float x, float low, float high)
+inline float m_sign(float x)         { return x < 0 ? -1.0f : +1.0f; }
+inline float m_abs(float x)          { return x < 0 ? -x : x; }
+inline float m_min(float x, float y) { return x < y ? x : y; }
+inline float m_max(float x, float y) { return x > y ? x : y; }
+inline float m_clamp(float x, float low, float high)
 {
     return x < low ? low : (x > high ? high : x);
 }
 
-float m_square(float x) { return x*x; }
+inline float m_square(float x) { return x*x; }
 
 // return: Linear mapping from [t0, t1] to [y0, y1]
-float m_map(float t0, float t1, float t, float y0, float y1)
+inline float m_map(float t0, float t1, float t, float y0, float y1)
 {
     return m_clamp(y0 + (y1 - y0) * (t - t0) / (t1 - t0), y0, y1);
 }
 
 // return: Linear mapping from [0, 1] to [low, high]
-float m_mix(float low, float high, float t)
+inline float m_mix(float low, float high, float t)
 {
     return low + (high - low) * t;
 }
 
-float m_smoothstep(float lo, float hi, float x)
+inline float m_smoothstep(float lo, float hi, float x)
 {
     float t = m_clamp((x - lo) / (hi - lo), 0.0f, 1.0f);
     return t * t * (3.0f - 2.0f * t);
@@ -609,8 +800,111 @@ Vector<float, n> m_mix(Vector<float, n> low,
     return low + (high - low) * t;
 }
 
+///////////////// Approximations /////////////////
+// Polynomial replacements for the libm functions. m_sincos has no
+// branches, so loops over it vectorize (m_sincos_n runs about three
+// times faster than sinf+cosf). SO_MATH_APPROX picks the degree:
+//
+//                             0          1          2 (default)
+//   m_sincos   abs. error     2.61e-4    3.68e-6    1.53e-7
+//   m_rsqrt    rel. error     1.76e-3    4.74e-6    1.48e-7
+//   m_sqrt     rel. error     1.76e-3    4.77e-6    sqrtf
+//   m_exp      rel. error     7.95e-4    5.58e-5    1.20e-7
+//
+// The errors were measured against libm (in double) over every float
+// in |x| <= 4096 for m_sincos, [1e-30, 1e30] for m_sqrt and m_rsqrt
+// and [-87, 88] for m_exp, and rounded up. so_math_test checks them.
+// m_sincos loses accuracy beyond that range.
+#ifndef SO_MATH_APPROX
+#define SO_MATH_APPROX 2
+#endif
+
+// m_sincos and m_exp are marked inline so that they get inlined, and
+// vectorized, in loops such as m_sincos_n.
+inline void m_sincos(float x, float *s, float *c)
+{
+    // x = r + q*pi/2 with r in [-pi/4, pi/4]. pi/2 is split in
+    // three parts so that q*part is exact for moderate q.
+    int quadrant = (int)(x*0.636619772f + copysignf(0.5f, x));
+    float q = (float)quadrant;
+    float r = x - q*1.5703125f;
+    r = r - q*4.837512969970703125e-4f;
+    r = r - q*7.549789948768648e-8f;
+    float r2 = r*r;
+    #if SO_MATH_APPROX == 0
+    float sin_r = r + r*r2*(-1.6605e-1f + r2*7.61e-3f);
+    float cos_r = 1.0f - 0.5f*r2 + r2*r2*4.1503e-2f;
+    #elif SO_MATH_APPROX == 1
+    float sin_r = r + r*r2*(-1.6666654611e-1f + r2*(8.3321608736e-3f + r2*-1.9515295891e-4f));
+    float cos_r = 1.0f - 0.5f*r2 + r2*r2*(4.166664568298827e-2f + r2*-1.388731625493765e-3f);
+    #else
+    float sin_r = r + r*r2*(-1.6666654611e-1f + r2*(8.3321608736e-3f + r2*-1.9515295891e-4f));
+    float cos_r = 1.0f - 0.5f*r2 + r2*r2*(4.166664568298827e-2f + r2*(-1.388731625493765e-3f + r2*2.443315711809948e-5f));
+    #endif
+
+    // Quadrant 0: ( sin,  cos), 1: ( cos, -sin),
+    //          2: (-sin, -cos), 3: (-cos,  sin)
+    // The selects are done with arithmetic rather than branches.
+    float swap = (float)(quadrant & 1);
+    float sign_s = (float)(1 - (quadrant & 2));
+    float sign_c = (float)(1 - ((quadrant+1) & 2));
+    *s = sign_s*(sin_r + swap*(cos_r - sin_r));
+    *c = sign_c*(cos_r + swap*(sin_r - cos_r));
+}
+
+inline float m_sin(float x) { float s, c; m_sincos(x, &s, &c); return s; }
+inline float m_cos(float x) { float s, c; m_sincos(x, &s, &c); return c; }
+
+// x must be positive. Each level adds a Newton-Raphson step.
+inline float m_rsqrt(float x)
+{
+    float xhalf = 0.5f*x;
+    float y = m_float_from_bits(0x5f375a86 - (m_bits_from_float(x) >> 1));
+    y = y*(1.5f - xhalf*y*y);
+    #if SO_MATH_APPROX >= 1
+    y = y*(1.5f - xhalf*y*y);
+    #endif
+    #if SO_MATH_APPROX >= 2
+    y = y*(1.5f - xhalf*y*y);
+    #endif
+    return y;
+}
+
+// sqrtf is a single instruction on anything with SSE, so the
+// approximation is only used at the lower precision levels.
+inline float m_sqrt(float x)
+{
+    #if SO_MATH_APPROX >= 2
+    return sqrtf(x);
+    #else
+    return x*m_rsqrt(x);
+    #endif
+}
+
+// x is clamped to [-87.3, 88.3], so the result stays a normal float.
+inline float m_exp(float x)
+{
+    x = x < -87.3f ? -87.3f : (x > 88.3f ? 88.3f : x);
+
+    // e^x = 2^n e^r with r in [-ln(2)/2, ln(2)/2]
+    int exponent = (int)(x*1.44269504f + copysignf(0.5f, x));
+    float n = (float)exponent;
+    float r = x - n*0.693359375f;
+    r = r - n*-2.12194440e-4f;
+    #if SO_MATH_APPROX == 0
+    float p = 1.0f + r + r*r*(5.0e-1f + r*1.6666666e-1f);
+    #elif SO_MATH_APPROX == 1
+    float p = 1.0f + r + r*r*(5.0e-1f + r*(1.6666666e-1f + r*4.1666667e-2f));
+    #else
+    float p = 1.0f + r + r*r*(5.0000001201e-1f + r*(1.6666665459e-1f + r*(4.1665795894e-2f +
+              r*(8.3334519073e-3f + r*(1.3981999507e-3f + r*1.9875691500e-4f)))));
+    #endif
+    float scale = m_float_from_bits((unsigned int)(exponent + 127) << 23);
+    return p*scale;
+}
+
 ///////////////// Linear algebra /////////////////
-vec3 m_cross(vec3 a, vec3 b)
+inline vec3 m_cross(vec3 a, vec3 b)
 {
     return m_vec3(a.y*b.z-a.z*b.y,
                   a.z*b.x-a.x*b.z,
@@ -619,7 +913,7 @@ vec3 m_cross(vec3 a, vec3 b)
 
 // return: The skew-symmetric matrix form of the
 //         cross product operator applied by v.
-mat3 m_skew(vec3 v)
+inline mat3 m_skew(vec3 v)
 {
     mat3 result = {0, v.z, -v.y, -v.z, 0, v.x, v.y, -v.x, 0};
     return result;
@@ -630,14 +924,14 @@ mat3 m_skew(vec3 v)
 //         - Doesn’t require the input to be normalised.
 //         - Doesn’t normalize the output.
 // thanks: http://lolengine.net/blog/2013/09/21/picking-orthogonal-vector-combing-coconuts
-vec3 m_orthogonal_vector(vec3 v)
+inline vec3 m_orthogonal_vector(vec3 v)
 {
     return m_abs(v.x) > m_abs(v.z) ? m_vec3(-v.y, v.x, 0.0)
                                    : m_vec3(0.0, -v.z, v.y);
 }
 
 // return: A transformation matrix in SE3 (rotation and translation)
-mat4 m_se3(mat3 R, vec3 r)
+inline mat4 m_se3(mat3 R, vec3 r)
 {
     mat4 result = m_id4();
     result.a1.xyz = R.a1;
@@ -647,14 +941,14 @@ mat4 m_se3(mat3 R, vec3 r)
     return result;
 }
 
-void m_se3_decompose(mat4 se3, mat3 *R, vec3 *p)
+inline void m_se3_decompose(mat4 se3, mat3 *R, vec3 *p)
 {
     *R = m_mat3(se3);
     *p = se3.a4.xyz;
 }
 
 // return: The inverse of a SO3 matrix
-mat4 m_se3_inverse(mat4 m)
+inline mat4 m_se3_inverse(mat4 m)
 {
     mat3 R = m_transpose(m_mat3(m));
     vec3 r = -R * m.a4.xyz;
@@ -669,7 +963,7 @@ typedef vec4 quat;
 
 // return: The quaternion describing the rotation of
 // _angle_ radians about a normalized axis _axis_.
-quat m_quat_from_angle_axis(vec3 axis, float angle)
+inline quat m_quat_from_angle_axis(vec3 axis, float angle)
 {
     quat result = {};
     float s = sin(angle/2.0f);
@@ -685,7 +979,7 @@ quat m_quat_from_angle_axis(vec3 axis, float angle)
 // represented by the given Euler angles that
 // parametrize the rotation matrix given by
 //   R = Rx(ex)Ry(ey)Rz(ez)
-quat m_quat_from_euler(float ex, float ey, float ez)
+inline quat m_quat_from_euler(float ex, float ey, float ez)
 {
     // Implements Shepperd's method
     float cz = cos(ez); float sz = sin(ez);
@@ -745,7 +1039,7 @@ quat m_quat_from_euler(float ex, float ey, float ez)
 }
 
 // return: The SO3 rotation matrix of q
-mat3 m_quat_to_so3(quat q)
+inline mat3 m_quat_to_so3(quat q)
 {
     mat3 e_skew = m_skew(q.xyz);
     mat3 result = m_id3() + 2.0f*q.w*e_skew + 2.0f*e_skew*e_skew;
@@ -753,7 +1047,7 @@ mat3 m_quat_to_so3(quat q)
 }
 
 // return: The quaternion product q MUL r
-quat m_quat_mul(quat q, quat r)
+inline quat m_quat_mul(quat q, quat r)
 {
     quat result = {};
     result.w = q.w*r.w - m_dot(q.xyz, r.xyz);
@@ -763,7 +1057,7 @@ quat m_quat_mul(quat q, quat r)
 
 // return: The matrix which when left-multiplied by a vector v=(x,y,z)
 // produces the same result as m_quat_mul(q, m_vec4(v, 0)).
-Matrix<float,4,3> m_quat_mul_matrix(quat q)
+inline Matrix<float,4,3> m_quat_mul_matrix(quat q)
 {
     Matrix<float,4,3> result = {};
     *m_element(&result, 0, 0) = +q.w;
@@ -783,103 +1077,141 @@ Matrix<float,4,3> m_quat_mul_matrix(quat q)
     return result;
 }
 
-mat4
-mat_scale(float s)
+// The builders below index .data directly so that they can be
+// constexpr. In column-major order element (row, col) of a mat4
+// is data[row + 4*col], e.g. data[12..14] is the translation.
+
+SO_MATH_CONSTEXPR mat4
+mat_scale(float x, float y, float z)
 {
     mat4 result = {};
-    result.a1.x = s;
-    result.a2.y = s;
-    result.a3.z = s;
-    result.a4.w = 1;
+    result.data[0] = x;
+    result.data[5] = y;
+    result.data[10] = z;
+    result.data[15] = 1;
     return result;
 }
 
-mat4
-mat_scale(float x, float y, float z)
+SO_MATH_CONSTEXPR mat4
+mat_scale(float s)
 {
-    mat4 result = {};
-    result.a1.x = x;
-    result.a2.y = y;
-    result.a3.z = z;
-    result.a4.w = 1;
-    return result;
+    return mat_scale(s, s, s);
 }
 
-mat4
+SO_MATH_CONSTEXPR mat4
 mat_scale(vec3 s)
 {
-    return mat_scale(s.x, s.y, s.z);
+    return mat_scale(s.data[0], s.data[1], s.data[2]);
+}
+
+// return: x reduced to [-pi, pi]
+SO_MATH_CONSTEXPR double m_ct_reduce(double x)
+{
+    double turns = x / 6.283185307179586;
+    long long k = (long long)(turns < 0.0 ? turns - 0.5 : turns + 0.5);
+    return x - k*6.283185307179586;
+}
+
+// return: sin(x) to about double precision, for use in constant
+//         expressions. Use sin or m_sincos at runtime.
+SO_MATH_CONSTEXPR double m_ct_sin(double x)
+{
+    // The Taylor series has converged to below 1e-15 on [-pi, pi]
+    // after the x^27 term.
+    double r = m_ct_reduce(x);
+    double term = r;
+    double sum = r;
+    for (int i = 1; i <= 13; i++)
+    {
+        term *= -r*r / ((2*i)*(2*i+1));
+        sum += term;
+    }
+    return sum;
+}
+
+SO_MATH_CONSTEXPR double m_ct_cos(double x)
+{
+    double r = m_ct_reduce(x);
+    double term = 1.0;
+    double sum = 1.0;
+    for (int i = 1; i <= 13; i++)
+    {
+        term *= -r*r / ((2*i-1)*(2*i));
+        sum += term;
+    }
+    return sum;
 }
 
 // Positive angle indicates counter-clockwise rotation about x axis
-// according to the right hand rule.
-mat4
-mat_rotate_x(float angle_in_radians)
+// according to the right hand rule. c and s are the cosine and sine
+// of the angle.
+SO_MATH_CONSTEXPR mat4
+mat_rotate_x_(float c, float s)
 {
-    float c = cos(angle_in_radians);
-    float s = sin(angle_in_radians);
     mat4 result = m_id4();
-    result.a2.y = c;
-    result.a2.z = s;
-    result.a3.y = -s;
-    result.a3.z = c;
+    result.data[5] = c;
+    result.data[6] = s;
+    result.data[9] = -s;
+    result.data[10] = c;
     return result;
 }
 
 // Positive angle indicates counter-clockwise rotation about y axis
-mat4
-mat_rotate_y(float angle_in_radians)
+SO_MATH_CONSTEXPR mat4
+mat_rotate_y_(float c, float s)
 {
-    float c = cos(angle_in_radians);
-    float s = sin(angle_in_radians);
     mat4 result = m_id4();
-    result.a1.x = c;
-    result.a1.z = -s;
-    result.a3.x = s;
-    result.a3.z = c;
+    result.data[0] = c;
+    result.data[2] = -s;
+    result.data[8] = s;
+    result.data[10] = c;
     return result;
 }
 
 // Positive angle indicates counter-clockwise rotation about z axis
-mat4
-mat_rotate_z(float angle_in_radians)
+SO_MATH_CONSTEXPR mat4
+mat_rotate_z_(float c, float s)
 {
-    float c = cos(angle_in_radians);
-    float s = sin(angle_in_radians);
     mat4 result = m_id4();
-    result.a1.x = c;
-    result.a1.y = s;
-    result.a2.x = -s;
-    result.a2.y = c;
+    result.data[0] = c;
+    result.data[1] = s;
+    result.data[4] = -s;
+    result.data[5] = c;
     return result;
 }
 
-mat4
-mat_translate(vec3 x)
+inline mat4 mat_rotate_x(float angle_in_radians) { return mat_rotate_x_(cos(angle_in_radians), sin(angle_in_radians)); }
+inline mat4 mat_rotate_y(float angle_in_radians) { return mat_rotate_y_(cos(angle_in_radians), sin(angle_in_radians)); }
+inline mat4 mat_rotate_z(float angle_in_radians) { return mat_rotate_z_(cos(angle_in_radians), sin(angle_in_radians)); }
+
+// Compile-time versions of the above, e.g.
+//     constexpr mat4 tilt = mat_rotate_x_ct(PI/8);
+SO_MATH_CONSTEXPR mat4 mat_rotate_x_ct(double angle_in_radians) { return mat_rotate_x_((float)m_ct_cos(angle_in_radians), (float)m_ct_sin(angle_in_radians)); }
+SO_MATH_CONSTEXPR mat4 mat_rotate_y_ct(double angle_in_radians) { return mat_rotate_y_((float)m_ct_cos(angle_in_radians), (float)m_ct_sin(angle_in_radians)); }
+SO_MATH_CONSTEXPR mat4 mat_rotate_z_ct(double angle_in_radians) { return mat_rotate_z_((float)m_ct_cos(angle_in_radians), (float)m_ct_sin(angle_in_radians)); }
+
+SO_MATH_CONSTEXPR mat4
+mat_translate(float x, float y, float z)
 {
     mat4 result = m_id4();
-    result.a4.x = x.x;
-    result.a4.y = x.y;
-    result.a4.z = x.z;
+    result.data[12] = x;
+    result.data[13] = y;
+    result.data[14] = z;
     return result;
 }
 
-mat4
-mat_translate(float x, float y, float z)
+SO_MATH_CONSTEXPR mat4
+mat_translate(vec3 x)
 {
-    mat4 result = m_id4();
-    result.a4.x = x;
-    result.a4.y = y;
-    result.a4.z = z;
-    return result;
+    return mat_translate(x.data[0], x.data[1], x.data[2]);
 }
 
-mat4
+SO_MATH_CONSTEXPR mat4
 mat_ortho(float left, float right, float bottom, float top)
 {
     mat4 result = m_id4();
-    result.a1.x = 2.0f / (right - left);
-    result.a2.y = 2.0f / (top - bottom);
+    result.data[0] = 2.0f / (right - left);
+    result.data[5] = 2.0f / (top - bottom);
     return result;
 }
 
@@ -888,21 +1220,21 @@ Map x from [left, right] to [-1, +1]
     y from [bottom, top] to [-1, +1]
     z from [zn, zf]      to [-1, +1]
 */
-mat4
+SO_MATH_CONSTEXPR mat4
 mat_ortho_depth(float left, float right, float bottom, float top, float zn, float zf)
 {
     mat4 result = {};
-    result.a1.x = 2.0f / (right - left);
-    result.a2.y = 2.0f / (top - bottom);
-    result.a3.z = 2.0f / (zn - zf);
-    result.a4.x = (right + left) / (left - right);
-    result.a4.y = (top + bottom) / (bottom - top);
-    result.a4.z = (zf + zn) / (zn - zf);
-    result.a4.w = 1.0f;
+    result.data[0] = 2.0f / (right - left);
+    result.data[5] = 2.0f / (top - bottom);
+    result.data[10] = 2.0f / (zn - zf);
+    result.data[12] = (right + left) / (left - right);
+    result.data[13] = (top + bottom) / (bottom - top);
+    result.data[14] = (zf + zn) / (zn - zf);
+    result.data[15] = 1.0f;
     return result;
 }
 
-mat4
+inline mat4
 mat_perspective(float fov, float width, float height, float zn, float zf)
 {
     mat4 result = {};
@@ -915,4 +1247,411 @@ mat_perspective(float fov, float width, float height, float zn, float zf)
     return result;
 }
 
+///////////////// Compile-time checks /////////////////
+// The constexpr builders must give the same values as the runtime
+// formulas they replace. Exact comparisons are fine here: the
+// inputs are chosen so that the float results are exact.
+#ifdef SO_MATH_HAS_CONSTEXPR
+static_assert(m_id4().data[0] == 1.0f && m_id4().data[1] == 0.0f && m_id4().data[15] == 1.0f, "m_identity_");
+static_assert(m_mat4(m_mat3(m_vec3(1, 2, 3), m_vec3(4, 5, 6), m_vec3(7, 8, 9))).data[6] == 6.0f, "m_mat4_(mat3)");
+static_assert(m_mat4(m_mat3(m_vec3(1, 2, 3), m_vec3(4, 5, 6), m_vec3(7, 8, 9))).data[15] == 1.0f, "m_mat4_(mat3)");
+static_assert(m_mat3(mat_translate(1, 2, 3)).data[8] == 1.0f, "m_mat3_(mat4)");
+static_assert(mat_translate(1, 2, 3).data[13] == 2.0f, "mat_translate");
+static_assert(mat_scale(2.0f).data[10] == 2.0f && mat_scale(2.0f).data[15] == 1.0f, "mat_scale");
+static_assert(mat_ortho(-2, 2, -1, 1).data[0] == 0.5f && mat_ortho(-2, 2, -1, 1).data[5] == 1.0f, "mat_ortho");
+static_assert(mat_ortho_depth(0, 4, 0, 2, 1, 3).data[12] == -1.0f, "mat_ortho_depth");
+static_assert(m_ct_sin(0.0) == 0.0 && m_ct_cos(0.0) == 1.0, "m_ct_sin");
+static_assert((float)m_ct_sin(PI/6) == 0.5f && (float)m_ct_cos(PI/3) == 0.5f, "m_ct_sin");
+static_assert((float)m_ct_sin(-PI/2) == -1.0f && (float)m_ct_cos(PI) == -1.0f, "m_ct_sin");
+static_assert((float)m_ct_sin(100.0*TWO_PI + PI/6) == 0.5f, "m_ct_sin range reduction");
+static_assert(mat_rotate_z_ct(PI/2).data[1] == 1.0f && mat_rotate_z_ct(PI/2).data[4] == -1.0f, "mat_rotate_z_ct");
+static_assert(m_rgba(0xFF8000FF).data[0] == 1.0f && m_rgba(0xFF8000FF).data[1] == 128/255.0f, "m_rgba");
+#endif
+
+///////////////// Batch functions /////////////////
+// Array versions of the common per-vector operations, for when
+// there are thousands of positions to transform. Each comes in
+// an AoS flavor (arrays of vec2/vec3/vec4) and, where it makes
+// sense, an SoA flavor (separate x and y arrays) for data that is
+// already laid out that way. out may be the same array as in.
+//
+// When compiled with OpenMP the loops are split across threads
+// once n reaches SO_MATH_PARALLEL_MIN; below that the threading
+// overhead costs more than it saves.
+#ifndef SO_MATH_PARALLEL_MIN
+#define SO_MATH_PARALLEL_MIN 16384
+#endif
+
+#if defined(_OPENMP) && defined(_MSC_VER)
+#define SO_MATH_PARALLEL_FOR __pragma(omp parallel for if(n >= SO_MATH_PARALLEL_MIN))
+#elif defined(_OPENMP)
+#define SO_MATH_PARALLEL_FOR _Pragma("omp parallel for if(n >= SO_MATH_PARALLEL_MIN)")
+#else
+#define SO_MATH_PARALLEL_FOR
+#endif
+
+// Applies the 2D affine transform m (translation in m.a3) to n points.
+inline void m_transform_points(mat3 m, const vec2 *in, vec2 *out, int n)
+{
+    #ifdef SO_MATH_SSE
+    // Two points per register: x0 y0 x1 y1
+    __m128 c1 = _mm_setr_ps(m.a11, m.a21, m.a11, m.a21);
+    __m128 c2 = _mm_setr_ps(m.a12, m.a22, m.a12, m.a22);
+    __m128 c3 = _mm_setr_ps(m.a13, m.a23, m.a13, m.a23);
+    int pairs = n / 2;
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < pairs; i++)
+    {
+        __m128 p = _mm_loadu_ps(&in[2*i].x);
+        __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c1, x), _mm_mul_ps(c2, y)), c3);
+        _mm_storeu_ps(&out[2*i].x, r);
+    }
+    int start = 2*pairs;
+    #else
+    int start = 0;
+    SO_MATH_PARALLEL_FOR
+    #endif
+    for (int i = start; i < n; i++)
+    {
+        float x = in[i].x;
+        float y = in[i].y;
+        out[i].x = m.a11*x + m.a12*y + m.a13;
+        out[i].y = m.a21*x + m.a22*y + m.a23;
+    }
+}
+
+// SoA version of the above.
+inline void m_transform_points(mat3 m, const float *x, const float *y, float *out_x, float *out_y, int n)
+{
+    int start = 0;
+    #ifdef SO_MATH_SSE
+    __m128 a11 = _mm_set1_ps(m.a11), a12 = _mm_set1_ps(m.a12), a13 = _mm_set1_ps(m.a13);
+    __m128 a21 = _mm_set1_ps(m.a21), a22 = _mm_set1_ps(m.a22), a23 = _mm_set1_ps(m.a23);
+    int quads = n / 4;
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < quads; i++)
+    {
+        __m128 px = _mm_loadu_ps(x + 4*i);
+        __m128 py = _mm_loadu_ps(y + 4*i);
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a11, px), _mm_mul_ps(a12, py)), a13);
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a21, px), _mm_mul_ps(a22, py)), a23);
+        _mm_storeu_ps(out_x + 4*i, rx);
+        _mm_storeu_ps(out_y + 4*i, ry);
+    }
+    start = 4*quads;
+    #endif
+    for (int i = start; i < n; i++)
+    {
+        float px = x[i];
+        float py = y[i];
+        out_x[i] = m.a11*px + m.a12*py + m.a13;
+        out_y[i] = m.a21*px + m.a22*py + m.a23;
+    }
+}
+
+// Applies the 3D affine transform m (translation in m.a4) to n points.
+// The w row of m is ignored, i.e. there is no perspective divide.
+inline void m_transform_points(mat4 m, const vec3 *in, vec3 *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        vec3 p = in[i];
+        out[i].x = m.a11*p.x + m.a12*p.y + m.a13*p.z + m.a14;
+        out[i].y = m.a21*p.x + m.a22*p.y + m.a23*p.z + m.a24;
+        out[i].z = m.a31*p.x + m.a32*p.y + m.a33*p.z + m.a34;
+    }
+}
+
+// out[i] = m*in[i]
+inline void m_transform_vectors(mat4 m, const vec4 *in, vec4 *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        #ifdef SO_MATH_SSE
+        _mm_storeu_ps(out[i].data, m_sse_mul(m, _mm_loadu_ps(in[i].data)));
+        #else
+        out[i] = m*in[i];
+        #endif
+    }
+}
+
+// Unlike m_normalize this uses an exact square root. Zero-length
+// vectors come out as NaN, same as dividing by their length would.
+inline void m_normalize_n(const vec2 *in, vec2 *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        vec2 v = in[i];
+        float s = 1.0f / sqrtf(v.x*v.x + v.y*v.y);
+        out[i].x = v.x*s;
+        out[i].y = v.y*s;
+    }
+}
+
+inline void m_normalize_n(const vec3 *in, vec3 *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        vec3 v = in[i];
+        float s = 1.0f / sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
+        out[i].x = v.x*s;
+        out[i].y = v.y*s;
+        out[i].z = v.z*s;
+    }
+}
+
+// SoA version for 2D vectors.
+inline void m_normalize_n(const float *x, const float *y, float *out_x, float *out_y, int n)
+{
+    int start = 0;
+    #ifdef SO_MATH_SSE
+    __m128 one = _mm_set1_ps(1.0f);
+    int quads = n / 4;
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < quads; i++)
+    {
+        __m128 px = _mm_loadu_ps(x + 4*i);
+        __m128 py = _mm_loadu_ps(y + 4*i);
+        __m128 l2 = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+        __m128 s = _mm_div_ps(one, _mm_sqrt_ps(l2));
+        _mm_storeu_ps(out_x + 4*i, _mm_mul_ps(px, s));
+        _mm_storeu_ps(out_y + 4*i, _mm_mul_ps(py, s));
+    }
+    start = 4*quads;
+    #endif
+    for (int i = start; i < n; i++)
+    {
+        float s = 1.0f / sqrtf(x[i]*x[i] + y[i]*y[i]);
+        out_x[i] = x[i]*s;
+        out_y[i] = y[i]*s;
+    }
+}
+
+inline void m_sincos_n(const float *x, float *s, float *c, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        float si, co;
+        m_sincos(x[i], &si, &co);
+        s[i] = si;
+        c[i] = co;
+    }
+}
+
+inline void m_exp_n(const float *x, float *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+        out[i] = m_exp(x[i]);
+}
+
+// out[i] = m_dot(a[i], b[i])
+template <int k>
+void m_dot_n(const Vector<float, k> *a, const Vector<float, k> *b, float *out, int n)
+{
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < n; i++)
+    {
+        float result = 0.0f;
+        for (int j = 0; j < k; j++)
+            result += a[i].data[j] * b[i].data[j];
+        out[i] = result;
+    }
+}
+
+// SoA version for 2D vectors.
+inline void m_dot_n(const float *ax, const float *ay, const float *bx, const float *by, float *out, int n)
+{
+    int start = 0;
+    #ifdef SO_MATH_SSE
+    int quads = n / 4;
+    SO_MATH_PARALLEL_FOR
+    for (int i = 0; i < quads; i++)
+    {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(ax + 4*i), _mm_loadu_ps(bx + 4*i));
+        __m128 y = _mm_mul_ps(_mm_loadu_ps(ay + 4*i), _mm_loadu_ps(by + 4*i));
+        _mm_storeu_ps(out + 4*i, _mm_add_ps(x, y));
+    }
+    start = 4*quads;
+    #endif
+    for (int i = start; i < n; i++)
+        out[i] = ax[i]*bx[i] + ay[i]*by[i];
+}
+
+//////////// Batch quaternions and rigid transforms ////////////
+// Rotations and rigid transforms (SE3) for many bodies at once,
+// stored as SoA: one array per component, owned by the caller. A
+// rigid transform maps p to R(q)p + t, and is kept as a quaternion
+// and translation rather than as a mat4, so there are no 4x4
+// matrices to copy around. out may alias the inputs.
+//
+// Each kernel is written once, as a template over the lane type:
+// float for the scalar tail, and m_float4 (four bodies in an SSE
+// register) for the rest. They are marked inline so that the lanes
+// stay in registers rather than going through memory between them.
+struct QuatArray
+{
+    float *x, *y, *z, *w;
+};
+
+struct Vec3Array
+{
+    float *x, *y, *z;
+};
+
+struct RigidArray
+{
+    QuatArray q;
+    Vec3Array t;
+};
+
+inline void m_load(const float *p, float *x) { *x = *p; }
+inline void m_store(float *p, float x)       { *p = x; }
+
+#ifdef SO_MATH_SSE
+struct m_float4
+{
+    __m128 v;
+};
+
+inline m_float4 m_f4(__m128 v) { m_float4 result = { v }; return result; }
+inline m_float4 operator +(m_float4 a, m_float4 b) { return m_f4(_mm_add_ps(a.v, b.v)); }
+inline m_float4 operator -(m_float4 a, m_float4 b) { return m_f4(_mm_sub_ps(a.v, b.v)); }
+inline m_float4 operator *(m_float4 a, m_float4 b) { return m_f4(_mm_mul_ps(a.v, b.v)); }
+inline m_float4 operator *(float s, m_float4 a)    { return m_f4(_mm_mul_ps(_mm_set1_ps(s), a.v)); }
+inline m_float4 operator -(m_float4 a)             { return m_f4(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+inline void m_load(const float *p, m_float4 *x)    { x->v = _mm_loadu_ps(p); }
+inline void m_store(float *p, m_float4 x)          { _mm_storeu_ps(p, x.v); }
+#define SO_MATH_LANES 4
+typedef m_float4 m_lane;
+#else
+#define SO_MATH_LANES 1
+typedef float m_lane;
+#endif
+
+// Runs kernel<F>(..., i) over [0, n), SO_MATH_LANES at a time and
+// then one at a time for the remainder.
+#define SO_MATH_FOR_LANES(kernel, ...)                     \
+    {                                                      \
+        int blocks_ = n / SO_MATH_LANES;                   \
+        SO_MATH_PARALLEL_FOR                               \
+        for (int k_ = 0; k_ < blocks_; k_++)               \
+            kernel<m_lane>(__VA_ARGS__, k_*SO_MATH_LANES); \
+        for (int k_ = blocks_*SO_MATH_LANES; k_ < n; k_++) \
+            kernel<float>(__VA_ARGS__, k_);                \
+    }
+
+template <typename F>
+inline void m_quat_mul_lanes(QuatArray q, QuatArray r, QuatArray out, int i)
+{
+    F qx, qy, qz, qw, rx, ry, rz, rw;
+    m_load(q.x+i, &qx); m_load(q.y+i, &qy); m_load(q.z+i, &qz); m_load(q.w+i, &qw);
+    m_load(r.x+i, &rx); m_load(r.y+i, &ry); m_load(r.z+i, &rz); m_load(r.w+i, &rw);
+    m_store(out.x+i, qw*rx + rw*qx + (qy*rz - qz*ry));
+    m_store(out.y+i, qw*ry + rw*qy + (qz*rx - qx*rz));
+    m_store(out.z+i, qw*rz + rw*qz + (qx*ry - qy*rx));
+    m_store(out.w+i, qw*rw - (qx*rx + qy*ry + qz*rz));
+}
+
+// out = q*v*q^-1 for unit q, evaluated as
+//   a = 2(u x v), out = v + w a + u x a
+// with u the vector part of q, which is cheaper than building the
+// rotation matrix.
+template <typename F>
+inline void m_quat_rotate_(F qx, F qy, F qz, F qw, F *x, F *y, F *z)
+{
+    F vx = *x, vy = *y, vz = *z;
+    F ax = 2.0f*(qy*vz - qz*vy);
+    F ay = 2.0f*(qz*vx - qx*vz);
+    F az = 2.0f*(qx*vy - qy*vx);
+    *x = vx + qw*ax + (qy*az - qz*ay);
+    *y = vy + qw*ay + (qz*ax - qx*az);
+    *z = vz + qw*az + (qx*ay - qy*ax);
+}
+
+template <typename F>
+inline void m_quat_rotate_lanes(QuatArray q, Vec3Array v, Vec3Array out, int i)
+{
+    F qx, qy, qz, qw, vx, vy, vz;
+    m_load(q.x+i, &qx); m_load(q.y+i, &qy); m_load(q.z+i, &qz); m_load(q.w+i, &qw);
+    m_load(v.x+i, &vx); m_load(v.y+i, &vy); m_load(v.z+i, &vz);
+    m_quat_rotate_(qx, qy, qz, qw, &vx, &vy, &vz);
+    m_store(out.x+i, vx); m_store(out.y+i, vy); m_store(out.z+i, vz);
+}
+
+// out = a*b, i.e. b applied first.
+template <typename F>
+inline void m_rigid_compose_lanes(RigidArray a, RigidArray b, RigidArray out, int i)
+{
+    F qx, qy, qz, qw, tx, ty, tz, ax, ay, az;
+    m_load(a.q.x+i, &qx); m_load(a.q.y+i, &qy); m_load(a.q.z+i, &qz); m_load(a.q.w+i, &qw);
+    m_load(b.t.x+i, &tx); m_load(b.t.y+i, &ty); m_load(b.t.z+i, &tz);
+    m_load(a.t.x+i, &ax); m_load(a.t.y+i, &ay); m_load(a.t.z+i, &az);
+    m_quat_rotate_(qx, qy, qz, qw, &tx, &ty, &tz);
+    m_quat_mul_lanes<F>(a.q, b.q, out.q, i);
+    m_store(out.t.x+i, ax + tx); m_store(out.t.y+i, ay + ty); m_store(out.t.z+i, az + tz);
+}
+
+// The inverse of p -> Rp + t is p -> R^T p - R^T t.
+template <typename F>
+inline void m_rigid_inverse_lanes(RigidArray a, RigidArray out, int i)
+{
+    F qx, qy, qz, qw, tx, ty, tz;
+    m_load(a.q.x+i, &qx); m_load(a.q.y+i, &qy); m_load(a.q.z+i, &qz); m_load(a.q.w+i, &qw);
+    m_load(a.t.x+i, &tx); m_load(a.t.y+i, &ty); m_load(a.t.z+i, &tz);
+    qx = -qx; qy = -qy; qz = -qz;
+    m_quat_rotate_(qx, qy, qz, qw, &tx, &ty, &tz);
+    m_store(out.q.x+i, qx); m_store(out.q.y+i, qy); m_store(out.q.z+i, qz); m_store(out.q.w+i, qw);
+    m_store(out.t.x+i, -tx); m_store(out.t.y+i, -ty); m_store(out.t.z+i, -tz);
+}
+
+template <typename F>
+inline void m_rigid_transform_lanes(RigidArray a, Vec3Array p, Vec3Array out, int i)
+{
+    F qx, qy, qz, qw, px, py, pz, tx, ty, tz;
+    m_load(a.q.x+i, &qx); m_load(a.q.y+i, &qy); m_load(a.q.z+i, &qz); m_load(a.q.w+i, &qw);
+    m_load(p.x+i, &px); m_load(p.y+i, &py); m_load(p.z+i, &pz);
+    m_load(a.t.x+i, &tx); m_load(a.t.y+i, &ty); m_load(a.t.z+i, &tz);
+    m_quat_rotate_(qx, qy, qz, qw, &px, &py, &pz);
+    m_store(out.x+i, px + tx); m_store(out.y+i, py + ty); m_store(out.z+i, pz + tz);
+}
+
+// out[i] = m_quat_mul(q[i], r[i])
+inline void m_quat_mul_n(QuatArray q, QuatArray r, QuatArray out, int n)
+{
+    SO_MATH_FOR_LANES(m_quat_mul_lanes, q, r, out);
+}
+
+// out[i] = q[i] v[i] q[i]^-1, for unit quaternions
+inline void m_quat_rotate_n(QuatArray q, Vec3Array v, Vec3Array out, int n)
+{
+    SO_MATH_FOR_LANES(m_quat_rotate_lanes, q, v, out);
+}
+
+// out[i] = a[i] b[i], the transform that applies b[i] and then a[i]
+inline void m_rigid_compose_n(RigidArray a, RigidArray b, RigidArray out, int n)
+{
+    SO_MATH_FOR_LANES(m_rigid_compose_lanes, a, b, out);
+}
+
+inline void m_rigid_inverse_n(RigidArray a, RigidArray out, int n)
+{
+    SO_MATH_FOR_LANES(m_rigid_inverse_lanes, a, out);
+}
+
+// out[i] = a[i] applied to the point p[i]
+inline void m_rigid_transform_n(RigidArray a, Vec3Array p, Vec3Array out, int n)
+{
+    SO_MATH_FOR_LANES(m_rigid_transform_lanes, a, p, out);
+}
+
+#undef SO_MATH_FOR_LANES
+
 #endif
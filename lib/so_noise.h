@@ -1,7 +1,20 @@
-/* so_noise - v0.1
+/* so_noise - v0.3
 
 Changelog
 ====================================================================
+19. october 2026
+    Smooth value and gradient noise in 1D, 2D and 3D, fBm, and
+    batch evaluation of 2D gradient noise and fBm over points and
+    grids. noise1f and noise2f are documented as returning values
+    in [-1, 1], which is what they have always done.
+
+19. october 2026
+    Counter-based random numbers (Philox4x32-10). Every value is a
+    pure function of (key, stream, index), so there is no hidden
+    state, and bulk fills give the same numbers no matter how the
+    range is split between threads. xor128 and frand are kept, but
+    are not thread-safe.
+
 26. september 2015
     Converted to so code format for code reuse purposes.
 
@@ -17,19 +30,97 @@ To create the implementation in one source file include this header:
 #ifndef SO_NOISE_HEADER_INCLUDE
 #define SO_NOISE_HEADER_INCLUDE
 
-// return: A 1D hash value in [0.0f, 1.0f]
+// return: A 1D hash value in [-1.0f, 1.0f]
 float        noise1f(int x);
 
-// return: A 2D hash value in [0.0f, 1.0f]
+// return: A 2D hash value in [-1.0f, 1.0f]
 float        noise2f(int x, int y);
 
+// Coherent noise
+// --------------------------------------------------------------------
+// Smooth functions of position that vary on a scale of one unit, all
+// returning values in [-1.0f, 1.0f]. Value noise interpolates random
+// values placed at the integer lattice; gradient (Perlin) noise
+// interpolates random slopes and is zero at the lattice points, which
+// makes it look less blocky. Both use the quintic fade 6t^5-15t^4+10t^3,
+// so they are continuous up to the second derivative.
+
+float        value_noise1f(float x);
+float        value_noise2f(float x, float y);
+float        value_noise3f(float x, float y, float z);
+float        gradient_noise1f(float x);
+float        gradient_noise2f(float x, float y);
+float        gradient_noise3f(float x, float y, float z);
+
+// return: Fractal Brownian motion: octaves layers of gradient noise,
+//         each at lacunarity times the frequency and gain times the
+//         amplitude of the previous one, normalized to [-1.0f, 1.0f].
+float        fbm1f(float x, int octaves, float lacunarity = 2.0f, float gain = 0.5f);
+float        fbm2f(float x, float y, int octaves, float lacunarity = 2.0f, float gain = 0.5f);
+float        fbm3f(float x, float y, float z, int octaves, float lacunarity = 2.0f, float gain = 0.5f);
+
+// out[i] = gradient_noise2f(x[i], y[i]), four points at a time with SSE2.
+// Gives exactly the same values as the scalar version.
+void         gradient_noise2f_n(const float *x, const float *y, float *out, int n);
+
+// out[i] = fbm2f(x[i], y[i], ...), with gradient_noise2f_n
+void         fbm2f_n(const float *x, const float *y, float *out, int n,
+                     int octaves, float lacunarity = 2.0f, float gain = 0.5f);
+
+// out[j*nx + i] = fbm2f(x0 + i*dx, y0 + j*dy, ...) for a grid of nx*ny samples
+void         fbm2f_grid(float x0, float y0, float dx, float dy, int nx, int ny,
+                        int octaves, float *out, float lacunarity = 2.0f, float gain = 0.5f);
+
 // return: A random number with a period of (2^128) - 1
 // more:   http://en.wikipedia.org/wiki/Xorshift
+// note:   Keeps its state in statics, see rng_ below instead.
 unsigned int xor128();
 
 // return: A uniformly distributed value in [0.0f, 1.0f]
 float        frand();
 
+// Counter-based random numbers
+// --------------------------------------------------------------------
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3", 2011) maps a 128-bit counter and a 64-bit key to 128
+// random bits. Here the counter holds a 64-bit stream id and a 64-bit
+// index, so each (key, stream) pair is an independent sequence of
+// 2^64 values that can be read in any order:
+//
+//     RngKey key = rng_key(seed);
+//     float u = rng_uniform(key, entity_id, frame);
+//     rng_fill_normal(key, STREAM_WIND, 0, samples, 4096);
+//
+// Filling [0, n) in one call or in any number of pieces, from any
+// number of threads, gives the same values.
+struct RngKey
+{
+    unsigned int k0, k1;
+};
+
+RngKey       rng_key(unsigned long long seed);
+
+// return: The four 32-bit outputs of Philox4x32-10 for counter c
+void         rng_philox(RngKey key, const unsigned int c[4], unsigned int out[4]);
+
+// return: Value number index of the stream, as 32 random bits
+unsigned int rng_u32(RngKey key, unsigned long long stream, unsigned long long index);
+
+// return: Value number index of the stream, uniform in [0.0f, 1.0f)
+//         with 24 bits of resolution
+float        rng_uniform(RngKey key, unsigned long long stream, unsigned long long index);
+
+// return: Value number index of the stream, normally distributed with
+//         mean 0 and variance 1. It is made from the uniform values
+//         at index and index^1 (Box-Muller), so avoid reading the same
+//         stream as both uniform and normal.
+float        rng_normal(RngKey key, unsigned long long stream, unsigned long long index);
+
+// Fills out[i] with value number first+i of the stream, for i in [0, n)
+void         rng_fill_u32(RngKey key, unsigned long long stream, unsigned long long first, unsigned int *out, int n);
+void         rng_fill_uniform(RngKey key, unsigned long long stream, unsigned long long first, float *out, int n);
+void         rng_fill_normal(RngKey key, unsigned long long stream, unsigned long long first, float *out, int n);
+
 #endif // SO_FBO_HEADER_INCLUDE
 #ifdef SO_NOISE_IMPLEMENTATION
 
@@ -73,4 +164,516 @@ float frand()
     return xor128() / float(4294967295.0f);
 }
 
+#include <math.h>
+#if !defined(SO_NOISE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SO_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define RNG_PHILOX_M0 0xD2511F53
+#define RNG_PHILOX_M1 0xCD9E8D57
+#define RNG_PHILOX_W0 0x9E3779B9
+#define RNG_PHILOX_W1 0xBB67AE85
+
+RngKey rng_key(unsigned long long seed)
+{
+    RngKey result = { (unsigned int)seed, (unsigned int)(seed >> 32) };
+    return result;
+}
+
+void rng_philox(RngKey key, const unsigned int c[4], unsigned int out[4])
+{
+    unsigned int c0 = c[0], c1 = c[1], c2 = c[2], c3 = c[3];
+    unsigned int k0 = key.k0, k1 = key.k1;
+    for (int round = 0; round < 10; round++)
+    {
+        unsigned long long p0 = (unsigned long long)RNG_PHILOX_M0 * c0;
+        unsigned long long p1 = (unsigned long long)RNG_PHILOX_M1 * c2;
+        unsigned int hi0 = (unsigned int)(p0 >> 32), lo0 = (unsigned int)p0;
+        unsigned int hi1 = (unsigned int)(p1 >> 32), lo1 = (unsigned int)p1;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += RNG_PHILOX_W0;
+        k1 += RNG_PHILOX_W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Counter layout: block index (low, high), stream (low, high).
+// Value number index is word index%4 of block index/4.
+void rng_block(RngKey key, unsigned long long stream, unsigned long long block, unsigned int out[4])
+{
+    unsigned int c[4] = { (unsigned int)block, (unsigned int)(block >> 32),
+                          (unsigned int)stream, (unsigned int)(stream >> 32) };
+    rng_philox(key, c, out);
+}
+
+unsigned int rng_u32(RngKey key, unsigned long long stream, unsigned long long index)
+{
+    unsigned int out[4];
+    rng_block(key, stream, index / 4, out);
+    return out[index % 4];
+}
+
+// The top 24 bits, so that every value is exact in a float
+float rng_to_uniform(unsigned int x)
+{
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+float rng_uniform(RngKey key, unsigned long long stream, unsigned long long index)
+{
+    return rng_to_uniform(rng_u32(key, stream, index));
+}
+
+// u1 in [0, 1) is flipped to (0, 1] so that the log is finite.
+void rng_box_muller(float u1, float u2, float *z0, float *z1)
+{
+    float r = sqrtf(-2.0f*logf(1.0f - u1));
+    float t = 6.28318530718f*u2;
+    *z0 = r*cosf(t);
+    *z1 = r*sinf(t);
+}
+
+float rng_normal(RngKey key, unsigned long long stream, unsigned long long index)
+{
+    unsigned long long even = index & ~1ull;
+    float z0, z1;
+    rng_box_muller(rng_uniform(key, stream, even), rng_uniform(key, stream, even + 1), &z0, &z1);
+    return (index & 1) ? z1 : z0;
+}
+
+#ifdef SO_NOISE_SSE2
+// return: The low and high halves of the 32x32 bit products a*m for
+//         each of the four lanes.
+void rng_mulhilo_sse2(__m128i a, __m128i m, __m128i *hi, __m128i *lo)
+{
+    __m128i p02 = _mm_mul_epu32(a, m);                                       // lanes 0, 2
+    __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(m, 32)); // lanes 1, 3
+    __m128i a01 = _mm_unpacklo_epi32(p02, p13); // lo0 lo1 hi0 hi1
+    __m128i a23 = _mm_unpackhi_epi32(p02, p13); // lo2 lo3 hi2 hi3
+    *lo = _mm_unpacklo_epi64(a01, a23);
+    *hi = _mm_unpackhi_epi64(a01, a23);
+}
+
+// Four consecutive blocks at once, with one block per lane.
+// Writes the 16 outputs in index order.
+void rng_block4_sse2(RngKey key, unsigned long long stream, unsigned long long block, unsigned int out[16])
+{
+    __m128i c0 = _mm_setr_epi32((int)block, (int)(block+1), (int)(block+2), (int)(block+3));
+    __m128i c1 = _mm_setr_epi32((int)(block >> 32), (int)((block+1) >> 32),
+                                (int)((block+2) >> 32), (int)((block+3) >> 32));
+    __m128i c2 = _mm_set1_epi32((int)stream);
+    __m128i c3 = _mm_set1_epi32((int)(stream >> 32));
+    __m128i m0 = _mm_set1_epi32((int)RNG_PHILOX_M0);
+    __m128i m1 = _mm_set1_epi32((int)RNG_PHILOX_M1);
+    unsigned int k0 = key.k0, k1 = key.k1;
+    for (int round = 0; round < 10; round++)
+    {
+        __m128i hi0, lo0, hi1, lo1;
+        rng_mulhilo_sse2(c0, m0, &hi0, &lo0);
+        rng_mulhilo_sse2(c2, m1, &hi1, &lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+        c3 = lo0;
+        k0 += RNG_PHILOX_W0;
+        k1 += RNG_PHILOX_W1;
+    }
+
+    // Transpose from word-per-register to block-per-register
+    __m128i t0 = _mm_unpacklo_epi32(c0, c1); // b0w0 b0w1 b1w0 b1w1
+    __m128i t1 = _mm_unpacklo_epi32(c2, c3); // b0w2 b0w3 b1w2 b1w3
+    __m128i t2 = _mm_unpackhi_epi32(c0, c1); // b2w0 b2w1 b3w0 b3w1
+    __m128i t3 = _mm_unpackhi_epi32(c2, c3); // b2w2 b2w3 b3w2 b3w3
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 8), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+void rng_fill_u32(RngKey key, unsigned long long stream, unsigned long long first, unsigned int *out, int n)
+{
+    int i = 0;
+    // Up to the first block boundary
+    while (i < n && (first + i) % 4 != 0)
+    {
+        out[i] = rng_u32(key, stream, first + i);
+        i++;
+    }
+    #ifdef SO_NOISE_SSE2
+    for (; i + 16 <= n; i += 16)
+        rng_block4_sse2(key, stream, (first + i) / 4, out + i);
+    #endif
+    for (; i + 4 <= n; i += 4)
+        rng_block(key, stream, (first + i) / 4, out + i);
+    for (; i < n; i++)
+        out[i] = rng_u32(key, stream, first + i);
+}
+
+void rng_fill_uniform(RngKey key, unsigned long long stream, unsigned long long first, float *out, int n)
+{
+    // Generated in chunks on the stack and converted from there
+    unsigned int bits[64];
+    for (int start = 0; start < n; start += 64)
+    {
+        int count = n - start < 64 ? n - start : 64;
+        rng_fill_u32(key, stream, first + start, bits, count);
+        int i = 0;
+        #ifdef SO_NOISE_SSE2
+        __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i x = _mm_srli_epi32(_mm_loadu_si128((__m128i*)(bits + i)), 8);
+            _mm_storeu_ps(out + start + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+        }
+        #endif
+        for (; i < count; i++)
+            out[start + i] = rng_to_uniform(bits[i]);
+    }
+}
+
+void rng_fill_normal(RngKey key, unsigned long long stream, unsigned long long first, float *out, int n)
+{
+    if (n <= 0)
+        return;
+    int i = 0;
+    if (first & 1)
+    {
+        out[0] = rng_normal(key, stream, first);
+        i = 1;
+    }
+    int pairs = (n - i) / 2;
+    rng_fill_uniform(key, stream, first + i, out + i, 2*pairs);
+    for (int p = 0; p < pairs; p++, i += 2)
+        rng_box_muller(out[i], out[i+1], &out[i], &out[i+1]);
+    if (i < n)
+        out[i] = rng_normal(key, stream, first + i);
+}
+
+// Lattice hash, see https://nullprogram.com/blog/2018/07/31/ for the
+// finalizer. Only uses operations that SSE2 has (or can emulate), so
+// that gradient_noise2f_n can match the scalar version bit for bit.
+unsigned int noise_hash(int x, int y, int z)
+{
+    unsigned int h = (unsigned int)x*0x8da6b343u ^ (unsigned int)y*0xd8163841u ^ (unsigned int)z*0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+float noise_fade(float t)
+{
+    return t*t*t*(t*(t*6.0f - 15.0f) + 10.0f);
+}
+
+float noise_lerp(float a, float b, float t)
+{
+    return a + t*(b - a);
+}
+
+// return: Byte number i of h, mapped to [-1.0f, 1.0f]
+float noise_byte(unsigned int h, int i)
+{
+    return (float)(int)((h >> (8*i)) & 0xff)*(1.0f/127.5f) - 1.0f;
+}
+
+// Gradients have components that are random bytes mapped to [-1, 1].
+// That is not uniform over directions, but it is cheap in SIMD. With
+// these gradients 1D, 2D and 3D noise are bounded by 1/2, 1 and 3/2,
+// which the gradient_noise functions scale to 1.
+float noise_grad1(unsigned int h, float x)                   { return noise_byte(h, 0)*x; }
+float noise_grad2(unsigned int h, float x, float y)          { return noise_byte(h, 0)*x + noise_byte(h, 1)*y; }
+float noise_grad3(unsigned int h, float x, float y, float z) { return noise_byte(h, 0)*x + noise_byte(h, 1)*y + noise_byte(h, 2)*z; }
+
+// return: A lattice value in [-1.0f, 1.0f]
+float noise_value(unsigned int h)
+{
+    return (float)(h >> 8)*(2.0f/16777215.0f) - 1.0f;
+}
+
+float value_noise1f(float x)
+{
+    float fx = floorf(x);
+    int ix = (int)fx;
+    float u = noise_fade(x - fx);
+    return noise_lerp(noise_value(noise_hash(ix, 0, 0)), noise_value(noise_hash(ix+1, 0, 0)), u);
+}
+
+float value_noise2f(float x, float y)
+{
+    float fx = floorf(x), fy = floorf(y);
+    int ix = (int)fx, iy = (int)fy;
+    float u = noise_fade(x - fx), v = noise_fade(y - fy);
+    float a = noise_lerp(noise_value(noise_hash(ix, iy, 0)),   noise_value(noise_hash(ix+1, iy, 0)),   u);
+    float b = noise_lerp(noise_value(noise_hash(ix, iy+1, 0)), noise_value(noise_hash(ix+1, iy+1, 0)), u);
+    return noise_lerp(a, b, v);
+}
+
+float value_noise3f(float x, float y, float z)
+{
+    float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+    int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+    float u = noise_fade(x - fx), v = noise_fade(y - fy), w = noise_fade(z - fz);
+    float r[2];
+    for (int k = 0; k < 2; k++)
+    {
+        float a = noise_lerp(noise_value(noise_hash(ix, iy, iz+k)),   noise_value(noise_hash(ix+1, iy, iz+k)),   u);
+        float b = noise_lerp(noise_value(noise_hash(ix, iy+1, iz+k)), noise_value(noise_hash(ix+1, iy+1, iz+k)), u);
+        r[k] = noise_lerp(a, b, v);
+    }
+    return noise_lerp(r[0], r[1], w);
+}
+
+float gradient_noise1f(float x)
+{
+    float fx = floorf(x);
+    int ix = (int)fx;
+    float tx = x - fx;
+    float n0 = noise_grad1(noise_hash(ix, 0, 0), tx);
+    float n1 = noise_grad1(noise_hash(ix+1, 0, 0), tx - 1.0f);
+    return 2.0f*noise_lerp(n0, n1, noise_fade(tx));
+}
+
+float gradient_noise2f(float x, float y)
+{
+    float fx = floorf(x), fy = floorf(y);
+    int ix = (int)fx, iy = (int)fy;
+    float tx = x - fx, ty = y - fy;
+    float n00 = noise_grad2(noise_hash(ix, iy, 0),     tx,        ty);
+    float n10 = noise_grad2(noise_hash(ix+1, iy, 0),   tx - 1.0f, ty);
+    float n01 = noise_grad2(noise_hash(ix, iy+1, 0),   tx,        ty - 1.0f);
+    float n11 = noise_grad2(noise_hash(ix+1, iy+1, 0), tx - 1.0f, ty - 1.0f);
+    float u = noise_fade(tx);
+    return noise_lerp(noise_lerp(n00, n10, u), noise_lerp(n01, n11, u), noise_fade(ty));
+}
+
+float gradient_noise3f(float x, float y, float z)
+{
+    float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+    int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+    float tx = x - fx, ty = y - fy, tz = z - fz;
+    float u = noise_fade(tx), v = noise_fade(ty);
+    float r[2];
+    for (int k = 0; k < 2; k++)
+    {
+        float n00 = noise_grad3(noise_hash(ix, iy, iz+k),     tx,        ty,        tz - k);
+        float n10 = noise_grad3(noise_hash(ix+1, iy, iz+k),   tx - 1.0f, ty,        tz - k);
+        float n01 = noise_grad3(noise_hash(ix, iy+1, iz+k),   tx,        ty - 1.0f, tz - k);
+        float n11 = noise_grad3(noise_hash(ix+1, iy+1, iz+k), tx - 1.0f, ty - 1.0f, tz - k);
+        r[k] = noise_lerp(noise_lerp(n00, n10, u), noise_lerp(n01, n11, u), v);
+    }
+    return (2.0f/3.0f)*noise_lerp(r[0], r[1], noise_fade(tz));
+}
+
+// Each octave is shifted by a different offset, or else they would
+// all be zero at the origin.
+#define NOISE_OCTAVE_OFFSET 19.19f
+
+float fbm1f(float x, int octaves, float lacunarity, float gain)
+{
+    float sum = 0.0f, norm = 0.0f, amplitude = 1.0f, frequency = 1.0f;
+    for (int i = 0; i < octaves; i++)
+    {
+        sum += amplitude*gradient_noise1f(x*frequency + i*NOISE_OCTAVE_OFFSET);
+        norm += amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    return sum / norm;
+}
+
+float fbm2f(float x, float y, int octaves, float lacunarity, float gain)
+{
+    float sum = 0.0f, norm = 0.0f, amplitude = 1.0f, frequency = 1.0f;
+    for (int i = 0; i < octaves; i++)
+    {
+        float offset = i*NOISE_OCTAVE_OFFSET;
+        sum += amplitude*gradient_noise2f(x*frequency + offset, y*frequency + offset);
+        norm += amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    return sum / norm;
+}
+
+float fbm3f(float x, float y, float z, int octaves, float lacunarity, float gain)
+{
+    float sum = 0.0f, norm = 0.0f, amplitude = 1.0f, frequency = 1.0f;
+    for (int i = 0; i < octaves; i++)
+    {
+        float offset = i*NOISE_OCTAVE_OFFSET;
+        sum += amplitude*gradient_noise3f(x*frequency + offset, y*frequency + offset, z*frequency + offset);
+        norm += amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    return sum / norm;
+}
+
+#ifdef SO_NOISE_SSE2
+// SSE2 has no 32-bit low multiply, so it is made from two 32x32->64 ones
+__m128i noise_mullo_sse2(__m128i a, __m128i b)
+{
+    __m128i p02 = _mm_mul_epu32(a, b);
+    __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__m128i noise_hash_sse2(__m128i x, __m128i y)
+{
+    __m128i h = _mm_xor_si128(noise_mullo_sse2(x, _mm_set1_epi32((int)0x8da6b343u)),
+                              noise_mullo_sse2(y, _mm_set1_epi32((int)0xd8163841u)));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+    h = noise_mullo_sse2(h, _mm_set1_epi32(0x7feb352d));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    return h;
+}
+
+__m128 noise_byte_sse2(__m128i h, int i)
+{
+    __m128i b = _mm_and_si128(_mm_srli_epi32(h, 8*i), _mm_set1_epi32(0xff));
+    return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), _mm_set1_ps(1.0f/127.5f)), _mm_set1_ps(1.0f));
+}
+
+__m128 noise_grad2_sse2(__m128i h, __m128 x, __m128 y)
+{
+    return _mm_add_ps(_mm_mul_ps(noise_byte_sse2(h, 0), x), _mm_mul_ps(noise_byte_sse2(h, 1), y));
+}
+
+__m128 noise_fade_sse2(__m128 t)
+{
+    __m128 a = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+    __m128 b = _mm_add_ps(_mm_mul_ps(t, a), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), b);
+}
+
+__m128 noise_lerp_sse2(__m128 a, __m128 b, __m128 t)
+{
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+// floorf for |x| < 2^31: truncate, then step down where that rounded up
+__m128i noise_floor_sse2(__m128 x, __m128 *fx)
+{
+    __m128i i = _mm_cvttps_epi32(x);
+    __m128 f = _mm_cvtepi32_ps(i);
+    __m128 up = _mm_cmpgt_ps(f, x);
+    i = _mm_add_epi32(i, _mm_castps_si128(up)); // up is -1 in the lanes to fix
+    *fx = _mm_sub_ps(f, _mm_and_ps(up, _mm_set1_ps(1.0f)));
+    return i;
+}
+#endif
+
+void gradient_noise2f_n(const float *x, const float *y, float *out, int n)
+{
+    int i = 0;
+    #ifdef SO_NOISE_SSE2
+    __m128i one = _mm_set1_epi32(1);
+    __m128 onef = _mm_set1_ps(1.0f);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 fx, fy;
+        __m128i ix = noise_floor_sse2(px, &fx);
+        __m128i iy = noise_floor_sse2(py, &fy);
+        __m128 tx = _mm_sub_ps(px, fx);
+        __m128 ty = _mm_sub_ps(py, fy);
+        __m128 tx1 = _mm_sub_ps(tx, onef);
+        __m128 ty1 = _mm_sub_ps(ty, onef);
+        __m128i ix1 = _mm_add_epi32(ix, one);
+        __m128i iy1 = _mm_add_epi32(iy, one);
+        __m128 n00 = noise_grad2_sse2(noise_hash_sse2(ix, iy), tx, ty);
+        __m128 n10 = noise_grad2_sse2(noise_hash_sse2(ix1, iy), tx1, ty);
+        __m128 n01 = noise_grad2_sse2(noise_hash_sse2(ix, iy1), tx, ty1);
+        __m128 n11 = noise_grad2_sse2(noise_hash_sse2(ix1, iy1), tx1, ty1);
+        __m128 u = noise_fade_sse2(tx);
+        __m128 r = noise_lerp_sse2(noise_lerp_sse2(n00, n10, u), noise_lerp_sse2(n01, n11, u), noise_fade_sse2(ty));
+        _mm_storeu_ps(out + i, r);
+    }
+    #endif
+    for (; i < n; i++)
+        out[i] = gradient_noise2f(x[i], y[i]);
+}
+
+void fbm2f_n(const float *x, const float *y, float *out, int n,
+             int octaves, float lacunarity, float gain)
+{
+    // In chunks that fit on the stack
+    float xs[64], ys[64], noise[64];
+    for (int start = 0; start < n; start += 64)
+    {
+        int count = n - start < 64 ? n - start : 64;
+        float *dst = out + start;
+        for (int i = 0; i < count; i++)
+            dst[i] = 0.0f;
+        float norm = 0.0f, amplitude = 1.0f, frequency = 1.0f;
+        for (int octave = 0; octave < octaves; octave++)
+        {
+            float offset = octave*NOISE_OCTAVE_OFFSET;
+            for (int i = 0; i < count; i++)
+            {
+                xs[i] = x[start + i]*frequency + offset;
+                ys[i] = y[start + i]*frequency + offset;
+            }
+            gradient_noise2f_n(xs, ys, noise, count);
+            for (int i = 0; i < count; i++)
+                dst[i] += amplitude*noise[i];
+            norm += amplitude;
+            amplitude *= gain;
+            frequency *= lacunarity;
+        }
+        for (int i = 0; i < count; i++)
+            dst[i] /= norm;
+    }
+}
+
+void fbm2f_grid(float x0, float y0, float dx, float dy, int nx, int ny,
+                int octaves, float *out, float lacunarity, float gain)
+{
+    // One row at a time, in chunks that fit on the stack
+    float xs[64], ys[64], noise[64];
+    float norm = 0.0f, amplitude = 1.0f;
+    for (int i = 0; i < octaves; i++)
+    {
+        norm += amplitude;
+        amplitude *= gain;
+    }
+    for (int row = 0; row < ny; row++)
+    {
+        float *dst = out + row*nx;
+        float y = y0 + row*dy;
+        for (int start = 0; start < nx; start += 64)
+        {
+            int count = nx - start < 64 ? nx - start : 64;
+            for (int i = 0; i < count; i++)
+                dst[start + i] = 0.0f;
+            amplitude = 1.0f;
+            float frequency = 1.0f;
+            for (int octave = 0; octave < octaves; octave++)
+            {
+                float offset = octave*NOISE_OCTAVE_OFFSET;
+                for (int i = 0; i < count; i++)
+                {
+                    xs[i] = (x0 + (start + i)*dx)*frequency + offset;
+                    ys[i] = y*frequency + offset;
+                }
+                gradient_noise2f_n(xs, ys, noise, count);
+                for (int i = 0; i < count; i++)
+                    dst[start + i] += amplitude*noise[i];
+                amplitude *= gain;
+                frequency *= lacunarity;
+            }
+            for (int i = 0; i < count; i++)
+                dst[start + i] /= norm;
+        }
+    }
+}
+
 #endif // SO_NOISE_IMPLEMENTATION
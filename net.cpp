@@ -0,0 +1,147 @@
+// Minimal blocking TCP sockets on top of winsock and BSD sockets.
+// Every call here may block, so only use them off the frame thread.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET NetSocket;
+#define NET_INVALID_SOCKET INVALID_SOCKET
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int NetSocket;
+#define NET_INVALID_SOCKET -1
+#endif
+#include <stdio.h>
+#include <string.h>
+
+bool net_init()
+{
+    #ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    #else
+    return true;
+    #endif
+}
+
+void net_close(NetSocket s)
+{
+    if (s == NET_INVALID_SOCKET)
+        return;
+    #ifdef _WIN32
+    closesocket(s);
+    #else
+    close(s);
+    #endif
+}
+
+// Limits how long a send or recv may block before failing.
+void net_set_timeout(NetSocket s, int milliseconds)
+{
+    #ifdef _WIN32
+    DWORD t = (DWORD)milliseconds;
+    #else
+    struct timeval t;
+    t.tv_sec = milliseconds / 1000;
+    t.tv_usec = (milliseconds % 1000) * 1000;
+    #endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&t, sizeof(t));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&t, sizeof(t));
+}
+
+// address: "host:port", e.g. "127.0.0.1:7777"
+NetSocket net_connect(const char *address, int timeout_ms)
+{
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    if (!colon || colon-address >= (int)sizeof(host))
+        return NET_INVALID_SOCKET;
+    memcpy(host, address, colon-address);
+    host[colon-address] = 0;
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *info = 0;
+    if (getaddrinfo(host, colon+1, &hints, &info) != 0)
+        return NET_INVALID_SOCKET;
+
+    NetSocket s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (s != NET_INVALID_SOCKET)
+    {
+        net_set_timeout(s, timeout_ms);
+        if (connect(s, info->ai_addr, (int)info->ai_addrlen) != 0)
+        {
+            net_close(s);
+            s = NET_INVALID_SOCKET;
+        }
+    }
+    freeaddrinfo(info);
+    if (s != NET_INVALID_SOCKET)
+    {
+        int one = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    }
+    return s;
+}
+
+// Listens on 127.0.0.1 only; this is meant for local stand-ins.
+NetSocket net_listen_loopback(int port)
+{
+    NetSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NET_INVALID_SOCKET)
+        return s;
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((u16)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(s, 16) != 0)
+    {
+        net_close(s);
+        return NET_INVALID_SOCKET;
+    }
+    return s;
+}
+
+NetSocket net_accept(NetSocket listener)
+{
+    return accept(listener, 0, 0);
+}
+
+bool net_send_all(NetSocket s, const void *data, int length)
+{
+    const char *bytes = (const char*)data;
+    while (length > 0)
+    {
+        int sent = (int)send(s, bytes, length, 0);
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+bool net_recv_all(NetSocket s, void *data, int length)
+{
+    char *bytes = (char*)data;
+    while (length > 0)
+    {
+        int received = (int)recv(s, bytes, length, 0);
+        if (received <= 0)
+            return false;
+        bytes += received;
+        length -= received;
+    }
+    return true;
+}
@@ -1,25 +1,48 @@
 #pragma once
+#include "determinism.h"
 #include "SDL_opengl.h"
 #include "SDL.h"
-#define IM_ASSERT
+
+// Built with GAME_HOT_RELOAD, the platform layer is the executable and
+// the game is a shared library that it loads, see platform_sdl.cpp.
+// ImGui and the functions below live in the executable, which exports
+// them to the game, and the game exports its entry points to it.
+#if !defined(GAME_HOT_RELOAD)
+#define PLATFORM_API
+#define GAME_EXPORT
+#elif defined(_WIN32)
+#ifdef GAME_MODULE
+#define PLATFORM_API __declspec(dllimport)
+#else
+#define PLATFORM_API __declspec(dllexport)
+#endif
+#define GAME_EXPORT extern "C" __declspec(dllexport)
+#else
+#define PLATFORM_API __attribute__((visibility("default")))
+#define GAME_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+#define IMGUI_API PLATFORM_API
+
 #include "lib/imgui/imgui.h"
-#include "lib/imgui/stb_truetype.h"
-#include "lib/imgui/stb_rect_pack.h"
 #include "lib/so_math.h"
-#define SO_NOISE_IMPLEMENTATION
 #include "lib/so_noise.h"
-#include <stdint.h>
-typedef float       r32;
-typedef uint64_t    u64;
-typedef uint32_t    u32;
-typedef uint16_t    u16;
-typedef uint8_t     u08;
-typedef int8_t      s08;
-typedef int16_t     s16;
-typedef int32_t     s32;
-typedef int64_t     s64;
-#define global static
-#define persist static
+#include "types.h"
+
+// Implemented by the platform layer
+PLATFORM_API u64 perf_counter();
+PLATFORM_API r32 time_since(u64 then);
+
+// What ImGui allocated in the last frame, see imgui_memory.cpp
+struct ImGuiMemoryStats
+{
+    int allocs;
+    int frees;
+    int system_allocs; // Made by the pools to grow, or for blocks too large for them
+    int live;          // Blocks in use
+    size_t pooled;     // Bytes in the pools, in use or not
+    size_t large;      // Bytes in use by blocks too large for the pools
+};
+PLATFORM_API ImGuiMemoryStats imgui_memory_stats();
 
 struct VideoMode
 {
@@ -72,3 +95,29 @@ struct Input
         } wheel;
     } mouse;
 };
+
+// Owned by the platform layer, so that it outlives the game module.
+// Before a reload the old module packs everything the game needs to
+// carry on into state, and the new module unpacks it again. Nothing in
+// state points into the module or into state itself, so the block can
+// be moved or grown freely.
+struct GameMemory
+{
+    u08 *state;
+    size_t state_size;
+    int reloads;   // Of the game module since the platform started
+    r32 reload_ms; // Taken by the last reload, from finding the new module to it being ready
+};
+
+// The entry points that the game module exports
+typedef void GameLoadFunction(GameMemory *memory);
+typedef void GameUnloadFunction(GameMemory *memory);
+typedef void GameTickFunction(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time);
+typedef void GameShutdownFunction();
+
+#ifndef GAME_HOT_RELOAD
+// Implemented by the game, which the platform layer calls directly
+void game_init();
+void game_tick(Input input, VideoMode mode, r32 elapsed_time, r32 delta_time);
+void game_shutdown();
+#endif
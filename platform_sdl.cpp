@@ -1,8 +1,24 @@
 #include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Built with SEPARATE_BUILD (see the Makefile), ImGui is compiled on its
+// own, and so are this file and game.cpp. The demo window is only
+// compiled into debug builds.
+#ifdef SEPARATE_BUILD
+bool ImGui_ImplSdl_Init(SDL_Window *window);
+void ImGui_ImplSdl_Shutdown();
+void ImGui_ImplSdl_NewFrame(SDL_Window *window);
+bool ImGui_ImplSdl_ProcessEvent(SDL_Event *event);
+#else
 #include "lib/imgui/imgui_draw.cpp"
 #include "lib/imgui/imgui.cpp"
+#ifdef DEBUG
 #include "lib/imgui/imgui_demo.cpp"
+#endif
 #include "lib/imgui/imgui_impl_sdl.cpp"
+#endif
+#include "imgui_memory.cpp"
 
 void crashv(const char *fmt, va_list args)
 {
@@ -54,8 +70,155 @@ r32 time_since(u64 then)
     return perf_seconds(then, now);
 }
 
+#ifdef GAME_HOT_RELOAD
+// Hot reload
+//
+// The game module is loaded from a copy, so that the compiler can write
+// a new one while the old one is in use. When the module changes and
+// then stays the same for GAME_MODULE_SETTLE ms, so that it is not read
+// while it is still being written, the new one is loaded next to the
+// old one. Only if that succeeds does the old one pack its state into
+// GameMemory and get unloaded, and the new one take over. A module that
+// fails to load leaves the old one running.
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define GAME_MODULE_PATH "game.dll"
+#define GAME_MODULE_COPY "game_loaded_%d.dll"
+#else
+#define GAME_MODULE_PATH "./game.so"
+#define GAME_MODULE_COPY "./game_loaded_%d.so"
+#endif
+#define GAME_MODULE_SETTLE 250 // ms
+
+struct GameModule
+{
+    void *object;
+    char path[256]; // Of the copy that object was loaded from
+    GameLoadFunction *load;
+    GameUnloadFunction *unload;
+    GameTickFunction *tick;
+    GameShutdownFunction *shutdown;
+
+    time_t mtime;   // Of GAME_MODULE_PATH when it was copied
+    off_t size;
+    int copies;     // Made so far, to give each a new name
+    time_t changed_mtime;
+    off_t changed_size;
+    u64 changed;    // perf_counter when a change was first seen, 0 if none
+};
+
+bool game_module_copy(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    if (!in)
+        return false;
+    FILE *out = fopen(to, "wb");
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+    char buffer[65536];
+    size_t n;
+    bool ok = true;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        ok = ok && fwrite(buffer, 1, n, out) == n;
+    ok = ok && !ferror(in);
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+// Loads a fresh copy of the module into module, which is only changed
+// if this succeeds.
+bool game_module_open(GameModule *module)
+{
+    struct stat info;
+    if (stat(GAME_MODULE_PATH, &info) != 0)
+        return false;
+    GameModule fresh = *module;
+    snprintf(fresh.path, sizeof(fresh.path), GAME_MODULE_COPY, fresh.copies++);
+    module->copies = fresh.copies;
+    if (!game_module_copy(GAME_MODULE_PATH, fresh.path))
+    {
+        remove(fresh.path);
+        return false;
+    }
+    fresh.object = SDL_LoadObject(fresh.path);
+    if (fresh.object)
+    {
+        fresh.load = (GameLoadFunction*)SDL_LoadFunction(fresh.object, "game_load");
+        fresh.unload = (GameUnloadFunction*)SDL_LoadFunction(fresh.object, "game_unload");
+        fresh.tick = (GameTickFunction*)SDL_LoadFunction(fresh.object, "game_tick");
+        fresh.shutdown = (GameShutdownFunction*)SDL_LoadFunction(fresh.object, "game_shutdown");
+    }
+    if (!fresh.object || !fresh.load || !fresh.unload || !fresh.tick || !fresh.shutdown)
+    {
+        printf("Failed to load %s: %s\n", GAME_MODULE_PATH, SDL_GetError());
+        if (fresh.object)
+            SDL_UnloadObject(fresh.object);
+        remove(fresh.path);
+        return false;
+    }
+    fresh.mtime = info.st_mtime;
+    fresh.size = info.st_size;
+    fresh.changed = 0;
+    *module = fresh;
+    return true;
+}
+
+void game_module_close(GameModule *module)
+{
+    SDL_UnloadObject(module->object);
+    remove(module->path);
+    module->object = 0;
+}
+
+// Called once per frame, between frames
+void game_module_update(GameModule *module, GameMemory *memory)
+{
+    struct stat info;
+    if (stat(GAME_MODULE_PATH, &info) != 0)
+        return;
+    if (info.st_mtime == module->mtime && info.st_size == module->size)
+    {
+        module->changed = 0;
+        return;
+    }
+    if (module->changed == 0 || info.st_mtime != module->changed_mtime || info.st_size != module->changed_size)
+    {
+        module->changed = perf_counter();
+        module->changed_mtime = info.st_mtime;
+        module->changed_size = info.st_size;
+        return;
+    }
+    if (1000.0f*time_since(module->changed) < GAME_MODULE_SETTLE)
+        return;
+
+    u64 begin = perf_counter();
+    GameModule old = *module;
+    if (!game_module_open(module))
+    {
+        // Try again once it changes
+        module->mtime = info.st_mtime;
+        module->size = info.st_size;
+        module->changed = 0;
+        return;
+    }
+    old.unload(memory);
+    game_module_close(&old);
+    module->load(memory);
+    memory->reloads++;
+    memory->reload_ms = 1000.0f*time_since(begin);
+    printf("Reloaded %s in %.2f ms\n", GAME_MODULE_PATH, memory->reload_ms);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
+    imgui_memory_init();
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
     {
         crash("Failed to initialize SDL: %s", SDL_GetError());
@@ -104,7 +267,17 @@ int main(int argc, char *argv[])
     mode.swap_interval = SDL_GL_GetSwapInterval();
 
     ImGui_ImplSdl_Init(window);
+    #ifdef GAME_HOT_RELOAD
+    GameMemory memory = {};
+    GameModule module = {};
+    if (!game_module_open(&module))
+    {
+        crash("Failed to load the game from %s", GAME_MODULE_PATH);
+    }
+    module.load(&memory);
+    #else
     game_init();
+    #endif
 
     Input input = {};
 
@@ -210,8 +383,15 @@ int main(int argc, char *argv[])
         }
         input.mouse.ndc.x = -1.0f + 2.0f * input.mouse.pos.x / (r32)mode.width;
         input.mouse.ndc.y = +1.0f - 2.0f * input.mouse.pos.y / (r32)mode.height;
+        imgui_memory_frame();
+        #ifdef GAME_HOT_RELOAD
+        game_module_update(&module, &memory);
+        ImGui_ImplSdl_NewFrame(window);
+        module.tick(input, mode, elapsed_time, 1.0f/60.0f);
+        #else
         ImGui_ImplSdl_NewFrame(window);
         game_tick(input, mode, elapsed_time, 1.0f/60.0f);
+        #endif
         ImGui::Render();
         SDL_GL_SwapWindow(window);
 
@@ -234,6 +414,12 @@ int main(int argc, char *argv[])
         }
     }
 
+    #ifdef GAME_HOT_RELOAD
+    module.shutdown();
+    game_module_close(&module);
+    #else
+    game_shutdown();
+    #endif
     ImGui_ImplSdl_Shutdown();
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
@@ -0,0 +1,270 @@
+// Replays
+//
+// A session is fully determined by the wind it was played in, the
+// number of roombas and the keys that were held in each tick, see
+// sim.cpp. Recording those lets the leaderboard server play the session
+// again and check that it really ends with the claimed points, instead
+// of trusting a number the client could have edited.
+//
+// The keys are run-length encoded. Players hold keys for many ticks at
+// a time, so a 60 second session (3600 ticks) usually takes a few
+// hundred bytes:
+//
+//   varint  REPLAY_VERSION
+//   varint  float bits of each r32 in WindParams, in declaration order
+//   varint  octaves
+//   varint  number of roombas (from version 2, version 1 had one)
+//   varint  number of ticks
+//   varint  runs of (length-1) << 4 | keys, until all ticks are covered
+//
+// Bump REPLAY_VERSION whenever the format or what a session scores
+// changes. Old versions are only decoded while they still score the
+// same, and rejected after that. Version 1 sessions had one roomba and
+// still do. Version 2 sessions with more roombas got more time back per
+// win than they do now. Up to version 3 the drag only acted while the
+// wind blew, so a session without wind had none whatever it recorded.
+// Up to version 4 the wind was interpolated from a grid rather than
+// sampled at the bodies, so sessions with wind no longer score the same.
+#include <atomic>
+#include <thread>
+
+#define REPLAY_VERSION     5
+#define REPLAY_DT          SIM_DT
+#define REPLAY_MAX_TICKS   (5*60*60)
+#define REPLAY_MAX_ENCODED 4096
+#define REPLAY_MAX_THREADS 64
+
+struct Replay
+{
+    bool valid; // Cleared if the session can not be played again
+    WindParams wind;
+    int roombas;
+    int ticks;
+    u08 keys[REPLAY_MAX_TICKS]; // SIM_KEY_* bits held during each tick
+};
+
+void replay_begin(Replay *replay, const WindParams *wind, int roombas)
+{
+    replay->valid = true;
+    replay->wind = *wind;
+    replay->roombas = roombas;
+    replay->ticks = 0;
+}
+
+void replay_record(Replay *replay, u32 keys)
+{
+    if (replay->ticks == REPLAY_MAX_TICKS)
+    {
+        replay->valid = false;
+        return;
+    }
+    replay->keys[replay->ticks] = (u08)keys;
+    replay->ticks++;
+}
+
+// out must hold REPLAY_MAX_ENCODED bytes.
+// return: Number of bytes written, or 0 if the replay is not valid or
+//         does not fit.
+int replay_encode(const Replay *replay, u08 *out)
+{
+    if (!replay->valid)
+        return 0;
+    const WindParams *w = &replay->wind;
+    r32 floats[] = {
+        w->intensity, w->mean.x, w->mean.y, w->gust, w->length_scale,
+        w->time_scale, w->player_drag, w->pendulum_drag
+    };
+    int n = highscore_put_varint(out, REPLAY_VERSION);
+    for (int i = 0; i < array_count(floats); i++)
+        n += highscore_put_varint(out+n, m_bits_from_float(floats[i]));
+    n += highscore_put_varint(out+n, (u32)w->octaves);
+    n += highscore_put_varint(out+n, (u32)replay->roombas);
+    n += highscore_put_varint(out+n, (u32)replay->ticks);
+
+    int i = 0;
+    while (i < replay->ticks)
+    {
+        u32 keys = replay->keys[i];
+        int run = 1;
+        while (i+run < replay->ticks && replay->keys[i+run] == keys)
+            run++;
+        if (n+5 > REPLAY_MAX_ENCODED)
+            return 0;
+        n += highscore_put_varint(out+n, ((u32)(run-1) << 4) | keys);
+        i += run;
+    }
+    return n;
+}
+
+// return: Number of bytes read, or 0 if the replay is malformed, has
+//         wind the game can not be set to (see wind_allowed) or was
+//         recorded by a version of the simulation that scores
+//         differently.
+int replay_decode(const u08 *in, const u08 *end, Replay *replay)
+{
+    const u08 *at = in;
+    u32 x;
+    int n;
+    #define REPLAY_READ(X) { n = highscore_get_varint(at, end, &(X)); if (n == 0) return 0; at += n; }
+    u32 version;
+    REPLAY_READ(version);
+    if (version != 1 && version != 3 && version != 4 && version != REPLAY_VERSION)
+        return 0;
+
+    WindParams *w = &replay->wind;
+    r32 *floats[] = {
+        &w->intensity, &w->mean.x, &w->mean.y, &w->gust, &w->length_scale,
+        &w->time_scale, &w->player_drag, &w->pendulum_drag
+    };
+    for (int i = 0; i < array_count(floats); i++)
+    {
+        REPLAY_READ(x);
+        *floats[i] = m_float_from_bits(x);
+    }
+    REPLAY_READ(x);
+    w->octaves = (int)x;
+    if (version < 4 && w->intensity == 0.0f)
+    {
+        w->player_drag = 0.0f;
+        w->pendulum_drag = 0.0f;
+    }
+    if (version < 5 && w->intensity != 0.0f)
+        return 0;
+    if (!wind_allowed(w))
+        return 0;
+    u32 roombas = 1;
+    if (version >= 2)
+        REPLAY_READ(roombas);
+    if (roombas < 1 || roombas > MAX_ROOMBAS)
+        return 0;
+    replay->roombas = (int)roombas;
+    u32 ticks;
+    REPLAY_READ(ticks);
+    if (ticks > REPLAY_MAX_TICKS)
+        return 0;
+
+    u32 i = 0;
+    while (i < ticks)
+    {
+        REPLAY_READ(x);
+        u32 run = (x >> 4)+1;
+        if (run > ticks-i)
+            return 0;
+        memset(replay->keys+i, (int)(x & 15), run);
+        i += run;
+    }
+    #undef REPLAY_READ
+    replay->ticks = (int)ticks;
+    replay->valid = true;
+    return (int)(at-in);
+}
+
+// return: true if the session was played in the setup that the
+//         leaderboard ranks, one roomba in still air
+bool replay_is_standard(const Replay *replay)
+{
+    return replay->roombas == 1 && wind_is_default(&replay->wind);
+}
+
+// Plays the replay from the start.
+// return: true if the session ended in exactly the last recorded tick.
+bool replay_run(const Replay *replay, Sim *sim)
+{
+    sim_init(sim, &replay->wind, replay->roombas);
+    for (int i = 0; i < replay->ticks; i++)
+    {
+        if (!sim->playing)
+            return false;
+        sim_step(sim, replay->keys[i], REPLAY_DT);
+    }
+    return !sim->playing;
+}
+
+// replay, sim: Scratch space
+// return: true if the encoded replay is a complete session that ends
+//         with the given points.
+bool replay_verify(const u08 *encoded, int length, int points, Replay *replay, Sim *sim)
+{
+    return replay_decode(encoded, encoded+length, replay) == length &&
+           replay_run(replay, sim) &&
+           sim->points == points;
+}
+
+struct ReplayClaim
+{
+    const u08 *replay;
+    int length;
+    int points;
+};
+
+// What a verified session did, for analytics
+struct ReplayStats
+{
+    int ticks;
+    u32 events[NUM_SIM_EVENTS];
+};
+
+struct ReplayBatch
+{
+    const ReplayClaim *claims;
+    bool *verified;
+    ReplayStats *stats;
+    int count;
+    std::atomic<int> next;
+};
+
+void replay_batch_worker(ReplayBatch *batch)
+{
+    // Too large for the stack of every thread we might run on
+    Replay *replay = (Replay*)malloc(sizeof(Replay));
+    Sim *sim = (Sim*)malloc(sizeof(Sim));
+
+    // Sessions differ in length, so claims are handed out one at a
+    // time instead of in fixed slices.
+    for (;;)
+    {
+        int i = batch->next++;
+        if (i >= batch->count)
+            break;
+        const ReplayClaim *claim = &batch->claims[i];
+        batch->verified[i] = replay && sim &&
+                             replay_verify(claim->replay, claim->length, claim->points, replay, sim);
+        if (batch->stats && batch->verified[i])
+        {
+            batch->stats[i].ticks = replay->ticks;
+            memcpy(batch->stats[i].events, sim->event_counts, sizeof(sim->event_counts));
+        }
+    }
+    free(replay);
+    free(sim);
+}
+
+// Verifies count claims on up to threads threads, 0 for one per core.
+// stats: Optional, filled in for the verified claims
+void replay_verify_batch(const ReplayClaim *claims, int count, bool *verified,
+                         int threads = 0, ReplayStats *stats = 0)
+{
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads > REPLAY_MAX_THREADS)
+        threads = REPLAY_MAX_THREADS;
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    ReplayBatch batch;
+    batch.claims = claims;
+    batch.verified = verified;
+    batch.stats = stats;
+    batch.count = count;
+    batch.next = 0;
+
+    // The calling thread is one of the workers
+    std::thread workers[REPLAY_MAX_THREADS];
+    for (int i = 1; i < threads; i++)
+        workers[i] = std::thread(replay_batch_worker, &batch);
+    replay_batch_worker(&batch);
+    for (int i = 1; i < threads; i++)
+        workers[i].join();
+}
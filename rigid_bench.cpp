@@ -0,0 +1,269 @@
+// rigid_bench: times the batch quaternion and rigid transform kernels.
+//
+// Checks m_quat_mul_n, m_quat_rotate_n, m_rigid_compose_n,
+// m_rigid_inverse_n and m_rigid_transform_n against the single-body
+// functions (m_quat_mul, m_quat_to_so3, m_se3, m_se3_inverse) on random
+// bodies, with translations up to 10 m, and then times each kernel over
+// a batch of bodies, best of five rounds. Composing the same transforms
+// as SE3 matrices, with the SIMD mat4 product and with the generic
+// template, is timed for comparison. Build with -DSO_MATH_NO_SIMD for
+// the scalar kernels and with -mavx for the AVX mat4 product.
+//
+//    $ g++ -O2 ../rigid_bench.cpp -o rigid_bench
+//    $ ./rigid_bench --bodies 1024 --iterations 2000
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#define BENCH_SEED       0x7269676964
+#define BENCH_CHECKED    10000
+#define BENCH_TOLERANCE  2e-5f // Max abs error, a few ulps of 10 m
+#define BENCH_ROUNDS     5
+
+RngKey bench_key;
+u64 bench_draw;
+
+r32 bench_uniform(r32 low, r32 high)
+{
+    return low + (high-low)*rng_uniform(bench_key, 0, bench_draw++);
+}
+
+// Owns the arrays of n rigid transforms
+struct Bodies
+{
+    RigidArray a;
+    float *data;
+};
+
+Bodies bench_alloc(int n)
+{
+    Bodies b;
+    b.data = (float*)malloc(7*n*sizeof(float));
+    float *p = b.data;
+    b.a.q.x = p; p += n; b.a.q.y = p; p += n; b.a.q.z = p; p += n; b.a.q.w = p; p += n;
+    b.a.t.x = p; p += n; b.a.t.y = p; p += n; b.a.t.z = p;
+    return b;
+}
+
+quat bench_quat(RigidArray a, int i) { return m_vec4(a.q.x[i], a.q.y[i], a.q.z[i], a.q.w[i]); }
+vec3 bench_vec3(Vec3Array v, int i) { return m_vec3(v.x[i], v.y[i], v.z[i]); }
+mat4 bench_se3(RigidArray a, int i) { return m_se3(m_quat_to_so3(bench_quat(a, i)), bench_vec3(a.t, i)); }
+
+void bench_randomize(RigidArray a, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        // Not m_normalize, whose inverse square root is only good to
+        // about 1e-3, while the kernels take unit quaternions
+        vec3 axis = m_vec3(bench_uniform(-1.0f, 1.0f), bench_uniform(-1.0f, 1.0f), bench_uniform(-1.0f, 1.0f));
+        axis = axis/m_length(axis);
+        quat q = m_quat_from_angle_axis(axis, bench_uniform(-PI, PI));
+        a.q.x[i] = q.x; a.q.y[i] = q.y; a.q.z[i] = q.z; a.q.w[i] = q.w;
+        a.t.x[i] = bench_uniform(-10.0f, 10.0f);
+        a.t.y[i] = bench_uniform(-10.0f, 10.0f);
+        a.t.z[i] = bench_uniform(-10.0f, 10.0f);
+    }
+}
+
+r32 bench_error(const float *a, const float *b, int n)
+{
+    r32 max_error = 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        r32 e = m_abs(a[i]-b[i]);
+        max_error = e > max_error ? e : max_error;
+    }
+    return max_error;
+}
+
+// return: The max abs error of the SE3 matrix of a against m
+r32 bench_se3_error(RigidArray a, int i, mat4 m)
+{
+    return bench_error(bench_se3(a, i).data, m.data, 16);
+}
+
+bool bench_report_error(const char *name, r32 error)
+{
+    bool passed = error <= BENCH_TOLERANCE;
+    printf("  %-20s max abs error %.2g%s\n", name, error, passed ? "" : "  FAILED");
+    return passed;
+}
+
+bool bench_check()
+{
+    int n = BENCH_CHECKED;
+    Bodies a = bench_alloc(n);
+    Bodies b = bench_alloc(n);
+    Bodies out = bench_alloc(n);
+    bench_randomize(a.a, n);
+    bench_randomize(b.a, n);
+    Vec3Array v = b.a.t;
+    Vec3Array p = out.a.t;
+
+    printf("Against the single-body functions, %d bodies\n", n);
+    bool passed = true;
+    r32 error = 0.0f;
+    m_quat_mul_n(a.a.q, b.a.q, out.a.q, n);
+    for (int i = 0; i < n; i++)
+    {
+        quat q = m_quat_mul(bench_quat(a.a, i), bench_quat(b.a, i));
+        error = m_max(error, bench_error(bench_quat(out.a, i).data, q.data, 4));
+    }
+    passed = bench_report_error("m_quat_mul_n", error) && passed;
+
+    error = 0.0f;
+    m_quat_rotate_n(a.a.q, v, p, n);
+    for (int i = 0; i < n; i++)
+    {
+        vec3 r = m_quat_to_so3(bench_quat(a.a, i))*bench_vec3(v, i);
+        error = m_max(error, bench_error(bench_vec3(p, i).data, r.data, 3));
+    }
+    passed = bench_report_error("m_quat_rotate_n", error) && passed;
+
+    error = 0.0f;
+    m_rigid_transform_n(a.a, v, p, n);
+    for (int i = 0; i < n; i++)
+    {
+        vec4 r = bench_se3(a.a, i)*m_vec4(bench_vec3(v, i), 1.0f);
+        error = m_max(error, bench_error(bench_vec3(p, i).data, r.data, 3));
+    }
+    passed = bench_report_error("m_rigid_transform_n", error) && passed;
+
+    error = 0.0f;
+    m_rigid_compose_n(a.a, b.a, out.a, n);
+    for (int i = 0; i < n; i++)
+        error = m_max(error, bench_se3_error(out.a, i, bench_se3(a.a, i)*bench_se3(b.a, i)));
+    passed = bench_report_error("m_rigid_compose_n", error) && passed;
+
+    error = 0.0f;
+    m_rigid_inverse_n(a.a, out.a, n);
+    for (int i = 0; i < n; i++)
+        error = m_max(error, bench_se3_error(out.a, i, m_se3_inverse(bench_se3(a.a, i))));
+    passed = bench_report_error("m_rigid_inverse_n", error) && passed;
+
+    free(a.data);
+    free(b.data);
+    free(out.data);
+    return passed;
+}
+
+// Keeps the compiler from seeing that every iteration computes the
+// same thing, and doing it only once
+inline void bench_clobber()
+{
+    #if defined(__GNUC__)
+    asm volatile("" ::: "memory");
+    #endif
+}
+
+void bench_print(const char *name, int n, int iterations, r32 seconds)
+{
+    printf("  %-26s %8.1f ms %8.1f M/s\n", name, 1000.0f*seconds, n*(r32)iterations/seconds/1e6f);
+}
+
+// Runs the statement iterations times, BENCH_ROUNDS times over, and
+// prints the fastest round
+#define BENCH_TIME(name, ...)                                    \
+    {                                                            \
+        r32 best_ = 1e9f;                                        \
+        for (int round_ = 0; round_ < BENCH_ROUNDS; round_++)    \
+        {                                                        \
+            u64 begin_ = perf_counter();                         \
+            for (int k_ = 0; k_ < iterations; k_++)              \
+            {                                                    \
+                __VA_ARGS__;                                     \
+                bench_clobber();                                 \
+            }                                                    \
+            r32 t_ = time_since(begin_);                         \
+            best_ = t_ < best_ ? t_ : best_;                     \
+        }                                                        \
+        bench_print(name, n, iterations, best_);                 \
+    }
+
+void bench_throughput(int n, int iterations)
+{
+    Bodies a = bench_alloc(n);
+    Bodies b = bench_alloc(n);
+    Bodies out = bench_alloc(n);
+    bench_randomize(a.a, n);
+    bench_randomize(b.a, n);
+    Vec3Array v = b.a.t;
+    Vec3Array p = out.a.t;
+    mat4 *ma = (mat4*)malloc(n*sizeof(mat4));
+    mat4 *mb = (mat4*)malloc(n*sizeof(mat4));
+    mat4 *mout = (mat4*)malloc(n*sizeof(mat4));
+    for (int i = 0; i < n; i++)
+    {
+        ma[i] = bench_se3(a.a, i);
+        mb[i] = bench_se3(b.a, i);
+    }
+
+    #if defined(SO_MATH_AVX)
+    const char *simd = "AVX";
+    #elif defined(SO_MATH_SSE)
+    const char *simd = "SSE";
+    #else
+    const char *simd = "no SIMD";
+    #endif
+    printf("%d bodies, %d iterations, best of %d, %s\n", n, iterations, BENCH_ROUNDS, simd);
+
+    BENCH_TIME("m_quat_mul_n", m_quat_mul_n(a.a.q, b.a.q, out.a.q, n));
+    BENCH_TIME("m_quat_rotate_n", m_quat_rotate_n(a.a.q, v, p, n));
+    BENCH_TIME("m_rigid_transform_n", m_rigid_transform_n(a.a, v, p, n));
+    BENCH_TIME("m_rigid_inverse_n", m_rigid_inverse_n(a.a, out.a, n));
+    BENCH_TIME("m_rigid_compose_n", m_rigid_compose_n(a.a, b.a, out.a, n));
+    BENCH_TIME("mat4*mat4",
+        for (int i = 0; i < n; i++)
+            mout[i] = ma[i]*mb[i]);
+    BENCH_TIME("mat4*mat4, generic",
+        for (int i = 0; i < n; i++)
+            mout[i] = operator*<float, 4, 4, 4>(ma[i], mb[i]));
+
+    // Keeps the results alive
+    printf("  (%g)\n", out.a.t.x[0] + mout[n-1].data[12] + p.x[n/2]);
+    free(a.data);
+    free(b.data);
+    free(out.data);
+    free(ma);
+    free(mb);
+    free(mout);
+}
+
+int main(int argc, char **argv)
+{
+    int bodies = 1024;
+    int iterations = 2000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bodies") == 0 && i+1 < argc)
+            bodies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--iterations") == 0 && i+1 < argc)
+            iterations = atoi(argv[++i]);
+        else
+        {
+            printf("usage: rigid_bench [--bodies n] [--iterations n]\n");
+            return 1;
+        }
+    }
+    if (bodies < 1)
+        bodies = 1;
+    if (iterations < 1)
+        iterations = 1;
+
+    bench_key = rng_key(BENCH_SEED);
+    bool passed = bench_check();
+    bench_throughput(bodies, iterations);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,1196 @@
+// Simulation
+//
+// Everything that decides the score: the player, the pendulum, the
+// roombas, the timers and the wind. sim_step advances a Sim by one tick
+// from the keys held during that tick. It reads and writes nothing
+// outside of the Sim, so a game can be stepped without a window and
+// several games can be stepped side by side.
+//
+// Deterministic physics
+//
+// Built with DETERMINISTIC_PHYSICS (see determinism.h), a Sim that
+// starts from sim_init and gets the same keys every tick ends up
+// bit-identical on every machine and with every optimization level.
+// That takes:
+//
+//   - IEEE single precision for every operation, i.e. no x87 and no
+//     -ffast-math or /fp:fast. determinism.h refuses to build otherwise.
+//   - No contraction of a*b+c into fused multiply-adds, which rounds
+//     once instead of twice. determinism.h turns it off for the whole
+//     translation unit, including the inline functions in so_math, as
+//     long as it is included before them.
+//   - Trig that does not come from the C library. sim_step only uses
+//     m_sincos, which is a fixed polynomial. sqrt is correctly rounded
+//     by IEEE, so it is the same everywhere.
+//   - Round to nearest and no flush-to-zero. sim_step sets the SSE
+//     control register for the duration of the step.
+//   - The same fixed time step. The platform layer always passes 1/60.
+#include <stddef.h>
+#include <string.h>
+
+#define SIM_KEY_LEFT  1
+#define SIM_KEY_RIGHT 2
+#define SIM_KEY_UP    4
+#define SIM_KEY_DOWN  8
+
+#define SIM_CSR 0x1f80 // SSE control register during sim_step
+#define SIM_DT  (1.0f/60.0f) // The fixed step of the platform layer
+
+struct Player
+{
+    vec2 position;
+    vec2 Dposition;
+    r32 theta;
+    r32 Dtheta;
+
+    r32 motor_constant;
+    r32 l_motor;
+    r32 r_motor;
+
+    r32 mass;
+    r32 arm;
+    r32 inertia;
+};
+
+struct PlayerPendulumLink
+{
+    r32 k;
+    r32 l0;
+    r32 d;
+};
+
+struct Pendulum
+{
+    vec2 position;
+    vec2 Dposition;
+    r32 mass;
+    r32 radius;
+};
+
+struct World
+{
+    r32 floor_level;
+    r32 green_line;
+    r32 red_line;
+    r32 g;
+
+    r32 right;
+    r32 left;
+    r32 top;
+    r32 bottom;
+};
+
+enum TimerState
+{
+    TIMER_INACTIVE = 0,
+    TIMER_BEGIN = 1,
+    TIMER_ACTIVE = 2,
+    TIMER_SUCCESS = 3,
+    TIMER_ABORTED = 4
+};
+
+struct Timer
+{
+    TimerState state;
+    r32 t;
+    r32 duration;
+    bool repeat;
+
+    // Scheduled timers only, see TimerWheel
+    u32 due;    // Tick of the next change of state
+    u32 t_tick; // Tick that t has been counted down to
+    u32 t_end;  // Last tick that counts t down
+    int next;   // In the slot of due, -1 after the last
+    int prev;   // -1 before the first
+};
+
+// These are counted down every tick, see update_timer. The player time
+// has to be, since scoring adds time to it.
+#define TIMER_PLAYER_TIME timers[0]
+#define NUM_TIMERS 1
+
+#define ON_TIMER_SUCCESS(TIMER) if (TIMER.state == TIMER_SUCCESS)
+#define ON_TIMER_ABORTED(TIMER) if (TIMER.state == TIMER_ABORTED)
+#define ON_TIMER_BEGIN(TIMER) if (TIMER.state == TIMER_BEGIN)
+#define DURING_TIMER(TIMER) if (TIMER.state == TIMER_ACTIVE || TIMER.state == TIMER_BEGIN)
+#define TIMER_PROGRESS(TIMER) (1.0f-TIMER.t/TIMER.duration)
+#define START_TIMER(TIMER) if (TIMER.state == TIMER_INACTIVE) { TIMER.state = TIMER_BEGIN; TIMER.t = TIMER.duration; }
+#define ABORT_TIMER(TIMER) if (TIMER.state == TIMER_ACTIVE) TIMER.state = TIMER_ABORTED;
+
+void init_timer(Timer *timer, r32 duration, bool repeat = false)
+{
+    timer->state = TIMER_INACTIVE;
+    timer->t = 0.0f;
+    timer->duration = duration;
+    timer->repeat = repeat;
+    timer->due = 0;
+    timer->t_tick = 0;
+    timer->t_end = 0;
+    timer->next = -1;
+    timer->prev = -1;
+}
+
+void update_timer(Timer *timer, r32 delta_time)
+{
+    if (timer->state == TIMER_SUCCESS)
+    {
+        if (timer->repeat)
+        {
+            timer->state = TIMER_BEGIN;
+        }
+        else
+        {
+            timer->state = TIMER_INACTIVE;
+        }
+    }
+    if (timer->state == TIMER_ABORTED)
+    {
+        timer->state = TIMER_INACTIVE;
+    }
+    if (timer->state == TIMER_BEGIN)
+    {
+        timer->t = timer->duration;
+        timer->state = TIMER_ACTIVE;
+    }
+    if (timer->state == TIMER_ACTIVE)
+    {
+        timer->t -= delta_time;
+        if (timer->t < 0.0f)
+        {
+            timer->state = TIMER_SUCCESS;
+        }
+    }
+}
+
+// The roombas are stored as one array per field, and every roomba has
+// its own timers, so that they are all updated in one pass over the
+// arrays. Roomba 0 starts where the single roomba of the original game
+// did, so a one-roomba arena plays exactly like it. Programs that keep
+// many Sims around can define a smaller MAX_ROOMBAS before including
+// this, since most of a Sim is sized by it.
+#ifndef MAX_ROOMBAS
+#define MAX_ROOMBAS 4096
+#endif
+
+// The roombas are also linked into a uniform grid, so that contact with
+// the pendulum is found by looking at the few roombas around it instead
+// of all of them. Roombas only move along x, so the grid is one row of
+// cells as wide as half a roomba. Roombas outside of it are kept in the
+// cells at the ends.
+#define ROOMBA_GRID_CELLS 64
+#define ROOMBA_GRID_CELL  0.5f
+#define ROOMBA_GRID_LEFT  (-0.5f*ROOMBA_GRID_CELLS*ROOMBA_GRID_CELL)
+
+// Every roomba has one of each
+enum RoombaTimer
+{
+    ROOMBA_TURN = 0, // Reverses the roomba when it runs out
+    ROOMBA_MAGNET,
+    ROOMBA_CELEBRATION,
+    ROOMBA_RED_CAPTURE,
+    ROOMBA_GREEN_CAPTURE,
+    ROOMBA_LOSE,
+    ROOMBA_WIN,
+    NUM_ROOMBA_TIMERS
+};
+
+#define MAX_TIMERS (NUM_ROOMBA_TIMERS*MAX_ROOMBAS)
+#define ROOMBA_TIMER(KIND, I) ((KIND)*MAX_ROOMBAS+(I))
+
+// Scheduled timers
+//
+// The roombas have thousands of timers between them, and most of them
+// are running with nothing to do but count down. Instead of counting
+// every one down every tick, a timer is linked into the slot of a timing
+// wheel for the tick when its state changes next, and each tick only
+// visits the timers in its slot. Starting and aborting a timer relinks
+// it, which is O(1).
+//
+// A timer changes state in the same ticks as with update_timer, so
+// scheduled and updated timers play the same sessions. The tick a timer
+// runs out on is found by counting its time down once, the same way
+// update_timer would. The counts are cached, since timers mostly start
+// from their full duration. t itself is counted down when it is read,
+// through timer_time_left, which keeps it bit-identical as well. That
+// relies on every step having the same delta_time, like everything
+// else in a deterministic session.
+//
+// Timers that run for more ticks than there are slots stay linked for
+// several turns of the wheel, and are skipped until they are due.
+#define TIMER_WHEEL_SLOTS 1024
+#define TIMER_WHEEL_CACHE 16 // Must match the hash in timer_wheel_count
+
+struct TimerWheel
+{
+    u32 tick; // Number of steps so far
+    r32 dt;
+    int slot[TIMER_WHEEL_SLOTS];
+    struct Count
+    {
+        r32 t;
+        r32 dt;
+        u32 ticks;
+    } cache[TIMER_WHEEL_CACHE];
+    Timer timers[MAX_TIMERS];
+};
+
+void timer_wheel_init(TimerWheel *wheel)
+{
+    wheel->tick = 0;
+    wheel->dt = 0.0f;
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++)
+        wheel->slot[i] = -1;
+    for (int i = 0; i < TIMER_WHEEL_CACHE; i++)
+        wheel->cache[i].dt = 0.0f;
+}
+
+void timer_wheel_link(TimerWheel *wheel, Timer *timer, u32 due)
+{
+    int id = (int)(timer-wheel->timers);
+    int *head = &wheel->slot[due % TIMER_WHEEL_SLOTS];
+    timer->due = due;
+    timer->prev = -1;
+    timer->next = *head;
+    if (*head >= 0)
+        wheel->timers[*head].prev = id;
+    *head = id;
+}
+
+void timer_wheel_unlink(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->prev >= 0)
+        wheel->timers[timer->prev].next = timer->next;
+    else
+        wheel->slot[timer->due % TIMER_WHEEL_SLOTS] = timer->next;
+    if (timer->next >= 0)
+        wheel->timers[timer->next].prev = timer->prev;
+}
+
+// return: Number of ticks that t takes to count down below zero.
+u32 timer_wheel_count(TimerWheel *wheel, r32 t)
+{
+    TimerWheel::Count *count = &wheel->cache[(m_bits_from_float(t)*2654435769u) >> 28];
+    if (count->dt != wheel->dt || count->t != t)
+    {
+        count->t = t;
+        count->dt = wheel->dt;
+        count->ticks = 0;
+        do
+        {
+            t -= wheel->dt;
+            count->ticks++;
+        } while (!(t < 0.0f));
+    }
+    return count->ticks;
+}
+
+// Counts the timer down from t, starting with this tick.
+void timer_wheel_resume(TimerWheel *wheel, Timer *timer)
+{
+    u32 ticks = timer_wheel_count(wheel, timer->t);
+    timer->t_tick = wheel->tick-1;
+    timer->t_end = wheel->tick+ticks-1;
+    if (ticks == 1)
+    {
+        timer->state = TIMER_SUCCESS;
+        timer_wheel_link(wheel, timer, wheel->tick+1);
+    }
+    else
+    {
+        timer->state = TIMER_ACTIVE;
+        timer_wheel_link(wheel, timer, timer->t_end);
+    }
+}
+
+// Moves on to the next tick. Call once per step, before reading or
+// changing any of the timers.
+void timer_wheel_step(TimerWheel *wheel, r32 delta_time)
+{
+    wheel->dt = delta_time;
+    wheel->tick++;
+    int id = wheel->slot[wheel->tick % TIMER_WHEEL_SLOTS];
+    while (id >= 0)
+    {
+        Timer *timer = &wheel->timers[id];
+        id = timer->next;
+        if (timer->due != wheel->tick)
+            continue;
+        timer_wheel_unlink(wheel, timer);
+        if (timer->state == TIMER_BEGIN ||
+            (timer->state == TIMER_SUCCESS && timer->repeat))
+        {
+            timer->t = timer->duration;
+            timer_wheel_resume(wheel, timer);
+        }
+        else if (timer->state == TIMER_ACTIVE && timer->t_end != wheel->tick)
+        {
+            // Started in the middle, see timer_wheel_start_at
+            timer_wheel_resume(wheel, timer);
+        }
+        else if (timer->state == TIMER_ACTIVE)
+        {
+            timer->state = TIMER_SUCCESS;
+            timer_wheel_link(wheel, timer, wheel->tick+1);
+        }
+        else
+        {
+            timer->state = TIMER_INACTIVE;
+        }
+    }
+}
+
+// Like START_TIMER
+void timer_wheel_start(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->state == TIMER_INACTIVE)
+    {
+        timer->state = TIMER_BEGIN;
+        timer->t = timer->duration;
+        timer->t_tick = timer->t_end = wheel->tick;
+        timer_wheel_link(wheel, timer, wheel->tick+1);
+    }
+}
+
+// Starts an inactive timer as if it had been running for a while, with
+// t left after this tick.
+void timer_wheel_start_at(TimerWheel *wheel, Timer *timer, r32 t)
+{
+    if (timer->state == TIMER_INACTIVE)
+    {
+        timer->state = TIMER_ACTIVE;
+        timer->t = t;
+        timer->t_tick = timer->t_end = wheel->tick;
+        timer_wheel_link(wheel, timer, wheel->tick+1);
+    }
+}
+
+// Like ABORT_TIMER
+void timer_wheel_abort(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->state == TIMER_ACTIVE)
+    {
+        timer_wheel_unlink(wheel, timer);
+        timer->state = TIMER_ABORTED;
+        timer->t_end = wheel->tick;
+        timer_wheel_link(wheel, timer, wheel->tick+1);
+    }
+}
+
+r32 timer_time_left(TimerWheel *wheel, Timer *timer)
+{
+    u32 end = timer->t_end < wheel->tick ? timer->t_end : wheel->tick;
+    while (timer->t_tick < end)
+    {
+        timer->t -= wheel->dt;
+        timer->t_tick++;
+    }
+    return timer->t;
+}
+
+// Like TIMER_PROGRESS
+r32 timer_progress(TimerWheel *wheel, Timer *timer)
+{
+    return 1.0f-timer_time_left(wheel, timer)/timer->duration;
+}
+
+struct Roombas
+{
+    int count;
+
+    // The same for every roomba
+    r32 y;
+    r32 dy0;
+    r32 dy1;
+    r32 dy2;
+    r32 radius;
+    r32 speed;
+
+    r32 x[MAX_ROOMBAS];
+    r32 direction[MAX_ROOMBAS];
+    r32 Rdirection[MAX_ROOMBAS];
+    r32 x0[MAX_ROOMBAS]; // Where the roomba was when it started to leave
+
+    int cell[MAX_ROOMBAS];
+    int next[MAX_ROOMBAS]; // In the same cell, -1 after the last
+    int prev[MAX_ROOMBAS]; // -1 before the first
+    int cell_head[ROOMBA_GRID_CELLS];
+    bool near[MAX_ROOMBAS]; // Close enough to the pendulum to be tested this tick
+};
+
+int roomba_grid_cell(r32 x)
+{
+    r32 u = (x-ROOMBA_GRID_LEFT)/ROOMBA_GRID_CELL;
+    if (u < 0.0f)
+        return 0;
+    if (u >= (r32)ROOMBA_GRID_CELLS)
+        return ROOMBA_GRID_CELLS-1;
+    return (int)u;
+}
+
+void roomba_grid_link(Roombas *roombas, int i, int cell)
+{
+    int head = roombas->cell_head[cell];
+    roombas->cell[i] = cell;
+    roombas->prev[i] = -1;
+    roombas->next[i] = head;
+    if (head >= 0)
+        roombas->prev[head] = i;
+    roombas->cell_head[cell] = i;
+}
+
+void roomba_grid_unlink(Roombas *roombas, int i)
+{
+    int prev = roombas->prev[i];
+    int next = roombas->next[i];
+    if (prev >= 0)
+        roombas->next[prev] = next;
+    else
+        roombas->cell_head[roombas->cell[i]] = next;
+    if (next >= 0)
+        roombas->prev[next] = prev;
+}
+
+void roomba_grid_build(Roombas *roombas)
+{
+    for (int c = 0; c < ROOMBA_GRID_CELLS; c++)
+        roombas->cell_head[c] = -1;
+    for (int i = 0; i < roombas->count; i++)
+        roomba_grid_link(roombas, i, roomba_grid_cell(roombas->x[i]));
+}
+
+// Call after roomba i has moved. Roombas move a few centimeters per
+// tick, so most calls leave it where it was.
+void roomba_grid_move(Roombas *roombas, int i)
+{
+    int cell = roomba_grid_cell(roombas->x[i]);
+    if (cell != roombas->cell[i])
+    {
+        roomba_grid_unlink(roombas, i);
+        roomba_grid_link(roombas, i, cell);
+    }
+}
+
+// return: true if any roomba center is closer than reach to x.
+bool roomba_grid_any(const Roombas *roombas, r32 x, r32 reach)
+{
+    int c0 = roomba_grid_cell(x-reach);
+    int c1 = roomba_grid_cell(x+reach);
+    for (int c = c0; c <= c1; c++)
+    {
+        for (int i = roombas->cell_head[c]; i >= 0; i = roombas->next[i])
+        {
+            if (m_abs(x-roombas->x[i]) < reach)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Finds the roombas whose center may be in [x0, x1]. Every roomba that
+// is, is found, along with some that are a cell away.
+// out: Holds MAX_ROOMBAS indices
+// return: Number of indices written to out
+int roomba_grid_query(const Roombas *roombas, r32 x0, r32 x1, int *out)
+{
+    int n = 0;
+    int c0 = roomba_grid_cell(x0);
+    int c1 = roomba_grid_cell(x1);
+    for (int c = c0; c <= c1; c++)
+    {
+        for (int i = roombas->cell_head[c]; i >= 0; i = roombas->next[i])
+            out[n++] = i;
+    }
+    return n;
+}
+
+// Events
+//
+// sim_step lists what happened during the step, in the order it
+// happened, so that the game and tools can react to it without polling
+// the timers that decide it. The list only holds the last step. Events
+// beyond SIM_MAX_EVENTS in one step are counted, but not listed.
+// Replays do not need to store them, since playing the keys again gives
+// the same events.
+enum SimEventType
+{
+    SIM_EVENT_TIME_UP = 0,    // The session is over
+    SIM_EVENT_PLAYER_RESET,   // The player left the field and was put back
+    SIM_EVENT_ROOMBA_TURN,    // Turned because its turn timer ran out
+    SIM_EVENT_MAGNET,         // The pendulum held it long enough to turn it
+    SIM_EVENT_ROOMBA_LOSE,    // Captured by the red line, minus one point
+    SIM_EVENT_ROOMBA_WIN,     // Captured by the green line, plus one point
+    SIM_EVENT_ROOMBA_RETURN,  // Back in the middle after leaving the field
+    NUM_SIM_EVENTS
+};
+
+struct SimEvent
+{
+    SimEventType type;
+    int roomba; // -1 if the event is not about a roomba
+};
+
+#define SIM_MAX_EVENTS 1024
+
+const char *sim_event_name(SimEventType type)
+{
+    switch (type)
+    {
+        case SIM_EVENT_TIME_UP: return "time up";
+        case SIM_EVENT_PLAYER_RESET: return "player reset";
+        case SIM_EVENT_ROOMBA_TURN: return "roomba turn";
+        case SIM_EVENT_MAGNET: return "magnet";
+        case SIM_EVENT_ROOMBA_LOSE: return "roomba lose";
+        case SIM_EVENT_ROOMBA_WIN: return "roomba win";
+        case SIM_EVENT_ROOMBA_RETURN: return "roomba return";
+        default: return "unknown";
+    }
+}
+
+// The constants of a session. Sessions that are played again from a
+// replay always use the defaults, so changing them invalidates the
+// replay, see tunables.cpp and sweep.cpp.
+struct SimParams
+{
+    r32 g;
+    r32 floor_level;
+    r32 green_line;
+    r32 red_line;
+
+    r32 spring_k;
+    r32 spring_l0;
+    r32 spring_d;
+
+    r32 pendulum_mass;
+    r32 pendulum_radius;
+
+    r32 player_mass;
+    r32 player_arm;
+    r32 motor_constant;
+
+    r32 roomba_radius;
+    r32 roomba_speed;
+
+    // Timer durations, s
+    r32 session_time;
+    r32 roomba_timers[NUM_ROOMBA_TIMERS];
+};
+
+void sim_defaults(SimParams *p)
+{
+    p->g = 9.81f;
+    p->floor_level = 0.0f;
+    p->green_line = 2.5f;
+    p->red_line = -1.5f;
+
+    p->spring_k = 40.0f;
+    p->spring_l0 = 0.8f;
+    p->spring_d = 1.0f;
+
+    p->pendulum_mass = 0.05f;
+    p->pendulum_radius = 0.1f;
+
+    p->player_mass = 1.0f;
+    p->player_arm = 0.5f;
+    p->motor_constant = 0.8f*(p->player_mass+p->pendulum_mass)*p->g;
+
+    p->roomba_radius = 0.5f;
+    p->roomba_speed = 0.33f;
+
+    p->session_time = 60.0f;
+    p->roomba_timers[ROOMBA_TURN] = 8.5f;
+    p->roomba_timers[ROOMBA_MAGNET] = 0.45f;
+    p->roomba_timers[ROOMBA_CELEBRATION] = 0.5f;
+    p->roomba_timers[ROOMBA_RED_CAPTURE] = 2.0f;
+    p->roomba_timers[ROOMBA_GREEN_CAPTURE] = 2.0f;
+    p->roomba_timers[ROOMBA_LOSE] = 0.5f;
+    p->roomba_timers[ROOMBA_WIN] = 0.5f;
+}
+
+// The names of the constants in tunables files and sweep specs
+struct SimParamInfo
+{
+    const char *name;
+    size_t offset; // In SimParams
+};
+
+SimParamInfo sim_param_info[] = {
+    { "world.g",               offsetof(SimParams, g) },
+    { "world.floor_level",     offsetof(SimParams, floor_level) },
+    { "world.green_line",      offsetof(SimParams, green_line) },
+    { "world.red_line",        offsetof(SimParams, red_line) },
+    { "spring.k",              offsetof(SimParams, spring_k) },
+    { "spring.l0",             offsetof(SimParams, spring_l0) },
+    { "spring.d",              offsetof(SimParams, spring_d) },
+    { "pendulum.mass",         offsetof(SimParams, pendulum_mass) },
+    { "pendulum.radius",       offsetof(SimParams, pendulum_radius) },
+    { "player.mass",           offsetof(SimParams, player_mass) },
+    { "player.arm",            offsetof(SimParams, player_arm) },
+    { "player.motor_constant", offsetof(SimParams, motor_constant) },
+    { "roombas.radius",        offsetof(SimParams, roomba_radius) },
+    { "roombas.speed",         offsetof(SimParams, roomba_speed) },
+    { "timer.session",         offsetof(SimParams, session_time) },
+    { "timer.turn",            offsetof(SimParams, roomba_timers[ROOMBA_TURN]) },
+    { "timer.magnet",          offsetof(SimParams, roomba_timers[ROOMBA_MAGNET]) },
+    { "timer.celebration",     offsetof(SimParams, roomba_timers[ROOMBA_CELEBRATION]) },
+    { "timer.red_capture",     offsetof(SimParams, roomba_timers[ROOMBA_RED_CAPTURE]) },
+    { "timer.green_capture",   offsetof(SimParams, roomba_timers[ROOMBA_GREEN_CAPTURE]) },
+    { "timer.lose",            offsetof(SimParams, roomba_timers[ROOMBA_LOSE]) },
+    { "timer.win",             offsetof(SimParams, roomba_timers[ROOMBA_WIN]) },
+};
+
+#define NUM_SIM_PARAMS array_count(sim_param_info)
+
+r32 *sim_param(SimParams *params, int i)
+{
+    return (r32*)((u08*)params+sim_param_info[i].offset);
+}
+
+r32 sim_param(const SimParams *params, int i)
+{
+    return *(const r32*)((const u08*)params+sim_param_info[i].offset);
+}
+
+// return: The index of the constant in sim_param_info, or -1
+int sim_find_param(const char *name)
+{
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+    {
+        if (strcmp(name, sim_param_info[i].name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+struct Sim
+{
+    Player player;
+    PlayerPendulumLink spring;
+    Pendulum pendulum;
+    Roombas roombas;
+    World world;
+    Timer timers[NUM_TIMERS];
+    TimerWheel wheel;
+    Wind wind;
+    SimParams params;
+
+    bool playing; // Keys and points count. Cleared when time runs out.
+    int points;
+
+    SimEvent events[SIM_MAX_EVENTS]; // Of the last step
+    int num_events;
+    u32 event_counts[NUM_SIM_EVENTS]; // Since sim_init, listed or not
+    u32 events_dropped;
+};
+
+void sim_emit(Sim *s, SimEventType type, int roomba = -1)
+{
+    s->event_counts[type]++;
+    if (s->num_events == SIM_MAX_EVENTS)
+    {
+        s->events_dropped++;
+        return;
+    }
+    s->events[s->num_events].type = type;
+    s->events[s->num_events].roomba = roomba;
+    s->num_events++;
+}
+
+Timer *roomba_timer(Sim *s, RoombaTimer kind, int i)
+{
+    return &s->wheel.timers[ROOMBA_TIMER(kind, i)];
+}
+
+r32 compute_hover_voltage(const Sim *s)
+{
+    return sqrt(0.5f*(s->player.mass+s->pendulum.mass)*s->world.g/s->player.motor_constant);
+}
+
+r32 voltage_to_force_magnitude(const Player *player, r32 voltage)
+{
+    return player->motor_constant*voltage*voltage;
+}
+
+// Changes the constants of a session in progress. Timers that are
+// running keep their old duration until they start again.
+void sim_set_params(Sim *s, const SimParams *params)
+{
+    Player &player = s->player;
+    PlayerPendulumLink &spring = s->spring;
+    Pendulum &pendulum = s->pendulum;
+    Roombas &roombas = s->roombas;
+    World &world = s->world;
+    Timer *timers = s->timers;
+    {
+        world.floor_level = params->floor_level;
+        world.green_line = params->green_line;
+        world.red_line = params->red_line;
+        world.g = params->g;
+    }
+    {
+        spring.l0 = params->spring_l0;
+        spring.k = params->spring_k;
+        spring.d = params->spring_d;
+
+        pendulum.mass = params->pendulum_mass;
+        pendulum.radius = params->pendulum_radius;
+
+        player.mass = params->player_mass;
+        player.arm = params->player_arm;
+        player.inertia = player.mass*player.arm*player.arm;
+        player.motor_constant = params->motor_constant;
+
+        roombas.radius = params->roomba_radius;
+        roombas.speed = params->roomba_speed;
+        roombas.y = world.floor_level+0.2f;
+    }
+    {
+        TIMER_PLAYER_TIME.duration = params->session_time;
+        for (int kind = 0; kind < NUM_ROOMBA_TIMERS; kind++)
+        {
+            for (int i = 0; i < roombas.count; i++)
+                roomba_timer(s, (RoombaTimer)kind, i)->duration = params->roomba_timers[kind];
+        }
+    }
+    s->params = *params;
+}
+
+// roomba_count: Number of roombas in the arena, 1 to MAX_ROOMBAS
+// params: Optional, the defaults if not given
+void sim_init(Sim *s, const WindParams *wind_params, int roomba_count = 1, const SimParams *params = 0)
+{
+    SimParams defaults;
+    if (!params)
+    {
+        sim_defaults(&defaults);
+        params = &defaults;
+    }
+
+    Player &player = s->player;
+    PlayerPendulumLink &spring = s->spring;
+    Pendulum &pendulum = s->pendulum;
+    Roombas &roombas = s->roombas;
+    World &world = s->world;
+    Timer *timers = s->timers;
+    TimerWheel &wheel = s->wheel;
+    {
+        s->playing = true;
+        s->points = 0;
+        s->num_events = 0;
+        s->events_dropped = 0;
+        for (int i = 0; i < NUM_SIM_EVENTS; i++)
+            s->event_counts[i] = 0;
+    }
+    {
+        init_timer(&TIMER_PLAYER_TIME, params->session_time);
+        START_TIMER(TIMER_PLAYER_TIME);
+        timer_wheel_init(&wheel);
+        roombas.count = m_clamp(roomba_count, 1, MAX_ROOMBAS);
+        for (int i = 0; i < roombas.count; i++)
+        {
+            for (int kind = 0; kind < NUM_ROOMBA_TIMERS; kind++)
+                init_timer(roomba_timer(s, (RoombaTimer)kind, i), params->roomba_timers[kind], kind == ROOMBA_TURN);
+        }
+    }
+    {
+        sim_set_params(s, params);
+        world.right = +2.0f;
+        world.left = -2.0f;
+        world.top = +3.0f;
+        world.bottom = -1.0f;
+
+        player.l_motor = compute_hover_voltage(s);
+        player.r_motor = player.l_motor;
+
+        roombas.dy0 = -0.1f;
+        roombas.dy1 = +0.1f;
+        roombas.dy2 = 0.4f;
+    }
+    {
+        player.theta = 0.0f;
+        player.Dtheta = 0.0f;
+        player.position = m_vec2(0.0f, 2.0f);
+        player.Dposition = m_vec2(0.0f, 0.0f);
+
+        pendulum.position = m_vec2(player.position.x, player.position.y-spring.l0);
+        pendulum.Dposition = m_vec2(0.0f, 0.0f);
+
+        // The others are spread out over the field by the golden ratio,
+        // alternate between heading left and right, and turn at
+        // different times.
+        for (int i = 0; i < roombas.count; i++)
+        {
+            r32 spread = 0.618034f*i - (int)(0.618034f*i);
+            r32 offset = spread < 0.5f ? spread : spread-1.0f;
+            r32 direction = i % 2 == 0 ? -1.0f : +1.0f;
+            roombas.x[i] = offset*(world.green_line-world.red_line-2.0f*roombas.radius);
+            roombas.direction[i] = direction;
+            roombas.Rdirection[i] = direction;
+            roombas.x0[i] = 0.0f;
+            Timer *turn = roomba_timer(s, ROOMBA_TURN, i);
+            if (i == 0)
+                timer_wheel_start(&wheel, turn);
+            else
+                timer_wheel_start_at(&wheel, turn, turn->duration*(1.0f-spread));
+            roombas.near[i] = false;
+        }
+        roomba_grid_build(&roombas);
+
+        s->wind.params = *wind_params;
+        s->wind.time = 0.0f;
+        s->wind.at_player = m_vec2(0.0f, 0.0f);
+        s->wind.at_pendulum = m_vec2(0.0f, 0.0f);
+    }
+}
+
+// Flies the player instead of the keys, by choosing the motor voltages
+// from the state of the sim every tick. See control.cpp.
+typedef void ControlFunction(const Sim *s, const void *params, r32 *l_motor, r32 *r_motor);
+
+struct Controller
+{
+    ControlFunction *control;
+    const void *params;
+};
+
+// keys: SIM_KEY_* bits held during this tick
+// controller: Optional, sets the motors instead of the keys
+void sim_step(Sim *s, u32 keys, r32 delta_time, const Controller *controller = 0)
+{
+    Player &player = s->player;
+    PlayerPendulumLink &spring = s->spring;
+    Pendulum &pendulum = s->pendulum;
+    Roombas &roombas = s->roombas;
+    World &world = s->world;
+    Timer *timers = s->timers;
+    TimerWheel &wheel = s->wheel;
+    Wind &wind = s->wind;
+
+    #if defined(DETERMINISTIC_PHYSICS) && defined(SO_MATH_SSE)
+    // Round to nearest, denormals kept, all exceptions masked. Writing
+    // the control register is slow, so only do it if the caller changed
+    // it. The low six bits are sticky exception flags, not settings.
+    unsigned int caller_csr = _mm_getcsr();
+    bool set_csr = (caller_csr & ~0x3fu) != SIM_CSR;
+    if (set_csr)
+        _mm_setcsr(SIM_CSR);
+    #endif
+
+    s->num_events = 0;
+
+    // update timers
+    {
+        for (int i = 0; i < NUM_TIMERS; i++)
+        {
+            update_timer(&timers[i], delta_time);
+        }
+        timer_wheel_step(&wheel, delta_time);
+    }
+
+    ON_TIMER_SUCCESS(TIMER_PLAYER_TIME)
+    {
+        s->playing = false;
+        sim_emit(s, SIM_EVENT_TIME_UP);
+    }
+
+    // controller input
+    if (s->playing && controller)
+    {
+        controller->control(s, controller->params, &player.l_motor, &player.r_motor);
+        player.l_motor = m_clamp(player.l_motor, 0.0f, 1.0f);
+        player.r_motor = m_clamp(player.r_motor, 0.0f, 1.0f);
+    }
+
+    // key input
+    else if (s->playing)
+    {
+        r32 hover_voltage = compute_hover_voltage(s);
+        r32 dl = 0.0f;
+        r32 dr = 0.0f;
+        if (keys & SIM_KEY_LEFT)
+        {
+            dl -= 0.05f;
+            dr += 0.05f;
+        }
+        if (keys & SIM_KEY_RIGHT)
+        {
+            dl += 0.05f;
+            dr -= 0.05f;
+        }
+        if (keys & SIM_KEY_UP)
+        {
+            dl += 0.05f;
+            dr += 0.05f;
+        }
+        if (keys & SIM_KEY_DOWN)
+        {
+            dl -= 0.05f;
+            dr -= 0.05f;
+        }
+        player.l_motor = hover_voltage+dl;
+        player.r_motor = hover_voltage+dr;
+        if (player.l_motor > 1.0f) player.l_motor = 1.0f;
+        if (player.l_motor < 0.0f) player.l_motor = 0.0f;
+        if (player.r_motor > 1.0f) player.r_motor = 1.0f;
+        if (player.r_motor < 0.0f) player.r_motor = 0.0f;
+    }
+
+    // spring force
+    r32 spring_f = 0.0f;
+    {
+        r32 xa = player.position.x;
+        r32 xb = pendulum.position.x;
+        r32 Dxa = player.Dposition.x;
+        r32 Dxb = pendulum.Dposition.x;
+        r32 ya = player.position.y;
+        r32 yb = pendulum.position.y;
+        r32 Dya = player.Dposition.y;
+        r32 Dyb = pendulum.Dposition.y;
+        r32 l = sqrt((xa-xb)*(xa-xb) + (ya-yb)*(ya-yb));
+        r32 Dl = ((xa-xb)*(Dxa-Dxb) + (ya-yb)*(Dya-Dyb)) / l;
+        spring_f = spring.k*(l-spring.l0) + spring.d*Dl;
+    }
+
+    vec2 v_player_to_pendulum = pendulum.position-player.position;
+    r32 distance = m_length(v_player_to_pendulum);
+    if (distance > 0.01f)
+        v_player_to_pendulum /= distance;
+    vec2 v_pendulum_to_player = -v_player_to_pendulum;
+
+    // wind, sampled once per step where the two bodies are
+    vec2 player_wind;
+    vec2 pendulum_wind;
+    {
+        wind.time += delta_time;
+        wind_sample(&wind.params, wind.time, player.position, pendulum.position,
+                    &wind.at_player, &wind.at_pendulum);
+        player_wind = wind_force(wind.at_player, player.Dposition, wind.params.player_drag);
+        pendulum_wind = wind_force(wind.at_pendulum, pendulum.Dposition, wind.params.pendulum_drag);
+    }
+
+    // update player
+    {
+        r32 dt = delta_time;
+        vec2 tangent;
+        m_sincos(player.theta, &tangent.y, &tangent.x);
+        vec2 normal = m_vec2(-tangent.y, tangent.x);
+        r32 l_magnitude = voltage_to_force_magnitude(&player, player.l_motor);
+        r32 r_magnitude = voltage_to_force_magnitude(&player, player.r_motor);
+        vec2 l_force = l_magnitude*normal;
+        vec2 r_force = r_magnitude*normal;
+
+        if (player.position.y+player.arm*tangent.y < world.floor_level)
+        {
+            r_force.y += 1000.0f*(world.floor_level-player.position.y-player.arm*tangent.y);
+        }
+        if (player.position.y-player.arm*tangent.y < world.floor_level)
+        {
+            l_force.y += 1000.0f*(world.floor_level-player.position.y+player.arm*tangent.y);
+        }
+
+        vec2 s_force = spring_f*v_player_to_pendulum;
+        vec2 g_force = m_vec2(0.0f, -player.mass*world.g);
+        vec2 sum_forces = l_force+r_force+g_force+s_force+player_wind;
+
+        vec2 DDposition = sum_forces / player.mass;
+        player.Dposition += DDposition * dt;
+        player.position += player.Dposition * dt;
+
+        r32 DDtheta = player.arm * (r_magnitude-l_magnitude) / player.inertia;
+        player.Dtheta += DDtheta * dt;
+        player.theta += player.Dtheta * dt;
+
+        if (player.position.x > world.green_line+3.0f ||
+            player.position.x < world.red_line-3.0f ||
+            player.position.y < world.floor_level-2.0f ||
+            player.position.y > 3.0f)
+        {
+            player.theta = 0.0f;
+            player.Dtheta = 0.0f;
+            player.position = m_vec2(0.0f, 2.0f);
+            player.Dposition = m_vec2(0.0f, 0.0f);
+
+            pendulum.position = m_vec2(player.position.x, player.position.y-spring.l0);
+            pendulum.Dposition = m_vec2(0.0f, 0.0f);
+            sim_emit(s, SIM_EVENT_PLAYER_RESET);
+        }
+    }
+
+    // update pendulum
+    {
+        r32 dt = delta_time;
+        vec2 s_force = spring_f*v_pendulum_to_player;
+        vec2 g_force = m_vec2(0.0f, -pendulum.mass*world.g);
+        vec2 n_force = m_vec2(0.0f, 0.0f);
+
+        // contact forces
+        {
+            r32 ay = pendulum.position.y-pendulum.radius;
+            r32 by = world.floor_level;
+            r32 cy = roombas.y+roombas.dy1;
+            if (ay < by)
+            {
+                n_force.y = 50.0f*(by-ay);
+            }
+            if (ay < cy && roomba_grid_any(&roombas, pendulum.position.x, roombas.radius))
+            {
+                n_force.y = 50.0f*(cy-ay);
+            }
+        }
+        vec2 delta_v = pendulum.Dposition - player.Dposition;
+        vec2 f_force = -0.1f*delta_v*m_length(delta_v);
+        vec2 sum_forces = g_force+s_force+f_force+n_force+pendulum_wind;
+
+        vec2 DDposition = sum_forces / pendulum.mass;
+        pendulum.Dposition += DDposition * dt;
+        pendulum.position += pendulum.Dposition * dt;
+    }
+
+    // Roombas that may be under the pendulum once they have moved this
+    // tick. The grid still has them where they were, so look a step
+    // further than their radius.
+    int near[MAX_ROOMBAS];
+    int num_near = 0;
+    if (pendulum.position.y > roombas.y+roombas.dy1 &&
+        pendulum.position.y-pendulum.radius < roombas.y+roombas.dy2)
+    {
+        r32 reach = roombas.radius+roombas.speed*delta_time+0.01f;
+        num_near = roomba_grid_query(&roombas, pendulum.position.x-reach,
+                                     pendulum.position.x+reach, near);
+        for (int k = 0; k < num_near; k++)
+            roombas.near[near[k]] = true;
+    }
+
+    // update roombas
+    for (int i = 0; i < roombas.count; i++)
+    {
+        Timer &turn = wheel.timers[ROOMBA_TIMER(ROOMBA_TURN, i)];
+        Timer &magnet = wheel.timers[ROOMBA_TIMER(ROOMBA_MAGNET, i)];
+        Timer &celebration = wheel.timers[ROOMBA_TIMER(ROOMBA_CELEBRATION, i)];
+        Timer &red_capture = wheel.timers[ROOMBA_TIMER(ROOMBA_RED_CAPTURE, i)];
+        Timer &green_capture = wheel.timers[ROOMBA_TIMER(ROOMBA_GREEN_CAPTURE, i)];
+        Timer &lose = wheel.timers[ROOMBA_TIMER(ROOMBA_LOSE, i)];
+        Timer &win = wheel.timers[ROOMBA_TIMER(ROOMBA_WIN, i)];
+
+        r32 x = roombas.x[i];
+        r32 direction = roombas.direction[i];
+        r32 Rdirection = roombas.Rdirection[i];
+
+        x += direction*roombas.speed*delta_time;
+        ON_TIMER_SUCCESS(turn)
+        {
+            Rdirection *= -1.0f;
+            sim_emit(s, SIM_EVENT_ROOMBA_TURN, i);
+        }
+        direction += 5.0f*(Rdirection-direction)*delta_time;
+
+        if (roombas.near[i] && m_abs(pendulum.position.x-x) < roombas.radius)
+        {
+            if (celebration.state != TIMER_ACTIVE)
+            {
+                timer_wheel_start(&wheel, &magnet);
+            }
+        }
+        else
+        {
+            timer_wheel_abort(&wheel, &magnet);
+        }
+
+        ON_TIMER_SUCCESS(magnet)
+        {
+            timer_wheel_start(&wheel, &celebration);
+            Rdirection *= -1.0f;
+            sim_emit(s, SIM_EVENT_MAGNET, i);
+        }
+
+        // Red field
+        {
+            if (x - roombas.radius < world.red_line &&
+                lose.state != TIMER_ACTIVE)
+            {
+                timer_wheel_start(&wheel, &red_capture);
+            }
+            else
+            {
+                timer_wheel_abort(&wheel, &red_capture);
+            }
+
+            ON_TIMER_SUCCESS(red_capture)
+            {
+                timer_wheel_start(&wheel, &lose);
+                if (s->playing)
+                    s->points--;
+                sim_emit(s, SIM_EVENT_ROOMBA_LOSE, i);
+            }
+
+            DURING_TIMER(lose)
+            {
+                ON_TIMER_BEGIN(lose)
+                {
+                    roombas.x0[i] = x;
+                }
+                r32 t = timer_progress(&wheel, &lose);
+                x = roombas.x0[i] - 32.0f*m_smoothstep(0.0f, 1.0f, t);
+            }
+
+            ON_TIMER_SUCCESS(lose)
+            {
+                x = 0.0f;
+                sim_emit(s, SIM_EVENT_ROOMBA_RETURN, i);
+            }
+        }
+
+        // Green field
+        {
+            if (x + roombas.radius > world.green_line &&
+                win.state != TIMER_ACTIVE)
+            {
+                timer_wheel_start(&wheel, &green_capture);
+            }
+            else
+            {
+                timer_wheel_abort(&wheel, &green_capture);
+            }
+
+            ON_TIMER_SUCCESS(green_capture)
+            {
+                timer_wheel_start(&wheel, &win);
+                if (s->playing)
+                    s->points++;
+                sim_emit(s, SIM_EVENT_ROOMBA_WIN, i);
+            }
+
+            DURING_TIMER(win)
+            {
+                ON_TIMER_BEGIN(win)
+                {
+                    roombas.x0[i] = x;
+                }
+                r32 t = timer_progress(&wheel, &win);
+                x = roombas.x0[i] + 32.0f*m_smoothstep(0.0f, 1.0f, t);
+
+                // Scoring buys back time, while the roomba is leaving.
+                // With more roombas there are more wins, so each buys
+                // back less, or a crowded session would never end.
+                TIMER_PLAYER_TIME.t += 16.0f*delta_time/roombas.count;
+            }
+
+            ON_TIMER_SUCCESS(win)
+            {
+                x = 0.0f;
+                sim_emit(s, SIM_EVENT_ROOMBA_RETURN, i);
+            }
+        }
+
+        roombas.x[i] = x;
+        roombas.direction[i] = direction;
+        roombas.Rdirection[i] = Rdirection;
+        roomba_grid_move(&roombas, i);
+    }
+    for (int k = 0; k < num_near; k++)
+        roombas.near[near[k]] = false;
+
+    #if defined(DETERMINISTIC_PHYSICS) && defined(SO_MATH_SSE)
+    if (set_csr)
+        _mm_setcsr(caller_csr);
+    #endif
+}
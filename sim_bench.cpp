@@ -0,0 +1,161 @@
+// sim_bench: times sim_step headless.
+//
+// Records random sessions, like verify --generate, and then times
+// playing them again, so that only sim_step is measured. Build it with
+// and without DETERMINISTIC_PHYSICS, and with other compilers and
+// flags, to see what the deterministic mode costs. The state hash is
+// taken over the points and the final positions of every session, and
+// must be the same for every deterministic build, on any machine.
+//
+//    $ g++ -O2 ../sim_bench.cpp -o sim_bench
+//    $ g++ -O2 -DDETERMINISTIC_PHYSICS ../sim_bench.cpp -o sim_bench_det
+//    $ g++ -O2 -march=native -DDETERMINISTIC_PHYSICS ../sim_bench.cpp -o sim_bench_native
+//    $ ./sim_bench --sessions 200 --runs 5
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#include "highscore.cpp"
+#include "wind.cpp"
+#include "sim.cpp"
+#include "replay.cpp"
+
+#define BENCH_SEED 0x73696d62656e6368
+
+// A player that holds a random key combination for 1-32 ticks at a
+// time, like verify --generate.
+void bench_record(int index, const WindParams *wind, int roombas, Replay *replay, Sim *sim)
+{
+    sim_init(sim, wind, roombas);
+    replay_begin(replay, wind, roombas);
+    RngKey key = rng_key(BENCH_SEED);
+    u32 keys = 0;
+    int hold = 0;
+    for (u64 draw = 0; sim->playing && replay->ticks < REPLAY_MAX_TICKS; )
+    {
+        if (hold == 0)
+        {
+            u32 r = rng_u32(key, (u64)index, draw++);
+            keys = r & 15;
+            hold = 1+((r >> 4) & 31);
+        }
+        replay_record(replay, keys);
+        sim_step(sim, keys, REPLAY_DT);
+        hold--;
+    }
+}
+
+u64 bench_hash(u64 hash, const void *data, size_t size)
+{
+    const u08 *bytes = (const u08*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+int main(int argc, char **argv)
+{
+    int sessions = 200;
+    int runs = 5;
+    int roombas = 1;
+    r32 wind = 0.0f;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--sessions") == 0 && i+1 < argc)
+            sessions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i+1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roombas") == 0 && i+1 < argc)
+            roombas = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--wind") == 0 && i+1 < argc)
+            wind = (r32)atof(argv[++i]);
+        else
+        {
+            printf("usage: sim_bench [--sessions n] [--runs n] [--roombas n] [--wind intensity]\n");
+            return 1;
+        }
+    }
+    if (sessions < 1)
+        sessions = 1;
+    if (runs < 1)
+        runs = 1;
+    if (roombas < 1 || roombas > MAX_ROOMBAS)
+    {
+        printf("--roombas must be from 1 to %d\n", MAX_ROOMBAS);
+        return 1;
+    }
+
+    WindParams params;
+    wind_defaults(&params);
+    if (wind > 0.0f)
+    {
+        params.intensity = wind;
+        wind_air(&params);
+    }
+
+    // Too large for the stack
+    Replay *replays = (Replay*)malloc(sessions*sizeof(Replay));
+    Sim *sim = (Sim*)malloc(sizeof(Sim));
+    if (!replays || !sim)
+    {
+        printf("Out of memory for %d sessions\n", sessions);
+        return 1;
+    }
+    u64 ticks = 0;
+    for (int i = 0; i < sessions; i++)
+    {
+        bench_record(i, &params, roombas, &replays[i], sim);
+        ticks += (u64)replays[i].ticks;
+    }
+
+    #ifdef DETERMINISTIC_PHYSICS
+    const char *mode = "deterministic";
+    #else
+    const char *mode = "not deterministic";
+    #endif
+    printf("%d sessions, %llu ticks, %d roombas, wind %g, %s\n",
+           sessions, (unsigned long long)ticks, roombas, wind, mode);
+
+    r32 best = 1e9f;
+    r32 total = 0.0f;
+    u64 hash = 0xcbf29ce484222325ull;
+    for (int run = 0; run < runs; run++)
+    {
+        u64 begin = perf_counter();
+        for (int i = 0; i < sessions; i++)
+        {
+            replay_run(&replays[i], sim);
+            if (run == 0)
+            {
+                hash = bench_hash(hash, &sim->points, sizeof(sim->points));
+                hash = bench_hash(hash, &sim->player.position, sizeof(sim->player.position));
+                hash = bench_hash(hash, &sim->pendulum.position, sizeof(sim->pendulum.position));
+            }
+        }
+        r32 t = time_since(begin);
+        total += t;
+        best = t < best ? t : best;
+    }
+    printf("  %.1f ns per step mean, %.1f ns best, over %d runs\n",
+           1e9f*total/runs/ticks, 1e9f*best/ticks, runs);
+    printf("  state hash %016llx\n", (unsigned long long)hash);
+    free(replays);
+    free(sim);
+    return 0;
+}
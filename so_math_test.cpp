@@ -0,0 +1,412 @@
+// so_math_test: checks lib/so_math.h and times it.
+//
+// The SSE and AVX overloads for vec4 and mat4 must give what the
+// generic templates give, which they are compared against on random
+// inputs and on every pattern of +0 and -0, bit for bit except for
+// m_dot, which adds in another order.
+// Both are then timed on batches of products. Build with -mavx for the
+// AVX mat4 product, and with -DSO_MATH_NO_SIMD to time the templates
+// against themselves.
+//
+// The approximations (m_sincos, m_rsqrt, m_sqrt, m_exp) are checked
+// against libm, in double, over every float in the ranges their errors
+// are documented for in so_math.h, and must stay within those errors.
+// That takes a few minutes per core. SO_MATH_APPROX picks the level
+// that is checked. --step n checks every nth float, for a quick run.
+//
+//    $ g++ -O2 ../so_math_test.cpp -o so_math_test -pthread
+//    $ g++ -O2 -mavx ../so_math_test.cpp -o so_math_test_avx -pthread
+//    $ g++ -O2 -DSO_MATH_APPROX=0 ../so_math_test.cpp -o so_math_test_0 -pthread
+//    $ ./so_math_test
+//    $ ./so_math_test --step 101 --threads 4
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#define TEST_SEED   0x736f6d617468
+#define TEST_TRIALS 100000
+#define BENCH_COUNT 4096
+#define BENCH_ITERATIONS 2000
+#define APPROX_CHUNK (1 << 20) // Floats handed to a thread at a time
+#define APPROX_MAX_THREADS 64
+
+RngKey test_key;
+u64 test_draw;
+int test_failures;
+
+r32 test_random()
+{
+    return -10.0f + 20.0f*(rng_u32(test_key, 0, test_draw++) >> 8) / 16777216.0f;
+}
+
+vec4 test_random_vec4()
+{
+    vec4 v;
+    for (int i = 0; i < 4; i++)
+        v.data[i] = test_random();
+    return v;
+}
+
+mat4 test_random_mat4()
+{
+    mat4 m;
+    for (int i = 0; i < 16; i++)
+        m.data[i] = test_random();
+    return m;
+}
+
+// Reports each kind of mismatch once
+void test_check(const char *name, bool same, int *failed)
+{
+    if (!same && (*failed)++ == 0)
+    {
+        printf("%s differs from the generic template\n", name);
+        test_failures++;
+    }
+}
+
+// Bit for bit, so that -0 and +0 differ
+bool test_same(const float *a, const float *b, int n)
+{
+    return memcmp(a, b, n*sizeof(float)) == 0;
+}
+
+// The generic templates, called with explicit arguments so that the
+// SIMD overloads are not considered.
+void test_agreement()
+{
+    int failed[13] = {};
+    for (int trial = 0; trial < TEST_TRIALS; trial++)
+    {
+        vec4 a = test_random_vec4();
+        vec4 b = test_random_vec4();
+        mat4 m = test_random_mat4();
+        mat4 n = test_random_mat4();
+        r32 s = test_random();
+        vec4 v;
+        mat4 p;
+
+        v = a+b; test_check("vec4+vec4", test_same(v.data, operator+<float, 4>(a, b).data, 4), &failed[0]);
+        v = a-b; test_check("vec4-vec4", test_same(v.data, operator-<float, 4>(a, b).data, 4), &failed[1]);
+        v = a*b; test_check("vec4*vec4", test_same(v.data, operator*<float, 4>(a, b).data, 4), &failed[2]);
+        v = a/b; test_check("vec4/vec4", test_same(v.data, operator/<float, 4>(a, b).data, 4), &failed[3]);
+        v = a*s; test_check("vec4*float", test_same(v.data, operator*<float, 4>(a, s).data, 4), &failed[4]);
+        v = s*a; test_check("float*vec4", test_same(v.data, operator*<float, 4>(s, a).data, 4), &failed[5]);
+        v = -a;  test_check("-vec4", test_same(v.data, operator-<float, 4>(a).data, 4), &failed[6]);
+
+        // Pairwise instead of left to right, so only to rounding
+        r32 dot = m_dot(a, b);
+        r32 generic = m_dot<float, 4>(a, b);
+        r32 bound = 4.0f*1.2e-7f*(m_abs(a.x*b.x)+m_abs(a.y*b.y)+m_abs(a.z*b.z)+m_abs(a.w*b.w));
+        test_check("m_dot(vec4, vec4)", m_abs(dot-generic) <= bound, &failed[7]);
+
+        v = m*a; test_check("mat4*vec4", test_same(v.data, operator*<float, 4, 4>(m, a).data, 4), &failed[8]);
+        p = m*n; test_check("mat4*mat4", test_same(p.data, operator*<float, 4, 4, 4>(m, n).data, 16), &failed[9]);
+        p = m+n; test_check("mat4+mat4", test_same(p.data, operator+<float, 4, 4>(m, n).data, 16), &failed[10]);
+        p = m*s; test_check("mat4*float", test_same(p.data, operator*<4, 4>(m, s).data, 16), &failed[11]);
+        p = m_transpose(m);
+        test_check("m_transpose(mat4)", test_same(p.data, m_transpose<float, 4, 4>(m).data, 16), &failed[12]);
+    }
+}
+
+// Every pattern of +0 and -0 in a and b, with the same checks. Random
+// inputs are never zero, and the sign of a zero result depends on how
+// it was computed, e.g. 0 - 0 is +0 while -(+0) is -0. a/b is left
+// out, since it would be NaN, and so are the matrix products: the
+// templates start their sums from +0, so a sum of -0 products is +0
+// there and -0 in SIMD, and neither is wrong.
+void test_signed_zeros()
+{
+    int failed[8] = {};
+    for (int pattern = 0; pattern < 256; pattern++)
+    {
+        vec4 a, b;
+        mat4 m, n;
+        for (int i = 0; i < 4; i++)
+        {
+            a.data[i] = (pattern >> i) & 1 ? -0.0f : 0.0f;
+            b.data[i] = (pattern >> (4+i)) & 1 ? -0.0f : 0.0f;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            m.data[i] = a.data[i % 4]*(i & 4 ? -1.0f : 1.0f);
+            n.data[i] = b.data[i % 4]*(i & 8 ? -1.0f : 1.0f);
+        }
+        r32 s = pattern & 1 ? -0.0f : 0.0f;
+        vec4 v;
+        mat4 p;
+
+        v = a+b; test_check("vec4+vec4 of zeros", test_same(v.data, operator+<float, 4>(a, b).data, 4), &failed[0]);
+        v = a-b; test_check("vec4-vec4 of zeros", test_same(v.data, operator-<float, 4>(a, b).data, 4), &failed[1]);
+        v = a*b; test_check("vec4*vec4 of zeros", test_same(v.data, operator*<float, 4>(a, b).data, 4), &failed[2]);
+        v = a*s; test_check("vec4*float of zeros", test_same(v.data, operator*<float, 4>(a, s).data, 4), &failed[3]);
+        v = s*a; test_check("float*vec4 of zeros", test_same(v.data, operator*<float, 4>(s, a).data, 4), &failed[4]);
+        v = -a;  test_check("-vec4 of zeros", test_same(v.data, operator-<float, 4>(a).data, 4), &failed[5]);
+        p = m+n; test_check("mat4+mat4 of zeros", test_same(p.data, operator+<float, 4, 4>(m, n).data, 16), &failed[6]);
+        p = m*s; test_check("mat4*float of zeros", test_same(p.data, operator*<4, 4>(m, s).data, 16), &failed[7]);
+    }
+}
+
+// Sums the results so that the products are not optimized away
+r32 test_sum(const float *x, int n)
+{
+    r32 sum = 0.0f;
+    for (int i = 0; i < n; i++)
+        sum += x[i];
+    return sum;
+}
+
+void test_timing()
+{
+    mat4 *a = (mat4*)malloc(BENCH_COUNT*sizeof(mat4));
+    mat4 *b = (mat4*)malloc(BENCH_COUNT*sizeof(mat4));
+    mat4 *p = (mat4*)malloc(BENCH_COUNT*sizeof(mat4));
+    vec4 *x = (vec4*)malloc(BENCH_COUNT*sizeof(vec4));
+    vec4 *y = (vec4*)malloc(BENCH_COUNT*sizeof(vec4));
+    for (int i = 0; i < BENCH_COUNT; i++)
+    {
+        a[i] = test_random_mat4();
+        b[i] = test_random_mat4();
+        x[i] = test_random_vec4();
+    }
+
+    u64 begin = perf_counter();
+    for (int k = 0; k < BENCH_ITERATIONS; k++)
+        for (int i = 0; i < BENCH_COUNT; i++)
+            p[i] = operator*<float, 4, 4, 4>(a[i], b[i]);
+    r32 generic_mm = time_since(begin);
+    r32 check = test_sum(p[0].data, 16);
+
+    begin = perf_counter();
+    for (int k = 0; k < BENCH_ITERATIONS; k++)
+        for (int i = 0; i < BENCH_COUNT; i++)
+            p[i] = a[i]*b[i];
+    r32 simd_mm = time_since(begin);
+    check += test_sum(p[0].data, 16);
+
+    begin = perf_counter();
+    for (int k = 0; k < BENCH_ITERATIONS; k++)
+        for (int i = 0; i < BENCH_COUNT; i++)
+            y[i] = operator*<float, 4, 4>(a[i], x[i]);
+    r32 generic_mv = time_since(begin);
+    check += test_sum(y[0].data, 4);
+
+    begin = perf_counter();
+    for (int k = 0; k < BENCH_ITERATIONS; k++)
+        for (int i = 0; i < BENCH_COUNT; i++)
+            y[i] = a[i]*x[i];
+    r32 simd_mv = time_since(begin);
+    check += test_sum(y[0].data, 4);
+
+    #if defined(SO_MATH_AVX)
+    const char *simd = "AVX";
+    #elif defined(SO_MATH_SSE)
+    const char *simd = "SSE";
+    #else
+    const char *simd = "generic";
+    #endif
+    printf("%d x %d products (%g)\n", BENCH_ITERATIONS, BENCH_COUNT, check);
+    printf("  mat4*mat4  generic %6.1f ms  %-7s %6.1f ms\n", 1000.0f*generic_mm, simd, 1000.0f*simd_mm);
+    printf("  mat4*vec4  generic %6.1f ms  %-7s %6.1f ms\n", 1000.0f*generic_mv, simd, 1000.0f*simd_mv);
+    free(a);
+    free(b);
+    free(p);
+    free(x);
+    free(y);
+}
+
+// The errors as measured by this test, rounded up, for SO_MATH_APPROX
+// 0, 1 and 2. They are the ones listed in so_math.h. m_sqrt is sqrtf
+// at level 2, which is correctly rounded.
+struct ApproxTest
+{
+    const char *name;
+    const char *error;
+    double (*measure)(float x);
+    double bound[3];
+    u32 ranges[4][2]; // Inclusive ranges of float bits, 0 terminated
+};
+
+double approx_sincos(float x)
+{
+    float s, c;
+    m_sincos(x, &s, &c);
+    double es = fabs((double)s - sin((double)x));
+    double ec = fabs((double)c - cos((double)x));
+    return es > ec ? es : ec;
+}
+
+double approx_rsqrt(float x)
+{
+    double exact = 1.0/sqrt((double)x);
+    return fabs((double)m_rsqrt(x) - exact)/exact;
+}
+
+double approx_sqrt(float x)
+{
+    double exact = sqrt((double)x);
+    return fabs((double)m_sqrt(x) - exact)/exact;
+}
+
+double approx_exp(float x)
+{
+    double exact = exp((double)x);
+    return fabs((double)m_exp(x) - exact)/exact;
+}
+
+// 0x45800000 is 4096, 0x0da24260 is 1e-30, 0x7149f2ca is 1e30,
+// 0xc2ae0000 is -87 and 0x42b00000 is 88.
+ApproxTest approx_tests[] = {
+    { "m_sincos", "abs.", approx_sincos, { 2.61e-4, 3.68e-6, 1.53e-7 },
+      { { 0x00000000, 0x45800000 }, { 0x80000000, 0xc5800000 } } },
+    { "m_rsqrt", "rel.", approx_rsqrt, { 1.76e-3, 4.74e-6, 1.48e-7 },
+      { { 0x0da24260, 0x7149f2ca } } },
+    { "m_sqrt", "rel.", approx_sqrt, { 1.76e-3, 4.77e-6, 5.97e-8 },
+      { { 0x0da24260, 0x7149f2ca } } },
+    { "m_exp", "rel.", approx_exp, { 7.95e-4, 5.58e-5, 1.20e-7 },
+      { { 0x00000000, 0x42b00000 }, { 0x80000000, 0xc2ae0000 } } },
+};
+
+struct ApproxJob
+{
+    const ApproxTest *test;
+    u64 first[4]; // Index of the first float of each range in the whole
+    u64 count;    // Number of floats in all ranges
+    u64 step;
+    std::atomic<u64> next;
+    double max_error[APPROX_MAX_THREADS];
+    float worst[APPROX_MAX_THREADS];
+};
+
+void approx_worker(ApproxJob *job, int thread)
+{
+    double max_error = 0.0;
+    float worst = 0.0f;
+    for (;;)
+    {
+        u64 begin = job->next.fetch_add(APPROX_CHUNK);
+        if (begin >= job->count)
+            break;
+        u64 end = begin+APPROX_CHUNK < job->count ? begin+APPROX_CHUNK : job->count;
+        int range = 0;
+        for (u64 i = (begin + job->step-1)/job->step*job->step; i < end; i += job->step)
+        {
+            while (range < 3 && job->first[range+1] != 0 && i >= job->first[range+1])
+                range++;
+            float x = m_float_from_bits(job->test->ranges[range][0] + (u32)(i - job->first[range]));
+            double error = job->test->measure(x);
+            if (!(error <= max_error)) // Also catches NaN
+            {
+                max_error = error;
+                worst = x;
+            }
+        }
+    }
+    job->max_error[thread] = max_error;
+    job->worst[thread] = worst;
+}
+
+// return: false if an approximation exceeded its documented error
+bool test_approximations(u64 step, int threads)
+{
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads > APPROX_MAX_THREADS)
+        threads = APPROX_MAX_THREADS;
+    if (threads < 1)
+        threads = 1;
+
+    bool passed = true;
+    printf("Approximations at SO_MATH_APPROX %d, every %llu%s float, on %d threads\n",
+           SO_MATH_APPROX, (unsigned long long)step, step == 1 ? "" : "th", threads);
+    for (int t = 0; t < array_count(approx_tests); t++)
+    {
+        ApproxJob *job = new ApproxJob;
+        job->test = &approx_tests[t];
+        job->count = 0;
+        memset(job->first, 0, sizeof(job->first));
+        for (int r = 0; r < 4 && job->test->ranges[r][1] != 0; r++)
+        {
+            // Negative floats count up in magnitude too
+            u32 first = job->test->ranges[r][0];
+            u32 last = job->test->ranges[r][1];
+            job->first[r] = job->count;
+            job->count += (u64)(last - first) + 1;
+        }
+        job->step = step;
+        job->next = 0;
+
+        u64 begin = perf_counter();
+        std::thread workers[APPROX_MAX_THREADS];
+        for (int i = 1; i < threads; i++)
+            workers[i] = std::thread(approx_worker, job, i);
+        approx_worker(job, 0);
+        for (int i = 1; i < threads; i++)
+            workers[i].join();
+
+        double max_error = 0.0;
+        float worst = 0.0f;
+        for (int i = 0; i < threads; i++)
+        {
+            if (!(job->max_error[i] <= max_error))
+            {
+                max_error = job->max_error[i];
+                worst = job->worst[i];
+            }
+        }
+        double bound = job->test->bound[SO_MATH_APPROX];
+        bool within = max_error <= bound;
+        passed = passed && within;
+        printf("  %-8s %s error %.4g at x = %.9g, documented %.3g: %s (%.1f s)\n",
+               job->test->name, job->test->error, max_error, worst, bound,
+               within ? "passed" : "FAILED", time_since(begin));
+        delete job;
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    u64 step = 1;
+    int threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--step") == 0 && i+1 < argc)
+            step = (u64)atoll(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else
+        {
+            printf("usage: so_math_test [--step n] [--threads n]\n");
+            return 1;
+        }
+    }
+    if (step < 1)
+        step = 1;
+
+    test_key = rng_key(TEST_SEED);
+    test_agreement();
+    test_signed_zeros();
+    printf("SIMD against generic on %d random inputs and on signed zeros: %s\n",
+           TEST_TRIALS, test_failures ? "FAILED" : "passed");
+    test_timing();
+    if (!test_approximations(step, threads))
+        test_failures++;
+    return test_failures ? 1 : 0;
+}
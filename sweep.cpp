@@ -0,0 +1,471 @@
+// sweep: flies the autopilot over a grid of physical constants.
+//
+// Tuning the spring, the masses or the roombas means trying many
+// combinations of them. sweep reads a file that lists values for some
+// of the constants in SimParams, one constant per line, and for every
+// combination flies the autopilot in a batch of headless worlds on all
+// cores (see control.cpp). Constants that are not listed keep their
+// defaults. player.motor_constant does not follow the masses, so list
+// it too when sweeping those far from the defaults.
+//
+//    # springs.txt
+//    spring.k      20 40 80
+//    spring.d      0.5 1 2
+//    pendulum.mass 0.02:0.2:10    (10 evenly spaced values)
+//
+//    $ g++ -O2 ../sweep.cpp -o sweep -pthread
+//    $ ./sweep springs.txt springs.csv
+//    $ ./sweep --random 500 --worlds 16 springs.txt random.csv
+//
+// With --random, each listed constant is instead drawn uniformly
+// between the smallest and largest of its values, for the given number
+// of points. --worlds, --seconds, --roombas and --wind set up the
+// worlds that every point is flown in.
+//
+// Each point appends one row to the CSV file as soon as it is done: a
+// hash of everything the point depends on, the value of every constant,
+// then the mean over its worlds of
+//
+//   position_error  RMS distance of the player from the autopilot target, m
+//   swing           RMS horizontal offset of the pendulum, m
+//   stable          Fraction of worlds where the player never left the field
+//   energy          Squared motor voltages, summed over both motors
+//   wins, losses    Roombas captured at the green and red line
+//   magnets         Roombas turned with the magnet
+//
+// Points whose hash is already in the file are skipped. An interrupted
+// sweep picks up where it stopped, and growing a grid only flies the
+// new points. A row that was cut short, by a kill in the middle of
+// writing it, is not taken as done, and is cut from the file before
+// new rows are appended. Bump SWEEP_VERSION when the simulation, the autopilot or
+// the metrics change, so that old rows are no longer taken as done.
+#define DETERMINISTIC_PHYSICS
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#include "wind.cpp"
+#include "sim.cpp"
+#include "control.cpp"
+
+#define SWEEP_VERSION    2
+#define SWEEP_SEED       0x7377656570
+#define SWEEP_MAX_VALUES 256
+#define SWEEP_MAX_POINTS 10000000
+
+// The values listed for each constant, none if it keeps its default
+struct SweepSpec
+{
+    int count[NUM_SIM_PARAMS];
+    r32 values[NUM_SIM_PARAMS][SWEEP_MAX_VALUES];
+};
+
+bool sweep_add_value(SweepSpec *spec, int constant, r32 value)
+{
+    if (spec->count[constant] == SWEEP_MAX_VALUES)
+        return false;
+    spec->values[constant][spec->count[constant]++] = value;
+    return true;
+}
+
+// return: false if the file can not be read or has an error, which is
+//         printed.
+bool sweep_read_spec(const char *path, SweepSpec *spec)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+    memset(spec, 0, sizeof(SweepSpec));
+    char line[4096];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        const char *separators = " \t\r\n";
+        char *token = strtok(line, separators);
+        if (!token)
+            continue;
+
+        int constant = sim_find_param(token);
+        if (constant < 0)
+        {
+            printf("%s:%d: unknown constant %s\n", path, line_number, token);
+            ok = false;
+            break;
+        }
+        while (ok && (token = strtok(0, separators)))
+        {
+            // Either a value, or from:to:count
+            r32 from, to;
+            int count;
+            char end;
+            if (sscanf(token, "%f:%f:%d%c", &from, &to, &count, &end) == 3 && count >= 1)
+            {
+                for (int i = 0; i < count && ok; i++)
+                {
+                    r32 t = count > 1 ? i / (r32)(count-1) : 0.0f;
+                    ok = sweep_add_value(spec, constant, from+(to-from)*t);
+                }
+            }
+            else if (sscanf(token, "%f%c", &from, &end) == 1)
+            {
+                ok = sweep_add_value(spec, constant, from);
+            }
+            else
+            {
+                printf("%s:%d: expected a value or from:to:count, got %s\n", path, line_number, token);
+                ok = false;
+            }
+        }
+        if (ok && spec->count[constant] == 0)
+        {
+            printf("%s:%d: no values for %s\n", path, line_number, sim_param_info[constant].name);
+            ok = false;
+        }
+        else if (!ok && spec->count[constant] == SWEEP_MAX_VALUES)
+        {
+            printf("%s:%d: more than %d values\n", path, line_number, SWEEP_MAX_VALUES);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// Sets params to grid point number index, counting in the order of
+// sim_param_info with the first changing fastest.
+void sweep_grid_point(const SweepSpec *spec, u64 index, SimParams *params)
+{
+    sim_defaults(params);
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+    {
+        int count = spec->count[i];
+        if (count == 0)
+            continue;
+        *sim_param(params, i) = spec->values[i][index % count];
+        index /= count;
+    }
+}
+
+void sweep_random_point(const SweepSpec *spec, u64 seed, u64 index, SimParams *params)
+{
+    sim_defaults(params);
+    RngKey key = rng_key(SWEEP_SEED+seed);
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+    {
+        int count = spec->count[i];
+        if (count == 0)
+            continue;
+        r32 lo = spec->values[i][0];
+        r32 hi = lo;
+        for (int j = 1; j < count; j++)
+        {
+            lo = m_min(lo, spec->values[i][j]);
+            hi = m_max(hi, spec->values[i][j]);
+        }
+        *sim_param(params, i) = lo+(hi-lo)*rng_uniform(key, index, (u64)i);
+    }
+}
+
+// FNV-1a of the bits of everything that the results of a point depend on
+u64 sweep_hash(const ControlSetup *setup, int worlds)
+{
+    u32 words[64];
+    int n = 0;
+    words[n++] = SWEEP_VERSION;
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+        words[n++] = m_bits_from_float(sim_param(&setup->params, i));
+    const WindParams *w = &setup->wind;
+    r32 floats[] = {
+        w->intensity, w->mean.x, w->mean.y, w->gust, w->length_scale,
+        w->time_scale, w->player_drag, w->pendulum_drag,
+        setup->target.x, setup->target.y, setup->start_spread, setup->wind_spacing
+    };
+    for (int i = 0; i < array_count(floats); i++)
+        words[n++] = m_bits_from_float(floats[i]);
+    words[n++] = (u32)w->octaves;
+    words[n++] = (u32)setup->roombas;
+    words[n++] = (u32)setup->ticks;
+    words[n++] = (u32)worlds;
+
+    u64 hash = 0xcbf29ce484222325ull;
+    const u08 *bytes = (const u08*)words;
+    for (int i = 0; i < n*(int)sizeof(u32); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+int sweep_compare_hashes(const void *a, const void *b)
+{
+    u64 x = *(const u64*)a;
+    u64 y = *(const u64*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Columns of the header and of every row, see sweep_write_row
+#define SWEEP_COLUMNS (1+NUM_SIM_PARAMS+4+7)
+
+// Hashes of the points already in the output file, sorted
+struct SweepCache
+{
+    u64 *hashes;
+    int count;
+    long length; // Of the file up to the end of its last whole line
+};
+
+// return: false if the file exists but can not be read
+bool sweep_read_cache(const char *path, SweepCache *cache)
+{
+    cache->hashes = 0;
+    cache->count = 0;
+    cache->length = 0;
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return true;
+    int capacity = 0;
+    char line[4096];
+    bool continued = false;
+    while (fgets(line, sizeof(line), file))
+    {
+        // A line without its newline is either the end of a file that
+        // was cut short, or too long to be a row.
+        size_t n = strlen(line);
+        bool whole = n > 0 && line[n-1] == '\n';
+        bool skip = continued;
+        continued = !whole;
+        if (!whole || skip)
+            continue;
+        cache->length = ftell(file);
+
+        int columns = 1;
+        for (size_t i = 0; i < n; i++)
+            columns += line[i] == ',' ? 1 : 0;
+        unsigned long long hash;
+        char comma;
+        if (columns != SWEEP_COLUMNS ||
+            sscanf(line, "%16llx%c", &hash, &comma) != 2 || comma != ',')
+            continue; // The header, or a row from another version
+        if (cache->count == capacity)
+        {
+            capacity = capacity ? 2*capacity : 1024;
+            u64 *hashes = (u64*)realloc(cache->hashes, capacity*sizeof(u64));
+            if (!hashes)
+            {
+                fclose(file);
+                return false;
+            }
+            cache->hashes = hashes;
+        }
+        cache->hashes[cache->count++] = (u64)hash;
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    qsort(cache->hashes, cache->count, sizeof(u64), sweep_compare_hashes);
+    return ok;
+}
+
+bool sweep_cached(const SweepCache *cache, u64 hash)
+{
+    return cache->count > 0 &&
+           bsearch(&hash, cache->hashes, cache->count, sizeof(u64), sweep_compare_hashes) != 0;
+}
+
+void sweep_write_header(FILE *out)
+{
+    fprintf(out, "hash");
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+        fprintf(out, ",%s", sim_param_info[i].name);
+    fprintf(out, ",roombas,seconds,wind,worlds");
+    fprintf(out, ",position_error,swing,stable,energy,wins,losses,magnets\n");
+}
+
+void sweep_write_row(FILE *out, u64 hash, const ControlSetup *setup,
+                     const ControlTrial *trials, int worlds)
+{
+    r32 position_error = 0.0f;
+    r32 swing = 0.0f;
+    r32 energy = 0.0f;
+    int stable = 0;
+    int wins = 0;
+    int losses = 0;
+    int magnets = 0;
+    for (int i = 0; i < worlds; i++)
+    {
+        position_error += trials[i].position_error;
+        swing += trials[i].swing;
+        energy += trials[i].energy;
+        stable += trials[i].resets == 0 ? 1 : 0;
+        wins += trials[i].wins;
+        losses += trials[i].losses;
+        magnets += trials[i].magnets;
+    }
+    fprintf(out, "%016llx", (unsigned long long)hash);
+    for (int i = 0; i < NUM_SIM_PARAMS; i++)
+        fprintf(out, ",%g", sim_param(&setup->params, i));
+    fprintf(out, ",%d,%g,%g,%d", setup->roombas, setup->ticks*SIM_DT, setup->wind.intensity, worlds);
+    fprintf(out, ",%g,%g,%g,%g,%g,%g,%g\n",
+            position_error/worlds, swing/worlds, stable/(r32)worlds, energy/worlds,
+            wins/(r32)worlds, losses/(r32)worlds, magnets/(r32)worlds);
+}
+
+int main(int argc, char **argv)
+{
+    int worlds = 64;
+    r32 seconds = 10.0f;
+    int roombas = 1;
+    r32 wind = -1.0f; // Still air unless given, and then with drag
+    int threads = 0;
+    int random = 0;
+    u64 seed = 0;
+    const char *spec_path = 0;
+    const char *out_path = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--worlds") == 0 && i+1 < argc)
+            worlds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i+1 < argc)
+            seconds = (r32)atof(argv[++i]);
+        else if (strcmp(argv[i], "--roombas") == 0 && i+1 < argc)
+            roombas = m_clamp(atoi(argv[++i]), 1, MAX_ROOMBAS);
+        else if (strcmp(argv[i], "--wind") == 0 && i+1 < argc)
+            wind = (r32)atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--random") == 0 && i+1 < argc)
+            random = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+            seed = (u64)atoll(argv[++i]);
+        else if (!spec_path)
+            spec_path = argv[i];
+        else if (!out_path)
+            out_path = argv[i];
+        else
+            spec_path = 0;
+    }
+    if (!spec_path || !out_path || worlds < 1)
+    {
+        printf("usage: sweep [--worlds n] [--seconds s] [--roombas n] [--wind intensity]\n"
+               "             [--threads n] [--random points] [--seed n] spec output.csv\n");
+        return 1;
+    }
+
+    SweepSpec *spec = (SweepSpec*)malloc(sizeof(SweepSpec));
+    if (!spec || !sweep_read_spec(spec_path, spec))
+        return 1;
+    u64 points = 1;
+    for (int i = 0; i < NUM_SIM_PARAMS && points <= SWEEP_MAX_POINTS; i++)
+    {
+        if (spec->count[i] > 0)
+            points *= spec->count[i];
+    }
+    if (random > 0)
+        points = (u64)random;
+    if (points > SWEEP_MAX_POINTS)
+    {
+        printf("%s: more than %d points\n", spec_path, SWEEP_MAX_POINTS);
+        return 1;
+    }
+
+    SweepCache cache;
+    if (!sweep_read_cache(out_path, &cache))
+    {
+        printf("Failed to read %s\n", out_path);
+        return 1;
+    }
+    FILE *out = fopen(out_path, "a");
+    if (!out)
+    {
+        printf("Failed to open %s\n", out_path);
+        return 1;
+    }
+    fseek(out, 0, SEEK_END);
+    if (ftell(out) > cache.length)
+    {
+        // New rows would be joined onto the torn one
+        #ifdef _WIN32
+        int truncated = _chsize(_fileno(out), cache.length);
+        #else
+        int truncated = ftruncate(fileno(out), (off_t)cache.length);
+        #endif
+        if (truncated != 0)
+        {
+            printf("Failed to cut the torn last row from %s\n", out_path);
+            return 1;
+        }
+        printf("%s: cut a torn last row\n", out_path);
+        fseek(out, 0, SEEK_END);
+    }
+    if (ftell(out) == 0)
+        sweep_write_header(out);
+
+    ControlSetup setup;
+    control_setup_defaults(&setup);
+    setup.roombas = roombas;
+    setup.ticks = (int)(seconds/SIM_DT+0.5f);
+    if (wind >= 0.0f)
+    {
+        setup.wind.intensity = wind;
+        wind_air(&setup.wind);
+    }
+    Autopilot autopilot;
+    autopilot_defaults(&autopilot);
+    autopilot.target = setup.target;
+    Controller controller = autopilot_controller(&autopilot);
+    ControlTrial *trials = (ControlTrial*)malloc(worlds*sizeof(ControlTrial));
+
+    int flown = 0;
+    int skipped = 0;
+    u64 begin = perf_counter();
+    for (u64 point = 0; point < points; point++)
+    {
+        if (random > 0)
+            sweep_random_point(spec, seed, point, &setup.params);
+        else
+            sweep_grid_point(spec, point, &setup.params);
+        u64 hash = sweep_hash(&setup, worlds);
+        if (sweep_cached(&cache, hash))
+        {
+            skipped++;
+            continue;
+        }
+        control_evaluate_batch(&controller, &setup, worlds, trials, threads);
+        sweep_write_row(out, hash, &setup, trials, worlds);
+        fflush(out);
+        flown++;
+    }
+    r32 elapsed = time_since(begin);
+    fclose(out);
+    printf("%s: %d points flown, %d already done, in %.2f s (%.0f worlds per second)\n",
+           out_path, flown, skipped, elapsed, elapsed > 0.0f ? flown*worlds/elapsed : 0.0f);
+    free(spec);
+    free(cache.hashes);
+    free(trials);
+    return 0;
+}
@@ -0,0 +1,341 @@
+// Leaderboard sync
+//
+// Saved scores are uploaded in batches to a shared leaderboard server,
+// each with the replay of its session so that the server can check it,
+// and the standings it replies with are merged into highscore_list. All
+// network traffic happens on a worker thread, and so does writing the
+// merged scores to the journal. The frame thread only adds them to the
+// list in memory, and only ever try-locks the shared state in
+// sync_update, so a busy worker delays a hand-off by a frame instead
+// of stalling it. Saving a local score waits for a journal write of the
+// worker in progress, which is one short append, and the worker waits
+// for the save, so that records of the two never interleave.
+//
+// When the server cannot be reached the batch is put back in the
+// outbox and the worker waits before retrying, doubling the wait on
+// each failure up to SYNC_MAX_BACKOFF.
+//
+// Set LAGRANGE_SYNC_SERVER=host:port to enable. See sync_server.cpp for
+// a stand-in server to test against.
+#include "net.cpp"
+#include "sync_protocol.cpp"
+
+#define SYNC_OUTBOX_SIZE      1024
+#define SYNC_KNOWN_SIZE       (2*HIGHSCORE_MAX)
+#define SYNC_POLL_INTERVAL    10000 // ms between standings refreshes
+#define SYNC_MIN_BACKOFF      1000  // ms
+#define SYNC_MAX_BACKOFF      60000 // ms
+#define SYNC_TIMEOUT          2000  // ms for any single send or receive
+#define SYNC_JOURNAL_SIZE     (SYNC_MAX_BATCH*HIGHSCORE_MAX_JOURNAL_RECORD)
+
+struct SyncStatus
+{
+    bool online;
+    int uploaded;
+    int failures;
+    int backoff; // ms until the next attempt after a failure
+    int queued;
+};
+
+struct Sync
+{
+    bool enabled;
+    char server[256];
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *wake;
+
+    // Shared with the worker, protected by mutex
+    bool running;
+    SyncSubmission outbox[SYNC_OUTBOX_SIZE];
+    int outbox_count;
+    Highscore inbox[SYNC_MAX_BATCH];
+    int inbox_count;
+    u08 journal[SYNC_JOURNAL_SIZE]; // Records for the worker to write
+    int journal_length;
+    int journal_records;
+    int journal_written; // Records written, not yet counted in highscore_journal
+    bool journal_failed;
+    SyncStatus shared_status;
+
+    // Frame thread only
+    SyncSubmission pending[SYNC_OUTBOX_SIZE];
+    int pending_count;
+    Highscore merge[SYNC_MAX_BATCH];
+    u08 merged_journal[SYNC_JOURNAL_SIZE]; // Of the last merge, not handed off yet
+    int merged_journal_length;
+    int merged_journal_records;
+    u32 known[SYNC_KNOWN_SIZE]; // Open addressing set of sync_record_hash, 0 is empty
+    int known_count;
+    int merged;
+    SyncStatus status; // Copy of shared_status as of the last sync_update
+
+    // Worker thread only
+    SyncSubmission batch[SYNC_MAX_BATCH];
+    Highscore standings[SYNC_MAX_BATCH];
+    u08 journal_batch[SYNC_JOURNAL_SIZE];
+    u08 buffer[SYNC_HEADER_SIZE+SYNC_MAX_PAYLOAD];
+} sync_state;
+
+// return: true if the hash was not in the set before
+bool sync_remember(u32 hash)
+{
+    if (hash == 0)
+        hash = 1;
+    if (sync_state.known_count >= SYNC_KNOWN_SIZE/2)
+        return true;
+    u32 i = hash % SYNC_KNOWN_SIZE;
+    while (sync_state.known[i] != 0)
+    {
+        if (sync_state.known[i] == hash)
+            return false;
+        i = (i+1) % SYNC_KNOWN_SIZE;
+    }
+    sync_state.known[i] = hash;
+    sync_state.known_count++;
+    return true;
+}
+
+// Runs one submit/standings round trip on the worker thread.
+// return: Number of standings received, or -1 if the server is unavailable.
+int sync_exchange(int batch_count)
+{
+    NetSocket s = net_connect(sync_state.server, SYNC_TIMEOUT);
+    if (s == NET_INVALID_SOCKET)
+        return -1;
+    int received = -1;
+    if (sync_send_submissions(s, sync_state.batch, batch_count, sync_state.buffer))
+        received = sync_receive(s, SYNC_STANDINGS, sync_state.standings, sync_state.buffer);
+    net_close(s);
+    return received;
+}
+
+// Writes the journal records handed to the worker, with the lock held
+// on entry and exit but not while writing.
+void sync_write_journal()
+{
+    int length = sync_state.journal_length;
+    int records = sync_state.journal_records;
+    memcpy(sync_state.journal_batch, sync_state.journal, length);
+    sync_state.journal_length = 0;
+    sync_state.journal_records = 0;
+    SDL_UnlockMutex(sync_state.mutex);
+
+    // Remote scores can be fetched again from the server, so they are
+    // journaled without forcing them to disk.
+    bool written = highscore_write_journal(sync_state.journal_batch, length, false);
+
+    SDL_LockMutex(sync_state.mutex);
+    if (written)
+        sync_state.journal_written += records;
+    else
+        sync_state.journal_failed = true;
+}
+
+int sync_worker(void *)
+{
+    u32 next_attempt = 0;
+    u32 next_poll = 0;
+    SDL_LockMutex(sync_state.mutex);
+    while (sync_state.running)
+    {
+        if (sync_state.journal_length > 0)
+        {
+            sync_write_journal();
+            continue;
+        }
+
+        // Wait until there is something to upload or the standings are
+        // due, but never before the backoff has passed.
+        u32 now = SDL_GetTicks();
+        if ((s32)(next_attempt-now) > 0)
+        {
+            SDL_CondWaitTimeout(sync_state.wake, sync_state.mutex, next_attempt-now);
+            continue;
+        }
+        if (sync_state.outbox_count == 0 && (s32)(next_poll-now) > 0)
+        {
+            SDL_CondWaitTimeout(sync_state.wake, sync_state.mutex, next_poll-now);
+            continue;
+        }
+
+        int n = sync_state.outbox_count < SYNC_MAX_BATCH ? sync_state.outbox_count : SYNC_MAX_BATCH;
+        memcpy(sync_state.batch, sync_state.outbox, n*sizeof(SyncSubmission));
+        sync_state.outbox_count -= n;
+        memmove(sync_state.outbox, sync_state.outbox+n, sync_state.outbox_count*sizeof(SyncSubmission));
+        SDL_UnlockMutex(sync_state.mutex);
+
+        int received = sync_exchange(n);
+
+        SDL_LockMutex(sync_state.mutex);
+        now = SDL_GetTicks();
+        if (received >= 0)
+        {
+            memcpy(sync_state.inbox, sync_state.standings, received*sizeof(Highscore));
+            sync_state.inbox_count = received;
+            sync_state.shared_status.uploaded += n;
+            sync_state.shared_status.backoff = 0;
+            sync_state.shared_status.online = true;
+            next_poll = now+SYNC_POLL_INTERVAL;
+        }
+        else
+        {
+            // Put the batch back in front, dropping the newest scores
+            // if the outbox filled up in the meantime.
+            int keep = SYNC_OUTBOX_SIZE-n;
+            if (sync_state.outbox_count > keep)
+                sync_state.outbox_count = keep;
+            memmove(sync_state.outbox+n, sync_state.outbox, sync_state.outbox_count*sizeof(SyncSubmission));
+            memcpy(sync_state.outbox, sync_state.batch, n*sizeof(SyncSubmission));
+            sync_state.outbox_count += n;
+            SyncStatus *status = &sync_state.shared_status;
+            status->failures++;
+            status->online = false;
+            status->backoff = status->backoff == 0 ? SYNC_MIN_BACKOFF : 2*status->backoff;
+            if (status->backoff > SYNC_MAX_BACKOFF)
+                status->backoff = SYNC_MAX_BACKOFF;
+            next_attempt = now+status->backoff;
+        }
+    }
+    if (sync_state.journal_length > 0)
+        sync_write_journal();
+    SDL_UnlockMutex(sync_state.mutex);
+    return 0;
+}
+
+// Hands the journal records of the last merge to the worker, with the
+// lock held.
+// return: false if they do not fit until the worker catches up
+bool sync_hand_off_journal()
+{
+    int length = sync_state.merged_journal_length;
+    if (length == 0)
+        return true;
+    if (sync_state.journal_length+length > SYNC_JOURNAL_SIZE)
+        return false;
+    memcpy(sync_state.journal+sync_state.journal_length, sync_state.merged_journal, length);
+    sync_state.journal_length += length;
+    sync_state.journal_records += sync_state.merged_journal_records;
+    sync_state.merged_journal_length = 0;
+    sync_state.merged_journal_records = 0;
+    SDL_CondSignal(sync_state.wake);
+    return true;
+}
+
+// Tells highscore.cpp what the worker wrote, with the lock held or the
+// worker stopped.
+void sync_count_journal()
+{
+    highscore_journal.records += sync_state.journal_written;
+    sync_state.journal_written = 0;
+    if (sync_state.journal_failed)
+        highscore_journal.damaged = true;
+    sync_state.journal_failed = false;
+}
+
+void sync_init()
+{
+    sync_state.known_count = 0;
+    memset(sync_state.known, 0, sizeof(sync_state.known));
+    for (int i = 0; i < highscore_list.count; i++)
+    {
+        Highscore h;
+        highscore_get(i, &h);
+        sync_remember(sync_record_hash(&h));
+    }
+
+    const char *server = getenv("LAGRANGE_SYNC_SERVER");
+    if (!server || !server[0] || strlen(server) >= sizeof(sync_state.server) || !net_init())
+        return;
+    strcpy(sync_state.server, server);
+    sync_state.mutex = SDL_CreateMutex();
+    sync_state.wake = SDL_CreateCond();
+    sync_state.running = true;
+    sync_state.thread = SDL_CreateThread(sync_worker, "sync", 0);
+    sync_state.enabled = sync_state.thread != 0;
+}
+
+void sync_shutdown()
+{
+    if (!sync_state.enabled)
+        return;
+    SDL_LockMutex(sync_state.mutex);
+    sync_hand_off_journal();
+    sync_state.running = false;
+    SDL_CondSignal(sync_state.wake);
+    SDL_UnlockMutex(sync_state.mutex);
+    SDL_WaitThread(sync_state.thread, 0);
+    sync_count_journal();
+    SDL_DestroyCond(sync_state.wake);
+    SDL_DestroyMutex(sync_state.mutex);
+    sync_state.enabled = false;
+}
+
+// Queues a locally saved score for upload, together with the replay
+// of the session that the server checks it against.
+void sync_submit(Highscore h, const Replay *replay)
+{
+    sync_remember(sync_record_hash(&h));
+    if (sync_state.enabled && sync_state.pending_count < SYNC_OUTBOX_SIZE)
+    {
+        SyncSubmission *submission = &sync_state.pending[sync_state.pending_count];
+        submission->score = h;
+        submission->replay_length = replay_encode(replay, submission->replay);
+        sync_state.pending_count++;
+    }
+}
+
+// Called once per frame. Hands pending scores to the worker and merges
+// received standings, unless the worker holds the lock right now. The
+// merged scores are handed to the worker to be journaled on the next
+// call. Until then they are only in memory.
+void sync_update()
+{
+    if (!sync_state.enabled)
+        return;
+    if (SDL_TryLockMutex(sync_state.mutex) != 0)
+        return;
+    int moved = 0;
+    while (sync_state.pending_count > moved && sync_state.outbox_count < SYNC_OUTBOX_SIZE)
+    {
+        sync_state.outbox[sync_state.outbox_count] = sync_state.pending[moved];
+        sync_state.outbox_count++;
+        moved++;
+    }
+    sync_state.pending_count -= moved;
+    memmove(sync_state.pending, sync_state.pending+moved, sync_state.pending_count*sizeof(SyncSubmission));
+    if (moved > 0)
+        SDL_CondSignal(sync_state.wake);
+
+    // The standings wait in the inbox while the records of the last
+    // merge do not fit in the worker's journal queue. A newer reply
+    // replaces them, which loses nothing, since it is a whole list too.
+    int received = 0;
+    if (sync_hand_off_journal())
+    {
+        received = sync_state.inbox_count;
+        memcpy(sync_state.merge, sync_state.inbox, received*sizeof(Highscore));
+        sync_state.inbox_count = 0;
+    }
+    sync_count_journal();
+    sync_state.status = sync_state.shared_status;
+    sync_state.status.queued = sync_state.outbox_count+sync_state.pending_count;
+    SDL_UnlockMutex(sync_state.mutex);
+
+    int fresh = 0;
+    for (int i = 0; i < received; i++)
+    {
+        if (sync_remember(sync_record_hash(&sync_state.merge[i])))
+        {
+            sync_state.merge[fresh] = sync_state.merge[i];
+            fresh++;
+        }
+    }
+    int first = highscore_list.count;
+    int added = highscore_add_batch(sync_state.merge, fresh, sync_state.merged_journal,
+                                    &sync_state.merged_journal_length);
+    sync_state.merged_journal_records = added;
+    for (int i = 0; i < added; i++)
+        leaderboard_insert(first+i);
+    sync_state.merged += added;
+}
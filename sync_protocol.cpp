@@ -0,0 +1,198 @@
+// Leaderboard sync wire format, shared by the game and sync_server.
+//
+// Every message is a 16 byte header followed by a payload of packed
+// records. All integers are little-endian.
+//
+//   u32 magic   SYNC_MAGIC
+//   u32 type    SYNC_SUBMIT (client -> server) or SYNC_STANDINGS (reply)
+//   u32 count   Number of records in the payload
+//   u32 length  Number of payload bytes
+//
+// Records are packed with highscore_encode, which takes a typical score
+// from 516 bytes down to 20-30. Submitted records are followed by the
+// replay of the session (see replay.cpp), as a varint length and the
+// encoded bytes, so that the server can check the points.
+#define SYNC_MAGIC            0x3353474c // "LGS3"
+#define SYNC_SUBMIT           1
+#define SYNC_STANDINGS        2
+#define SYNC_HEADER_SIZE      16
+#define SYNC_MAX_BATCH        256
+#define SYNC_MAX_RECORD_SIZE  (HIGHSCORE_MAX_ENCODED+2+REPLAY_MAX_ENCODED)
+#define SYNC_MAX_PAYLOAD      (SYNC_MAX_BATCH*SYNC_MAX_RECORD_SIZE)
+
+struct SyncSubmission
+{
+    Highscore score;
+    int replay_length; // 0 if the session could not be recorded
+    u08 replay[REPLAY_MAX_ENCODED];
+};
+
+struct SyncHeader
+{
+    u32 magic;
+    u32 type;
+    u32 count;
+    u32 length;
+};
+
+void sync_put_u32(u08 *out, u32 x)
+{
+    out[0] = (u08)(x >> 0);
+    out[1] = (u08)(x >> 8);
+    out[2] = (u08)(x >> 16);
+    out[3] = (u08)(x >> 24);
+}
+
+u32 sync_get_u32(const u08 *in)
+{
+    return (u32)in[0] | ((u32)in[1] << 8) | ((u32)in[2] << 16) | ((u32)in[3] << 24);
+}
+
+void sync_write_header(u08 *out, SyncHeader header)
+{
+    sync_put_u32(out+0, header.magic);
+    sync_put_u32(out+4, header.type);
+    sync_put_u32(out+8, header.count);
+    sync_put_u32(out+12, header.length);
+}
+
+// return: false if the header is not a sync header or claims more
+//         than we are willing to receive.
+bool sync_read_header(const u08 *in, SyncHeader *header)
+{
+    header->magic = sync_get_u32(in+0);
+    header->type = sync_get_u32(in+4);
+    header->count = sync_get_u32(in+8);
+    header->length = sync_get_u32(in+12);
+    return header->magic == SYNC_MAGIC &&
+           header->count <= SYNC_MAX_BATCH &&
+           header->length <= SYNC_MAX_PAYLOAD;
+}
+
+// out must hold count*SYNC_MAX_RECORD_SIZE bytes.
+// return: Number of bytes written
+int sync_pack(const Highscore *records, int count, u08 *out)
+{
+    u08 *at = out;
+    for (int i = 0; i < count; i++)
+        at += highscore_encode(&records[i], at);
+    return (int)(at-out);
+}
+
+// return: Number of records unpacked, or -1 if the payload is malformed.
+int sync_unpack(const u08 *in, int length, int count, Highscore *records)
+{
+    const u08 *at = in;
+    const u08 *end = in+length;
+    for (int i = 0; i < count; i++)
+    {
+        int n = highscore_decode(at, end, &records[i]);
+        if (n == 0)
+            return -1;
+        at += n;
+    }
+    return count;
+}
+
+// out must hold count*SYNC_MAX_RECORD_SIZE bytes.
+// return: Number of bytes written
+int sync_pack_submissions(const SyncSubmission *submissions, int count, u08 *out)
+{
+    u08 *at = out;
+    for (int i = 0; i < count; i++)
+    {
+        at += highscore_encode(&submissions[i].score, at);
+        at += highscore_put_varint(at, (u32)submissions[i].replay_length);
+        memcpy(at, submissions[i].replay, submissions[i].replay_length);
+        at += submissions[i].replay_length;
+    }
+    return (int)(at-out);
+}
+
+// return: Number of bytes read, or 0 if the record is malformed.
+int sync_unpack_submission(const u08 *in, const u08 *end, SyncSubmission *submission)
+{
+    const u08 *at = in;
+    int n = highscore_decode(at, end, &submission->score);
+    if (n == 0)
+        return 0;
+    at += n;
+    u32 replay_length;
+    n = highscore_get_varint(at, end, &replay_length);
+    if (n == 0 || replay_length > REPLAY_MAX_ENCODED || replay_length > (u32)(end-at-n))
+        return 0;
+    at += n;
+    memcpy(submission->replay, at, replay_length);
+    submission->replay_length = (int)replay_length;
+    return (int)(at-in)+(int)replay_length;
+}
+
+// return: Number of submissions unpacked, or -1 if the payload is malformed.
+int sync_unpack_submissions(const u08 *in, int length, int count, SyncSubmission *submissions)
+{
+    const u08 *at = in;
+    const u08 *end = in+length;
+    for (int i = 0; i < count; i++)
+    {
+        int n = sync_unpack_submission(at, end, &submissions[i]);
+        if (n == 0)
+            return -1;
+        at += n;
+    }
+    return count;
+}
+
+// return: A hash identifying the record, used to avoid merging the
+//         same score twice (e.g. our own uploads coming back).
+u32 sync_record_hash(const Highscore *h)
+{
+    u32 crc = crc32(0, &h->points, sizeof(h->points));
+    crc = crc32(crc, h->nickname, strlen(h->nickname)+1);
+    return crc32(crc, h->email, strlen(h->email));
+}
+
+// Sends one message whose payload has been packed at buffer+SYNC_HEADER_SIZE.
+// Header and payload go out as a single buffer.
+bool sync_send_packed(NetSocket s, u32 type, int count, int length, u08 *buffer)
+{
+    SyncHeader header;
+    header.magic = SYNC_MAGIC;
+    header.type = type;
+    header.count = (u32)count;
+    header.length = (u32)length;
+    sync_write_header(buffer, header);
+    return net_send_all(s, buffer, SYNC_HEADER_SIZE+length);
+}
+
+bool sync_send(NetSocket s, u32 type, const Highscore *records, int count, u08 *buffer)
+{
+    int length = sync_pack(records, count, buffer+SYNC_HEADER_SIZE);
+    return sync_send_packed(s, type, count, length, buffer);
+}
+
+bool sync_send_submissions(NetSocket s, const SyncSubmission *submissions, int count, u08 *buffer)
+{
+    int length = sync_pack_submissions(submissions, count, buffer+SYNC_HEADER_SIZE);
+    return sync_send_packed(s, SYNC_SUBMIT, count, length, buffer);
+}
+
+// Receives one message and leaves its payload in buffer, which must
+// hold SYNC_MAX_PAYLOAD bytes.
+bool sync_receive_packed(NetSocket s, u32 expected_type, SyncHeader *header, u08 *buffer)
+{
+    u08 raw[SYNC_HEADER_SIZE];
+    return net_recv_all(s, raw, sizeof(raw)) &&
+           sync_read_header(raw, header) &&
+           header->type == expected_type &&
+           net_recv_all(s, buffer, (int)header->length);
+}
+
+// records must hold SYNC_MAX_BATCH entries.
+// return: Number of records received, or -1 on error.
+int sync_receive(NetSocket s, u32 expected_type, Highscore *records, u08 *buffer)
+{
+    SyncHeader header;
+    if (!sync_receive_packed(s, expected_type, &header, buffer))
+        return -1;
+    return sync_unpack(buffer, (int)header.length, (int)header.count, records);
+}
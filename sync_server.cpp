@@ -0,0 +1,198 @@
+// sync_server: a local stand-in for the shared leaderboard server.
+//
+// Accepts SYNC_SUBMIT messages on 127.0.0.1, plays the replay of every
+// submitted score and keeps the distinct scores whose replay ends with
+// the claimed points, of sessions with one roomba and no wind. Replies with the current top SYNC_MAX_BATCH
+// standings. It can be told to drop or delay requests, to check that
+// the game keeps running and backs off while the server misbehaves,
+// and to archive every submission for the verify tool.
+//
+//    $ g++ -O2 ../sync_server.cpp -o sync_server -pthread
+//    $ ./sync_server 7777 --fail-every 3 --delay 500 --archive submissions.dat
+//    $ LAGRANGE_SYNC_SERVER=127.0.0.1:7777 ./game
+#define DETERMINISTIC_PHYSICS
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter() { return (u64)clock(); }
+r32 time_since(u64 then) { return (r32)(clock()-then) / (r32)CLOCKS_PER_SEC; }
+
+#include "highscore.cpp"
+#include "wind.cpp"
+#include "sim.cpp"
+#include "replay.cpp"
+#include "net.cpp"
+#include "sync_protocol.cpp"
+
+#define SERVER_MAX_SCORES (1 << 16)
+
+struct Server
+{
+    Highscore scores[SERVER_MAX_SCORES];
+    u32 hashes[SERVER_MAX_SCORES];
+    int count;
+
+    Highscore top[SYNC_MAX_BATCH]; // Best first
+    int top_count;
+
+    SyncSubmission received[SYNC_MAX_BATCH];
+    ReplayClaim claims[SYNC_MAX_BATCH];
+    int claimed[SYNC_MAX_BATCH]; // Submission of each claim
+    bool verified[SYNC_MAX_BATCH];
+    Replay replay; // Scratch
+    u08 buffer[SYNC_HEADER_SIZE+SYNC_MAX_PAYLOAD];
+} server;
+
+void server_sleep(int milliseconds)
+{
+    #ifdef _WIN32
+    Sleep(milliseconds);
+    #else
+    usleep(milliseconds*1000);
+    #endif
+}
+
+void server_add(Highscore h)
+{
+    u32 hash = sync_record_hash(&h);
+    for (int i = 0; i < server.count; i++)
+        if (server.hashes[i] == hash)
+            return;
+    if (server.count == SERVER_MAX_SCORES)
+        return;
+    server.scores[server.count] = h;
+    server.hashes[server.count] = hash;
+    server.count++;
+
+    // Insertion into the top list, keeping earlier scores ahead on ties
+    int i = server.top_count < SYNC_MAX_BATCH ? server.top_count : SYNC_MAX_BATCH-1;
+    if (i == SYNC_MAX_BATCH-1 && server.top_count == SYNC_MAX_BATCH &&
+        server.top[i].points >= h.points)
+        return;
+    while (i > 0 && server.top[i-1].points < h.points)
+    {
+        server.top[i] = server.top[i-1];
+        i--;
+    }
+    server.top[i] = h;
+    if (server.top_count < SYNC_MAX_BATCH)
+        server.top_count++;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 7777;
+    int fail_every = 0;
+    int delay = 0;
+    const char *archive_path = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fail-every") == 0 && i+1 < argc)
+            fail_every = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--delay") == 0 && i+1 < argc)
+            delay = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--archive") == 0 && i+1 < argc)
+            archive_path = argv[++i];
+        else
+            port = atoi(argv[i]);
+    }
+
+    if (!net_init())
+    {
+        printf("Failed to initialize sockets\n");
+        return 1;
+    }
+    NetSocket listener = net_listen_loopback(port);
+    if (listener == NET_INVALID_SOCKET)
+    {
+        printf("Failed to listen on 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    printf("Listening on 127.0.0.1:%d\n", port);
+
+    for (int connection = 1; ; connection++)
+    {
+        NetSocket client = net_accept(listener);
+        if (client == NET_INVALID_SOCKET)
+            continue;
+        net_set_timeout(client, 2000);
+        if (fail_every > 0 && connection % fail_every == 0)
+        {
+            printf("#%d: dropped on purpose\n", connection);
+            net_close(client);
+            continue;
+        }
+
+        SyncHeader header;
+        int count = -1;
+        if (sync_receive_packed(client, SYNC_SUBMIT, &header, server.buffer))
+            count = sync_unpack_submissions(server.buffer, (int)header.length, (int)header.count, server.received);
+        if (count < 0)
+        {
+            printf("#%d: malformed request\n", connection);
+            net_close(client);
+            continue;
+        }
+
+        // The payload is a sequence of submission records, so archives
+        // can simply be appended to.
+        if (archive_path)
+        {
+            FILE *archive = fopen(archive_path, "ab");
+            if (archive)
+            {
+                fwrite(server.buffer, 1, header.length, archive);
+                fclose(archive);
+            }
+        }
+
+        // Only sessions played in the standard setup are ranked, since
+        // more roombas or wind make for other points. The others are not
+        // worth playing again.
+        int claims = 0;
+        int rejected = 0;
+        int unranked = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const SyncSubmission *s = &server.received[i];
+            if (replay_decode(s->replay, s->replay+s->replay_length, &server.replay) == 0)
+            {
+                rejected++;
+                continue;
+            }
+            if (!replay_is_standard(&server.replay))
+            {
+                unranked++;
+                continue;
+            }
+            server.claims[claims].replay = s->replay;
+            server.claims[claims].length = s->replay_length;
+            server.claims[claims].points = s->score.points;
+            server.claimed[claims] = i;
+            claims++;
+        }
+        replay_verify_batch(server.claims, claims, server.verified);
+        for (int i = 0; i < claims; i++)
+        {
+            if (server.verified[i])
+                server_add(server.received[server.claimed[i]].score);
+            else
+                rejected++;
+        }
+        if (delay > 0)
+            server_sleep(delay);
+        bool sent = sync_send(client, SYNC_STANDINGS, server.top, server.top_count, server.buffer);
+        printf("#%d: received %d, rejected %d, not ranked %d, %d scores in total, replied with %d standings%s\n",
+               connection, count, rejected, unranked, server.count, server.top_count, sent ? "" : " (send failed)");
+        fflush(stdout);
+        net_close(client);
+    }
+    return 0;
+}
@@ -0,0 +1,290 @@
+// sync_test: runs the game's leaderboard sync against sync_server.
+//
+// Plays random sessions and hands them to sync.cpp the way the game
+// does, while another kiosk uploads sessions of its own, some of which
+// the server must not rank: one claiming a point too many, one with more
+// roombas and one sent twice. Waits until everything is uploaded and
+// checks that the local list ends up with every local score and every
+// ranked score of the other kiosk exactly once, and that the list reads
+// back the same from the journal, which the sync worker writes to.
+//
+// The server keeps what it is sent, so start a new one for every run.
+// Give it --fail-every and --delay to check that the client retries.
+// The list is kept in sync_test.dat and sync_test.log, which are
+// deleted first.
+//
+//    $ g++ -O2 ../sync_test.cpp -o sync_test -pthread
+//    $ ./sync_server 7777 --fail-every 3 --delay 500 &
+//    $ LAGRANGE_SYNC_SERVER=127.0.0.1:7777 ./sync_test
+#define DETERMINISTIC_PHYSICS
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+// The few SDL calls that sync.cpp makes, on the standard library
+struct SDL_mutex  { std::mutex mutex; };
+struct SDL_cond   { std::condition_variable cond; };
+struct SDL_Thread { std::thread thread; };
+typedef int (*SDL_ThreadFunction)(void *data);
+SDL_mutex *SDL_CreateMutex()          { return new SDL_mutex; }
+void SDL_DestroyMutex(SDL_mutex *m)   { delete m; }
+int SDL_LockMutex(SDL_mutex *m)       { m->mutex.lock(); return 0; }
+int SDL_TryLockMutex(SDL_mutex *m)    { return m->mutex.try_lock() ? 0 : 1; }
+int SDL_UnlockMutex(SDL_mutex *m)     { m->mutex.unlock(); return 0; }
+SDL_cond *SDL_CreateCond()            { return new SDL_cond; }
+void SDL_DestroyCond(SDL_cond *c)     { delete c; }
+int SDL_CondSignal(SDL_cond *c)       { c->cond.notify_one(); return 0; }
+int SDL_CondWaitTimeout(SDL_cond *c, SDL_mutex *m, u32 ms)
+{
+    std::unique_lock<std::mutex> lock(m->mutex, std::adopt_lock);
+    bool signaled = c->cond.wait_for(lock, std::chrono::milliseconds(ms)) == std::cv_status::no_timeout;
+    lock.release();
+    return signaled ? 0 : 1;
+}
+u32 SDL_GetTicks() { return (u32)(perf_counter()/1000); }
+SDL_Thread *SDL_CreateThread(SDL_ThreadFunction f, const char *, void *data)
+{
+    SDL_Thread *t = new SDL_Thread;
+    t->thread = std::thread(f, data);
+    return t;
+}
+void SDL_WaitThread(SDL_Thread *t, int *)
+{
+    t->thread.join();
+    delete t;
+}
+
+#define HIGHSCORE_SNAPSHOT_PATH "sync_test.dat"
+#define HIGHSCORE_SNAPSHOT_TEMP "sync_test.tmp"
+#define HIGHSCORE_JOURNAL_PATH  "sync_test.log"
+#include "highscore.cpp"
+#include "wind.cpp"
+#include "sim.cpp"
+#include "replay.cpp"
+
+// The leaderboard is not drawn here
+void leaderboard_insert(int) { }
+
+#include "sync.cpp"
+
+#define SYNC_TEST_SEED    0x73796e63
+#define SYNC_TEST_LOCAL   12 // Sessions played here, uploaded in three rounds
+#define SYNC_TEST_REMOTE  20 // Sessions of the other kiosk
+#define SYNC_TEST_TIMEOUT 60 // s to wait for each round
+
+Replay replay;
+Sim sim;
+
+// A player that holds a random key combination for 1-32 ticks at a
+// time, like verify --generate.
+void sync_test_play(int index, int roombas)
+{
+    WindParams wind;
+    wind_defaults(&wind);
+    sim_init(&sim, &wind, roombas);
+    replay_begin(&replay, &wind, roombas);
+    RngKey key = rng_key(SYNC_TEST_SEED);
+    u32 keys = 0;
+    int hold = 0;
+    for (u64 draw = 0; sim.playing && replay.ticks < REPLAY_MAX_TICKS; )
+    {
+        if (hold == 0)
+        {
+            u32 r = rng_u32(key, (u64)index, draw++);
+            keys = r & 15;
+            hold = 1+((r >> 4) & 31);
+        }
+        replay_record(&replay, keys);
+        sim_step(&sim, keys, REPLAY_DT);
+        hold--;
+    }
+}
+
+// Uploads the other kiosk's sessions, retrying while the server drops
+// the request.
+// ranked: Set to whether the server should rank each one
+bool sync_test_upload_remote(bool *ranked)
+{
+    static SyncSubmission submissions[SYNC_TEST_REMOTE+1];
+    int count = 0;
+    for (int i = 0; i < SYNC_TEST_REMOTE; i++)
+    {
+        int roombas = i == 3 ? 2 : 1;
+        sync_test_play(1000+i, roombas);
+        SyncSubmission *s = &submissions[count++];
+        s->score.points = sim.points + (i == 7 ? 1 : 0);
+        sprintf(s->score.nickname, "remote%d", i);
+        sprintf(s->score.email, "remote%d@example.com", i);
+        s->replay_length = replay_encode(&replay, s->replay);
+        ranked[i] = roombas == 1 && i != 7;
+    }
+    submissions[count++] = submissions[0];
+
+    static u08 buffer[SYNC_HEADER_SIZE+SYNC_MAX_PAYLOAD];
+    static Highscore standings[SYNC_MAX_BATCH];
+    for (int attempt = 0; attempt < 10; attempt++)
+    {
+        NetSocket s = net_connect(sync_state.server, SYNC_TIMEOUT);
+        bool sent = s != NET_INVALID_SOCKET &&
+                    sync_send_submissions(s, submissions, count, buffer) &&
+                    sync_receive(s, SYNC_STANDINGS, standings, buffer) >= 0;
+        net_close(s);
+        if (sent)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(SYNC_MIN_BACKOFF));
+    }
+    return false;
+}
+
+// Pumps sync_update like the frame loop until the worker has uploaded
+// everything and merged the expected number of scores.
+bool sync_test_wait(int uploaded, int merged)
+{
+    u64 begin = perf_counter();
+    while (time_since(begin) < SYNC_TEST_TIMEOUT)
+    {
+        sync_update();
+        if (sync_state.status.uploaded == uploaded && sync_state.status.queued == 0 &&
+            sync_state.merged == merged)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    printf("Timed out with %d of %d uploaded and %d of %d merged\n",
+           sync_state.status.uploaded, uploaded, sync_state.merged, merged);
+    return false;
+}
+
+// return: Number of list entries equal to h
+int sync_test_count(const Highscore *h)
+{
+    int count = 0;
+    for (int i = 0; i < highscore_list.count; i++)
+    {
+        Highscore other;
+        highscore_get(i, &other);
+        if (other.points == h->points && strcmp(other.nickname, h->nickname) == 0 &&
+            strcmp(other.email, h->email) == 0)
+            count++;
+    }
+    return count;
+}
+
+int main()
+{
+    if (!getenv("LAGRANGE_SYNC_SERVER"))
+    {
+        printf("usage: LAGRANGE_SYNC_SERVER=host:port sync_test\n");
+        return 1;
+    }
+    remove(HIGHSCORE_SNAPSHOT_PATH);
+    remove(HIGHSCORE_SNAPSHOT_TEMP);
+    remove(HIGHSCORE_JOURNAL_PATH);
+    highscore_load();
+    sync_init();
+    if (!sync_state.enabled)
+    {
+        printf("Failed to start the sync worker\n");
+        return 1;
+    }
+
+    bool ranked[SYNC_TEST_REMOTE];
+    if (!sync_test_upload_remote(ranked))
+    {
+        printf("Failed to reach %s\n", sync_state.server);
+        return 1;
+    }
+    int expected = 0;
+    for (int i = 0; i < SYNC_TEST_REMOTE; i++)
+        expected += ranked[i] ? 1 : 0;
+
+    // Local scores are saved and submitted like at the end of a session.
+    // The last one claims a point too many, which the server rejects but
+    // the list keeps. The first round merges the other kiosk's scores,
+    // and the saves of the next rounds journal them again, ahead of the
+    // worker, see highscore_save_batch.
+    Highscore local[SYNC_TEST_LOCAL];
+    bool passed = true;
+    for (int round = 0; round < 3 && passed; round++)
+    {
+        for (int i = round*SYNC_TEST_LOCAL/3; i < (round+1)*SYNC_TEST_LOCAL/3; i++)
+        {
+            sync_test_play(i, 1);
+            local[i].points = sim.points + (i == SYNC_TEST_LOCAL-1 ? 1 : 0);
+            sprintf(local[i].nickname, "local%d", i);
+            sprintf(local[i].email, "local%d@example.com", i);
+            highscore_save(local[i]);
+            sync_submit(local[i], &replay);
+        }
+        passed = sync_test_wait((round+1)*SYNC_TEST_LOCAL/3, expected);
+    }
+    SyncStatus status = sync_state.status;
+    sync_shutdown();
+
+    // Every local score once, every ranked remote score once, and
+    // nothing else
+    for (int i = 0; i < SYNC_TEST_LOCAL; i++)
+    {
+        if (sync_test_count(&local[i]) != 1)
+        {
+            printf("%s is in the list %d times\n", local[i].nickname, sync_test_count(&local[i]));
+            passed = false;
+        }
+    }
+    for (int i = 0; i < SYNC_TEST_REMOTE; i++)
+    {
+        char nickname[32];
+        sprintf(nickname, "remote%d", i);
+        int count = 0;
+        for (int j = 0; j < highscore_list.count; j++)
+        {
+            Highscore other;
+            highscore_get(j, &other);
+            count += strcmp(other.nickname, nickname) == 0 ? 1 : 0;
+        }
+        if (count != (ranked[i] ? 1 : 0))
+        {
+            printf("remote%d is in the list %d times, expected %d\n", i, count, ranked[i] ? 1 : 0);
+            passed = false;
+        }
+    }
+    if (highscore_list.count != SYNC_TEST_LOCAL+expected)
+    {
+        printf("The list has %d scores, expected %d\n", highscore_list.count, SYNC_TEST_LOCAL+expected);
+        passed = false;
+    }
+
+    // The list must read back the same from the snapshot and journal
+    int count = highscore_list.count;
+    u32 used = highscore_list.data_used;
+    u08 *data = (u08*)malloc(used);
+    memcpy(data, highscore_list.data, used);
+    highscore_load();
+    if (highscore_list.count != count || highscore_list.data_used != used ||
+        memcmp(highscore_list.data, data, used) != 0)
+    {
+        printf("The list read back with %d scores, expected %d\n", highscore_list.count, count);
+        passed = false;
+    }
+    free(data);
+
+    printf("%d uploaded, %d failed attempts, %d merged, %d journal records, %d replayed: %s\n",
+           status.uploaded, status.failures, sync_state.merged, highscore_journal.records,
+           highscore_journal.replayed, passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
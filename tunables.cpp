@@ -0,0 +1,269 @@
+// Tunables
+//
+// The constants of the simulation (see SimParams) can be changed while
+// the game runs, by editing a text file next to it:
+//
+//    # tunables.txt
+//    spring.k       60
+//    roombas.speed  0.5
+//    timer.session  90
+//
+// Constants that are not listed keep their defaults, and so do all of
+// them while there is no file. Sessions played with other constants
+// can not be replayed, so the leaderboard server rejects their scores.
+//
+// A worker thread watches the file (with inotify on Linux, by polling
+// its modification time elsewhere) and parses it whenever it is saved.
+// Each parse makes a new block of constants that is never written
+// again, and hands it to the frame thread with one atomic pointer
+// exchange. tunables_update takes the newest block with another
+// exchange, so the frame thread never waits for the worker. A file
+// with errors is reported and otherwise ignored, and the last good
+// block stays in effect.
+//
+// Set LAGRANGE_TUNABLES to use another file than tunables.txt.
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#define TUNABLES_PATH          "tunables.txt"
+#define TUNABLES_POLL_INTERVAL 250 // ms between checks for changes and shutdown
+
+// An immutable block of constants as parsed from the file
+struct TunablesBlock
+{
+    SimParams params;
+    bool ok;          // Otherwise error says why, and params are not used
+    char error[256];
+    r32 parse_ms;
+    u64 saved;        // perf_counter when the worker saw the file change
+};
+
+struct Tunables
+{
+    bool enabled;
+    char path[256];
+    SDL_Thread *thread;
+    SDL_atomic_t running;
+
+    // Published by the worker, taken by the frame thread
+    void *pending;
+
+    // Frame thread only
+    TunablesBlock *current; // Of the last file without errors, or null for the defaults
+    SimParams defaults;
+    int reloads;
+    char error[256];       // Of the last parse, empty if it had none
+    r32 parse_ms;
+    r32 reload_ms;         // From the worker seeing the change to the block being taken
+} tunables;
+
+// return: A new block, never null unless out of memory
+TunablesBlock *tunables_parse(const char *path)
+{
+    u64 begin = perf_counter();
+    TunablesBlock *block = (TunablesBlock*)malloc(sizeof(TunablesBlock));
+    if (!block)
+        return 0;
+    block->saved = begin;
+    sim_defaults(&block->params);
+    block->ok = true;
+    block->error[0] = 0;
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        // No file is no error, everything keeps its default
+        block->parse_ms = 1000.0f*time_since(begin);
+        return block;
+    }
+    char line[1024];
+    int line_number = 0;
+    while (block->ok && fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        char name[64];
+        r32 value;
+        char extra;
+        int n = sscanf(line, "%63s %f %c", name, &value, &extra);
+        if (n <= 0)
+            continue;
+        int i = sim_find_param(name);
+        if (i < 0)
+        {
+            snprintf(block->error, sizeof(block->error), "%s:%d: unknown constant %s", path, line_number, name);
+            block->ok = false;
+        }
+        else if (n != 2)
+        {
+            snprintf(block->error, sizeof(block->error), "%s:%d: expected one value for %s", path, line_number, name);
+            block->ok = false;
+        }
+        else
+        {
+            *sim_param(&block->params, i) = value;
+        }
+    }
+    fclose(file);
+    block->parse_ms = 1000.0f*time_since(begin);
+    return block;
+}
+
+void tunables_publish(TunablesBlock *block)
+{
+    // If the frame thread has not taken the previous block yet, it
+    // never will, so it is ours to free.
+    TunablesBlock *unread = (TunablesBlock*)SDL_AtomicSetPtr(&tunables.pending, block);
+    free(unread);
+}
+
+bool tunables_modified(const char *path, time_t *mtime)
+{
+    struct stat info;
+    time_t t = stat(path, &info) == 0 ? info.st_mtime : 0;
+    bool modified = t != *mtime;
+    *mtime = t;
+    return modified;
+}
+
+int tunables_worker(void *)
+{
+    const char *path = tunables.path;
+    time_t mtime = 0;
+    tunables_modified(path, &mtime);
+
+    #ifdef __linux__
+    // Editors often save by writing another file and renaming it over
+    // this one, so watch the directory for anything that happens to a
+    // file of this name.
+    char directory[256];
+    const char *name = strrchr(path, '/');
+    if (name)
+    {
+        snprintf(directory, sizeof(directory), "%.*s", (int)(name-path), path);
+        name++;
+    }
+    else
+    {
+        strcpy(directory, ".");
+        name = path;
+    }
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd >= 0 && inotify_add_watch(fd, directory[0] ? directory : "/", IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE|IN_DELETE|IN_MOVED_FROM) < 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    #endif
+
+    while (SDL_AtomicGet(&tunables.running))
+    {
+        bool changed = false;
+        #ifdef __linux__
+        if (fd >= 0)
+        {
+            pollfd p = { fd, POLLIN, 0 };
+            if (poll(&p, 1, TUNABLES_POLL_INTERVAL) > 0)
+            {
+                alignas(inotify_event) char events[4096];
+                ssize_t length;
+                while ((length = read(fd, events, sizeof(events))) > 0)
+                {
+                    for (char *at = events; at < events+length; )
+                    {
+                        inotify_event *event = (inotify_event*)at;
+                        if (event->len > 0 && strcmp(event->name, name) == 0)
+                            changed = true;
+                        at += sizeof(inotify_event)+event->len;
+                    }
+                }
+            }
+        }
+        else
+        #endif
+        {
+            SDL_Delay(TUNABLES_POLL_INTERVAL);
+            changed = tunables_modified(path, &mtime);
+        }
+        if (changed)
+        {
+            TunablesBlock *block = tunables_parse(path);
+            if (block)
+                tunables_publish(block);
+        }
+    }
+
+    #ifdef __linux__
+    if (fd >= 0)
+        close(fd);
+    #endif
+    return 0;
+}
+
+void tunables_init()
+{
+    sim_defaults(&tunables.defaults);
+    tunables.current = 0;
+    tunables.pending = 0;
+    tunables.reloads = 0;
+    tunables.error[0] = 0;
+
+    const char *path = getenv("LAGRANGE_TUNABLES");
+    if (!path || !path[0])
+        path = TUNABLES_PATH;
+    if (strlen(path) >= sizeof(tunables.path))
+        return;
+    strcpy(tunables.path, path);
+
+    // The first parse happens before the first session, so that it
+    // starts with the file as it is.
+    TunablesBlock *block = tunables_parse(tunables.path);
+    if (block)
+        tunables_publish(block);
+    SDL_AtomicSet(&tunables.running, 1);
+    tunables.thread = SDL_CreateThread(tunables_worker, "tunables", 0);
+    tunables.enabled = tunables.thread != 0;
+}
+
+void tunables_shutdown()
+{
+    if (!tunables.enabled)
+        return;
+    SDL_AtomicSet(&tunables.running, 0);
+    SDL_WaitThread(tunables.thread, 0);
+    tunables.enabled = false;
+    free(SDL_AtomicSetPtr(&tunables.pending, 0));
+    free(tunables.current);
+    tunables.current = 0;
+}
+
+// Called once per frame, between ticks.
+// return: The constants to simulate with from now on
+const SimParams *tunables_update()
+{
+    TunablesBlock *block = (TunablesBlock*)SDL_AtomicSetPtr(&tunables.pending, 0);
+    if (block)
+    {
+        tunables.reloads++;
+        tunables.parse_ms = block->parse_ms;
+        tunables.reload_ms = 1000.0f*time_since(block->saved);
+        strcpy(tunables.error, block->error);
+        if (block->ok)
+        {
+            free(tunables.current);
+            tunables.current = block;
+        }
+        else
+        {
+            free(block);
+        }
+    }
+    return tunables.current ? &tunables.current->params : &tunables.defaults;
+}
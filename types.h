@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+typedef float       r32;
+typedef uint64_t    u64;
+typedef uint32_t    u32;
+typedef uint16_t    u16;
+typedef uint8_t     u08;
+typedef int8_t      s08;
+typedef int16_t     s16;
+typedef int32_t     s32;
+typedef int64_t     s64;
+#define global static
+#define persist static
+#define array_count(list) (sizeof((list))/sizeof((list)[0]))
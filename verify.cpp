@@ -0,0 +1,229 @@
+// verify: checks submitted scores by playing their replays.
+//
+// Reads files of submission records, as archived by sync_server, plays
+// every replay headless on all cores and lists the scores whose replay
+// does not end with the claimed points. Run it over the archive after
+// a change to the simulation, to see which scores it would invalidate.
+//
+//    $ g++ -O2 ../verify.cpp -o verify -pthread
+//    $ ./verify submissions.dat
+//    $ ./verify --threads 4 submissions.dat
+//
+// --generate writes a file of random sessions to test with, where every
+// tenth session claims one point too many. --roombas sets the number of
+// roombas in the generated sessions.
+//
+//    $ ./verify --generate 5000 test.dat
+//    $ ./verify --roombas 1000 --generate 100 crowded.dat
+//
+// --events lists how often each kind of event happened in the verified
+// sessions, in total and per minute of play.
+//
+//    $ ./verify --events submissions.dat
+#define DETERMINISTIC_PHYSICS
+#include "determinism.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "lib/so_math.h"
+#define SO_NOISE_IMPLEMENTATION
+#include "lib/so_noise.h"
+
+u64 perf_counter()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+r32 time_since(u64 then) { return (r32)(perf_counter()-then) / 1000000.0f; }
+
+#include "highscore.cpp"
+#include "wind.cpp"
+#include "sim.cpp"
+#include "replay.cpp"
+#include "net.cpp"
+#include "sync_protocol.cpp"
+
+#define VERIFY_SEED 0x766572696679
+
+int verify_roombas = 1;
+bool verify_events = false;
+
+// A player that holds a random key combination for 1-32 ticks at a time.
+void verify_generate_session(int index, Replay *replay, Sim *sim)
+{
+    WindParams wind;
+    wind_defaults(&wind);
+    sim_init(sim, &wind, verify_roombas);
+    replay_begin(replay, &wind, verify_roombas);
+    RngKey key = rng_key(VERIFY_SEED);
+    u32 keys = 0;
+    int hold = 0;
+    for (u64 draw = 0; sim->playing && replay->ticks < REPLAY_MAX_TICKS; )
+    {
+        if (hold == 0)
+        {
+            u32 r = rng_u32(key, (u64)index, draw++);
+            keys = r & 15;
+            hold = 1+((r >> 4) & 31);
+        }
+        replay_record(replay, keys);
+        sim_step(sim, keys, REPLAY_DT);
+        hold--;
+    }
+}
+
+int verify_generate(const char *path, int count)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Failed to open %s\n", path);
+        return 1;
+    }
+    Replay *replay = (Replay*)malloc(sizeof(Replay));
+    Sim *sim = (Sim*)malloc(sizeof(Sim));
+    SyncSubmission *submission = (SyncSubmission*)malloc(sizeof(SyncSubmission));
+    u08 *record = (u08*)malloc(SYNC_MAX_RECORD_SIZE);
+    u64 bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        verify_generate_session(i, replay, sim);
+        submission->score.points = sim->points + (i % 10 == 9 ? 1 : 0);
+        sprintf(submission->score.nickname, "bot%d", i);
+        sprintf(submission->score.email, "bot%d@example.com", i);
+        submission->replay_length = replay_encode(replay, submission->replay);
+        int length = sync_pack_submissions(submission, 1, record);
+        fwrite(record, 1, length, file);
+        bytes += submission->replay_length;
+    }
+    fclose(file);
+    printf("Wrote %d sessions to %s, %.0f bytes of replay per session\n",
+           count, path, count > 0 ? bytes / (double)count : 0.0);
+    free(replay);
+    free(sim);
+    free(submission);
+    free(record);
+    return 0;
+}
+
+bool verify_read_file(const char *path, u08 **data, int *length)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    *length = (int)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = (u08*)malloc(*length > 0 ? *length : 1);
+    bool ok = *data && fread(*data, 1, *length, file) == (size_t)*length;
+    fclose(file);
+    return ok;
+}
+
+int verify_file(const char *path, int threads)
+{
+    u08 *data;
+    int length;
+    if (!verify_read_file(path, &data, &length))
+    {
+        printf("Failed to read %s\n", path);
+        return 1;
+    }
+
+    // Every record takes at least 4 bytes: points, two string lengths
+    // and a replay length.
+    int capacity = length/4+1;
+    SyncSubmission *submissions = (SyncSubmission*)malloc(capacity*sizeof(SyncSubmission));
+    int count = 0;
+    const u08 *at = data;
+    const u08 *end = data+length;
+    while (at < end && count < capacity)
+    {
+        int n = sync_unpack_submission(at, end, &submissions[count]);
+        if (n == 0)
+        {
+            printf("%s: malformed record at byte %d, ignoring the rest\n", path, (int)(at-data));
+            break;
+        }
+        at += n;
+        count++;
+    }
+
+    ReplayClaim *claims = (ReplayClaim*)malloc(count*sizeof(ReplayClaim)+1);
+    bool *verified = (bool*)malloc(count*sizeof(bool)+1);
+    ReplayStats *stats = verify_events ? (ReplayStats*)malloc(count*sizeof(ReplayStats)+1) : 0;
+    for (int i = 0; i < count; i++)
+    {
+        claims[i].replay = submissions[i].replay;
+        claims[i].length = submissions[i].replay_length;
+        claims[i].points = submissions[i].score.points;
+    }
+    u64 begin = perf_counter();
+    replay_verify_batch(claims, count, verified, threads, stats);
+    r32 seconds = time_since(begin);
+
+    int rejected = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!verified[i])
+        {
+            printf("rejected: %d points, %s (%s)\n", submissions[i].score.points,
+                   submissions[i].score.nickname, submissions[i].score.email);
+            rejected++;
+        }
+    }
+    printf("%s: %d submissions, %d verified, %d rejected in %.2f s (%.0f per second)\n",
+           path, count, count-rejected, rejected, seconds, seconds > 0.0f ? count/seconds : 0.0f);
+    if (stats)
+    {
+        u64 ticks = 0;
+        u64 events[NUM_SIM_EVENTS] = {};
+        for (int i = 0; i < count; i++)
+        {
+            if (!verified[i])
+                continue;
+            ticks += stats[i].ticks;
+            for (int j = 0; j < NUM_SIM_EVENTS; j++)
+                events[j] += stats[i].events[j];
+        }
+        double minutes = ticks*(double)REPLAY_DT/60.0;
+        for (int j = 0; j < NUM_SIM_EVENTS; j++)
+        {
+            printf("  %-14s %10llu %10.1f per minute\n", sim_event_name((SimEventType)j),
+                   (unsigned long long)events[j], minutes > 0.0 ? events[j]/minutes : 0.0);
+        }
+    }
+    free(data);
+    free(submissions);
+    free(claims);
+    free(verified);
+    free(stats);
+    return rejected > 0 ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 0;
+    int result = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--events") == 0)
+            verify_events = true;
+        else if (strcmp(argv[i], "--roombas") == 0 && i+1 < argc)
+            verify_roombas = m_clamp(atoi(argv[++i]), 1, MAX_ROOMBAS);
+        else if (strcmp(argv[i], "--generate") == 0 && i+2 < argc)
+        {
+            int count = atoi(argv[++i]);
+            result |= verify_generate(argv[++i], count);
+        }
+        else
+            result |= verify_file(argv[i], threads);
+    }
+    if (argc < 2)
+        printf("usage: verify [--threads n] [--events] [--roombas n] [--generate count file] file...\n");
+    return result;
+}
@@ -0,0 +1,144 @@
+// Wind
+//
+// Disturbance forces from a turbulent wind field. The wind velocity is a
+// steady mean plus gusts, one fBm field per component:
+//
+//     w(p, t) = intensity*(mean + gust*fbm((p - mean*t)/length_scale + (0, t/time_scale)))
+//
+// The gusts are carried downwind by the mean, and slide through the
+// noise at 1/time_scale per second so that they also come and go where
+// the mean wind is zero. A body with velocity v feels the quadratic drag
+//
+//     F = drag*|w - v|*(w - v)
+//
+// The drag is air resistance, and acts with or without wind, so that a
+// flight changes smoothly with the intensity. There is none by default,
+// wind_air turns it on with the coefficients the wind is tuned for.
+//
+// The field is only evaluated where it is felt: sim_step samples it at
+// the player and the pendulum once per step, which takes 12 gradient
+// noise lookups for the default 3 octaves. That is cheap enough for
+// every world of a batch to have its own wind, at its own time.
+#define WIND_MAX_INTENSITY 3.0f
+#define WIND_PLAYER_DRAG   0.3f
+#define WIND_PENDULUM_DRAG 0.02f
+#define WIND_MAX_COORD     1e6f // Noise coordinates beyond this are clamped
+
+struct WindParams
+{
+    r32 intensity;    // 0 turns the wind off
+    vec2 mean;        // m/s
+    r32 gust;         // m/s, amplitude of the turbulence
+    r32 length_scale; // m, size of a gust
+    r32 time_scale;   // s, lifetime of a gust
+    int octaves;
+
+    r32 player_drag;   // N/(m/s)^2, 0 for none
+    r32 pendulum_drag; // N/(m/s)^2, 0 for none
+};
+
+struct Wind
+{
+    WindParams params;
+    r32 time;
+    vec2 at_player;   // m/s, sampled by the last step
+    vec2 at_pendulum; // m/s, sampled by the last step
+};
+
+void wind_defaults(WindParams *params)
+{
+    params->intensity = 0.0f;
+    params->mean = m_vec2(0.5f, 0.0f);
+    params->gust = 2.0f;
+    params->length_scale = 2.0f;
+    params->time_scale = 3.0f;
+    params->octaves = 3;
+    params->player_drag = 0.0f;
+    params->pendulum_drag = 0.0f;
+}
+
+// Turns on the drag, without which the wind has nothing to push on.
+void wind_air(WindParams *params)
+{
+    params->player_drag = WIND_PLAYER_DRAG;
+    params->pendulum_drag = WIND_PENDULUM_DRAG;
+}
+
+// return: true if the game can be set to these params, the defaults with
+//         an intensity from the slider and the drag on or off. Others,
+//         e.g. a length_scale of 0 or thousands of octaves, can not be
+//         evaluated, so params from elsewhere are checked with this.
+bool wind_allowed(const WindParams *params)
+{
+    WindParams defaults;
+    wind_defaults(&defaults);
+    bool still = params->player_drag == 0.0f && params->pendulum_drag == 0.0f;
+    bool air = params->player_drag == WIND_PLAYER_DRAG && params->pendulum_drag == WIND_PENDULUM_DRAG;
+
+    // Written so that NaN fails every comparison
+    return params->intensity >= 0.0f && params->intensity <= WIND_MAX_INTENSITY &&
+           params->mean.x == defaults.mean.x && params->mean.y == defaults.mean.y &&
+           params->gust == defaults.gust &&
+           params->length_scale == defaults.length_scale &&
+           params->time_scale == defaults.time_scale &&
+           params->octaves == defaults.octaves &&
+           (still || air);
+}
+
+// return: true if these are the defaults, the still air that the
+//         leaderboard ranks
+bool wind_is_default(const WindParams *params)
+{
+    WindParams defaults;
+    wind_defaults(&defaults);
+    return wind_allowed(params) &&
+           params->intensity == defaults.intensity &&
+           params->player_drag == defaults.player_drag &&
+           params->pendulum_drag == defaults.pendulum_drag;
+}
+
+// Keeps a noise coordinate in the range that the lattice can be
+// indexed with. Written so that NaN fails the test and becomes 0.
+r32 wind_clamp_coord(r32 x)
+{
+    return x >= -WIND_MAX_COORD ? m_min(x, WIND_MAX_COORD) : 0.0f;
+}
+
+// Samples the wind at time at two points, a and b, which is what a
+// step needs for the player and the pendulum. The four components are
+// evaluated together, four lanes wide.
+void wind_sample(const WindParams *params, r32 time, vec2 a, vec2 b, vec2 *at_a, vec2 *at_b)
+{
+    if (params->intensity == 0.0f)
+    {
+        *at_a = m_vec2(0.0f, 0.0f);
+        *at_b = m_vec2(0.0f, 0.0f);
+        return;
+    }
+    r32 s = 1.0f / params->length_scale;
+    r32 drift_x = params->mean.x*time;
+    r32 drift_y = params->mean.y*time;
+    r32 slide = time/params->time_scale;
+    r32 xa = wind_clamp_coord((a.x - drift_x)*s);
+    r32 ya = wind_clamp_coord((a.y - drift_y)*s + slide);
+    r32 xb = wind_clamp_coord((b.x - drift_x)*s);
+    r32 yb = wind_clamp_coord((b.y - drift_y)*s + slide);
+
+    // u and v at a, then u and v at b. v is the same noise, shifted.
+    r32 x[4] = { xa, xa + 57.0f, xb, xb + 57.0f };
+    r32 y[4] = { ya, ya + 31.0f, yb, yb + 31.0f };
+    r32 w[4];
+    fbm2f_n(x, y, w, 4, params->octaves);
+    *at_a = params->intensity*(params->mean + params->gust*m_vec2(w[0], w[1]));
+    *at_b = params->intensity*(params->mean + params->gust*m_vec2(w[2], w[3]));
+}
+
+// return: The drag force of the air, moving at wind, on a body moving
+//         at velocity
+vec2 wind_force(vec2 wind, vec2 velocity, r32 drag)
+{
+    if (drag == 0.0f)
+        return m_vec2(0.0f, 0.0f);
+    vec2 relative = wind - velocity;
+    return drag*m_length(relative)*relative;
+}